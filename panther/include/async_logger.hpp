@@ -0,0 +1,75 @@
+/* ----------------------------------------------------------------------------
+ * Copyright 2021, Jesus Tordesillas Torres, Aerospace Controls Laboratory
+ * Massachusetts Institute of Technology
+ * All Rights Reserved
+ * Authors: Jesus Tordesillas, et al.
+ * See LICENSE file for the license information
+ * -------------------------------------------------------------------------- */
+
+#ifndef ASYNC_LOGGER_HPP
+#define ASYNC_LOGGER_HPP
+
+#include <atomic>
+#include <cstdint>
+#include <fstream>
+#include <memory>
+#include <string>
+#include <thread>
+
+namespace tp  // Tracker and predictor
+{
+enum logRecordType : uint8_t
+{
+  LOG_SUCCESSIVE_DETECTIONS = 0,  // values: [number of different samples of a track that has been removed]
+  LOG_TIMES = 1,                  // values: [ms of each timer of tp::logtp] (see TrackerPredictor::publishingStage())
+};
+
+const int LOG_MAX_VALUES = 16;
+
+struct logRecord
+{
+  uint8_t type;
+  uint8_t num_values;
+  double time;  // in seconds
+  float values[LOG_MAX_VALUES];
+};
+
+// Logger whose log() never does file I/O nor blocks: the records are stored in a lock-free bounded buffer (multiple
+// producers, single consumer) that a background thread drains into a binary file. If the buffer is full, the record
+// is dropped (and counted). Format of the file: the magic string "TPLOG1\n", followed by the records, each one stored
+// as [uint8 type][uint8 num_values][float64 time][float32 values[num_values]] (byte order of the machine, no padding)
+class AsyncLogger
+{
+public:
+  AsyncLogger(const std::string& file_name, size_t capacity);
+  ~AsyncLogger();
+
+  // Returns false if the record has been dropped because the buffer is full
+  bool log(logRecordType type, double time, const float* values, int num_values);
+
+  uint64_t getNumDropped() const;
+
+private:
+  void writerLoop();
+  bool pop(tp::logRecord& record);
+
+  struct slot
+  {
+    std::atomic<size_t> sequence;
+    tp::logRecord record;
+  };
+
+  std::unique_ptr<slot[]> slots_;
+  size_t mask_;
+  std::atomic<size_t> enqueue_pos_;
+  size_t dequeue_pos_ = 0;  // Only used by the writer thread
+
+  std::atomic<bool> stop_;
+  std::atomic<uint64_t> num_dropped_;
+
+  std::ofstream file_;
+  std::thread writer_;
+};
+}  // namespace tp
+
+#endif
@@ -0,0 +1,93 @@
+/* ----------------------------------------------------------------------------
+ * Copyright 2021, Jesus Tordesillas Torres, Aerospace Controls Laboratory
+ * Massachusetts Institute of Technology
+ * All Rights Reserved
+ * Authors: Jesus Tordesillas, et al.
+ * See LICENSE file for the license information
+ * -------------------------------------------------------------------------- */
+
+#ifndef BOUNDED_QUEUE_HPP
+#define BOUNDED_QUEUE_HPP
+
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <utility>
+
+namespace tp  // Tracker and predictor
+{
+// Thread-safe FIFO queue with a maximum capacity, used to connect the stages of the pipeline of TrackerPredictor
+template <typename T>
+class BoundedQueue
+{
+public:
+  BoundedQueue(size_t capacity) : capacity_(capacity)
+  {
+  }
+
+  // Blocks while the queue is full. Returns false (and the element is not pushed) if the queue has been closed
+  bool push(const T& element)
+  {
+    std::unique_lock<std::mutex> lock(mtx_);
+    cv_not_full_.wait(lock, [this] { return closed_ || queue_.size() < capacity_; });
+    if (closed_)
+    {
+      return false;
+    }
+    queue_.push_back(element);
+    cv_not_empty_.notify_one();
+    return true;
+  }
+
+  // Never blocks: if the queue is full, the oldest element is discarded (and moved to discarded_element). Returns true
+  // if an element was discarded
+  bool pushDiscardingOldest(const T& element, T& discarded_element)
+  {
+    std::lock_guard<std::mutex> lock(mtx_);
+    bool discarded = false;
+    if (queue_.size() >= capacity_)
+    {
+      discarded_element = std::move(queue_.front());
+      queue_.pop_front();
+      discarded = true;
+    }
+    queue_.push_back(element);
+    cv_not_empty_.notify_one();
+    return discarded;
+  }
+
+  // Blocks while the queue is empty. Returns false if the queue has been closed (and it's empty)
+  bool pop(T& element)
+  {
+    std::unique_lock<std::mutex> lock(mtx_);
+    cv_not_empty_.wait(lock, [this] { return closed_ || !queue_.empty(); });
+    if (queue_.empty())
+    {
+      return false;
+    }
+    element = queue_.front();
+    queue_.pop_front();
+    cv_not_full_.notify_one();
+    return true;
+  }
+
+  // Wakes up all the threads waiting in push() or pop()
+  void close()
+  {
+    std::lock_guard<std::mutex> lock(mtx_);
+    closed_ = true;
+    cv_not_empty_.notify_all();
+    cv_not_full_.notify_all();
+  }
+
+private:
+  size_t capacity_;
+  bool closed_ = false;
+  std::deque<T> queue_;
+  std::mutex mtx_;
+  std::condition_variable cv_not_empty_;
+  std::condition_variable cv_not_full_;
+};
+}  // namespace tp
+
+#endif
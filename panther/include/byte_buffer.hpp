@@ -0,0 +1,64 @@
+/* ----------------------------------------------------------------------------
+ * Copyright 2021, Jesus Tordesillas Torres, Aerospace Controls Laboratory
+ * Massachusetts Institute of Technology
+ * All Rights Reserved
+ * Authors: Jesus Tordesillas, et al.
+ * See LICENSE file for the license information
+ * -------------------------------------------------------------------------- */
+
+#ifndef BYTE_BUFFER_HPP
+#define BYTE_BUFFER_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+// Helpers to write and read the binary buffers of compact_traj.hpp and traj_batch.hpp (byte order of the machine)
+
+namespace mt
+{
+// Appends value to the end of the buffer
+template <typename T>
+void writeBytes(std::vector<uint8_t>& buffer, T value)
+{
+  size_t size = buffer.size();
+  buffer.resize(size + sizeof(T));
+  std::memcpy(&buffer[size], &value, sizeof(T));
+}
+
+// Reads from the buffer, checking that it does not go beyond its end
+class byteReader
+{
+public:
+  byteReader(const uint8_t* data, size_t size) : data_(data), size_(size)
+  {
+  }
+
+  template <typename T>
+  bool read(T& value)
+  {
+    return readArray(&value, 1);
+  }
+
+  // Reads num consecutive values
+  template <typename T>
+  bool readArray(T* values, size_t num)
+  {
+    if (num * sizeof(T) > size_ - pos_)
+    {
+      return false;
+    }
+    std::memcpy(values, data_ + pos_, num * sizeof(T));
+    pos_ += num * sizeof(T);
+    return true;
+  }
+
+private:
+  const uint8_t* data_;
+  size_t size_;
+  size_t pos_ = 0;
+};
+}  // namespace mt
+
+#endif
@@ -0,0 +1,63 @@
+/* ----------------------------------------------------------------------------
+ * Copyright 2021, Jesus Tordesillas Torres, Aerospace Controls Laboratory
+ * Massachusetts Institute of Technology
+ * All Rights Reserved
+ * Authors: Jesus Tordesillas, et al.
+ * See LICENSE file for the license information
+ * -------------------------------------------------------------------------- */
+
+#ifndef CASADI_OP_HPP
+#define CASADI_OP_HPP
+
+#include <casadi/casadi.hpp>
+
+#include <map>
+#include <memory>
+#include <string>
+
+class DeadlineCallback;
+
+// Optimization problem generated by main.m ("op" or "op_fixed_pos").
+// main.m saves it in two ways:
+//  - <name>_pre.casadi, <name>_nlp.casadi and <name>_post.casadi: the inputs of the solver, the NLP and the outputs.
+//    IPOPT is created here (with the options given to load()), with an iteration callback that stops it when the
+//    deadline of the current solve is reached (return status "User_Requested_Stop")
+//  - <name>.casadi: everything in one function, with IPOPT inside (and its options baked in). It's only used if the
+//    files above don't exist (generated with an older main.m). In that case IPOPT can only be stopped by its
+//    max_cpu_time, and its stats are obtained through the instruction that calls IPOPT (see
+//    getIndexInstructionSolver())
+class CasadiOp
+{
+public:
+  CasadiOp();
+  ~CasadiOp();
+
+  // Returns false if none of the two forms can be loaded
+  bool load(const std::string& folder, const std::string& name, const casadi::Dict& opts_solver);
+
+  // IPOPT is stopped if it's still running after ms_budget milliseconds (only if hasDeadline()==true)
+  std::map<std::string, casadi::DM> solve(const std::map<std::string, casadi::DM>& arguments, double ms_budget);
+
+  // These ones refer to the last call to solve()
+  void getStatusAndIterCount(std::string& status, int& iter_count);
+  double getInfPrLastIterate();  // infinity if it's not available
+
+  bool hasDeadline() const;
+  const std::string& getName() const;
+
+private:
+  casadi::Dict getStats();
+
+  std::string name_;
+  bool has_deadline_ = false;
+
+  casadi::Function pre_;
+  casadi::Function solver_;
+  casadi::Function post_;
+  std::unique_ptr<DeadlineCallback> deadline_callback_;  // Must live as long as solver_
+
+  casadi::Function cf_;  // Only used if has_deadline_==false
+  int index_instruction_ = 0;
+};
+
+#endif
@@ -0,0 +1,85 @@
+/* ----------------------------------------------------------------------------
+ * Copyright 2021, Jesus Tordesillas Torres, Aerospace Controls Laboratory
+ * Massachusetts Institute of Technology
+ * All Rights Reserved
+ * Authors: Jesus Tordesillas, et al.
+ * See LICENSE file for the license information
+ * -------------------------------------------------------------------------- */
+
+#ifndef COMPACT_TRAJ_HPP
+#define COMPACT_TRAJ_HPP
+
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+
+#include <Eigen/Dense>
+
+#include "panther_types.hpp"
+
+// Compact binary encoding of the trajectories that the agents broadcast (see PantherRos::publishOwnTraj), used
+// instead of panther_msgs::DynTraj when use_compact_traj_broadcast==true. Compared to DynTraj:
+//  - The coefficients are floats, and all the intervals have degree 3 (padded with zeros if needed)
+//  - The times are floats relative to the first time of the trajectory (which is a double)
+//  - The variance is omitted when it is zero
+//  - The intervals that were already in the previous broadcast are not sent again (they are referenced instead). A
+//    full trajectory (keyframe) is sent every keyframe_period broadcasts, so that a receiver that has lost a message
+//    (or that started later) can recover
+// The buffer uses the byte order of the machine (all the agents are assumed to use the same one)
+
+namespace mt
+{
+struct compactTrajInfo
+{
+  int id;
+  bool is_agent;
+  Eigen::Vector3d bbox;
+  Eigen::Vector3d pos;  // current position of the agent
+};
+}  // namespace mt
+
+class CompactTrajEncoder
+{
+public:
+  CompactTrajEncoder(int keyframe_period);
+
+  // Returns false (and buffer is not valid) if the trajectory cannot be encoded (degree>3 or too many intervals)
+  bool encode(const mt::PieceWisePol& pwp_mean, const mt::PieceWisePol& pwp_var, const mt::compactTrajInfo& info,
+              std::vector<uint8_t>& buffer);
+  bool encode(const mt::PieceWisePolDeque& pwp_mean, const mt::PieceWisePol& pwp_var,
+              const mt::compactTrajInfo& info, std::vector<uint8_t>& buffer);
+
+private:
+  bool encodeFixed(const mt::PieceWisePol& pwp_var, const mt::compactTrajInfo& info, std::vector<uint8_t>& buffer);
+
+  int keyframe_period_;
+  uint32_t seq_ = 0;
+  int num_since_keyframe_ = 0;
+  mt::PieceWisePolFixed<3> last_mean_;  // mean of the last broadcast (in double, as it was before encoding it)
+  mt::PieceWisePolFixed<3> mean_;       // mean being encoded (swapped with last_mean_ after each broadcast)
+  mt::PieceWisePolFixed<3> var_;
+};
+
+class CompactTrajDecoder
+{
+public:
+  // Decodes only the fixed-size part of the buffer (id, position,...). Returns false if the buffer is not valid
+  static bool decodeInfo(const uint8_t* data, size_t size, mt::compactTrajInfo& info);
+
+  // Decodes the buffer directly into traj (no intermediate panther_msgs/mt::dynTraj are created). Returns false if
+  // the buffer is not valid, or if it's a delta with respect to a broadcast that this decoder hasn't received (in
+  // that case the next keyframe will be needed). Every buffer received from a sender should be passed to this
+  // function (even if the trajectory is not going to be used), so that the deltas can be applied
+  bool decode(const uint8_t* data, size_t size, mt::dynTrajCompiled& traj);
+
+private:
+  struct lastDecoded
+  {
+    uint32_t seq;
+    mt::PieceWisePolFixed<3> mean;
+  };
+
+  std::unordered_map<int, lastDecoded> last_decoded_;  // keyed by the id of the sender
+};
+
+#endif
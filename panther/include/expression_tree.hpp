@@ -0,0 +1,109 @@
+/* ----------------------------------------------------------------------------
+ * Copyright 2021, Jesus Tordesillas Torres, Aerospace Controls Laboratory
+ * Massachusetts Institute of Technology
+ * All Rights Reserved
+ * Authors: Jesus Tordesillas, et al.
+ * See LICENSE file for the license information
+ * -------------------------------------------------------------------------- */
+
+#ifndef EXPRESSION_TREE_HPP
+#define EXPRESSION_TREE_HPP
+
+#include <math.h>
+#include <memory>
+#include <string>
+#include <vector>
+
+// Tree of the expressions (functions of t) used in the trajectories of the dynamic obstacles (see dynamic_corridor.py
+// and pieceWisePol2String()). Only the subset of the exprtk syntax used there is supported: numbers, t, pi, + - * / ^,
+// comparisons, and, or, and the functions sin, cos, tan, exp, log, sqrt, abs, min, max
+
+namespace mt
+{
+struct exprNode;
+typedef std::shared_ptr<const exprNode> exprNodePtr;
+
+struct exprNode
+{
+  enum Type
+  {
+    CONSTANT,
+    VARIABLE,  // t
+    ADD,
+    SUB,
+    MUL,
+    DIV,
+    POW,
+    NEG,
+    FUNCTION,  // name is the function
+    COMPARISON,  // name is the operator. Its value is 1.0 (true) or 0.0 (false)
+    AND,
+    OR
+  };
+
+  Type type;
+  double value = 0.0;
+  std::string name;
+  std::vector<exprNodePtr> children;
+};
+
+// Native representation of an expression of the form
+//   poly(t-t_shift) + sum_k amplitude[k]*sin(frequency[k]*(t-t_shift)+phase[k])
+// that can be evaluated without exprtk (see lowerExpression()). t_shift avoids evaluating polynomials in the absolute
+// time (which is ~1e9 seconds)
+struct nativeExpression
+{
+  double t_shift = 0.0;
+  std::vector<double> poly;  // coefficients, highest power first
+  std::vector<double> amplitude;
+  std::vector<double> frequency;
+  std::vector<double> phase;
+
+  double eval(double t) const
+  {
+    double s = t - t_shift;
+    double result = 0.0;
+    for (double c : poly)
+    {
+      result = result * s + c;
+    }
+    for (int k = 0; k < amplitude.size(); k++)
+    {
+      result += amplitude[k] * sin(frequency[k] * s + phase[k]);
+    }
+    return result;
+  }
+
+  double evalDerivative(double t) const
+  {
+    double s = t - t_shift;
+    double result = 0.0;
+    int deg = (int)poly.size() - 1;
+    for (int i = 0; i < deg; i++)
+    {
+      result = result * s + (deg - i) * poly[i];
+    }
+    for (int k = 0; k < amplitude.size(); k++)
+    {
+      result += amplitude[k] * frequency[k] * cos(frequency[k] * s + phase[k]);
+    }
+    return result;
+  }
+};
+}  // namespace mt
+
+// Returns false if s uses syntax not supported (root is then nullptr)
+bool parseExpression(const std::string& s, mt::exprNodePtr& root);
+
+// Returns d(node)/dt, or nullptr if it cannot be obtained. Comparisons are treated as piecewise constant (i.e., their
+// derivative is 0)
+mt::exprNodePtr differentiateExpression(const mt::exprNodePtr& node);
+
+// Returns a string that exprtk can compile
+std::string expressionToString(const mt::exprNodePtr& node);
+
+// Converts node into a mt::nativeExpression (using t_shift, which should be close to the times where it will be
+// evaluated). Returns false if node does not have that form (e.g., it has products of sines, abs(t),...)
+bool lowerExpression(const mt::exprNodePtr& node, double t_shift, mt::nativeExpression& native);
+
+#endif
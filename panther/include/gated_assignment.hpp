@@ -0,0 +1,44 @@
+/* ----------------------------------------------------------------------------
+ * Copyright 2021, Jesus Tordesillas Torres, Aerospace Controls Laboratory
+ * Massachusetts Institute of Technology
+ * All Rights Reserved
+ * Authors: Jesus Tordesillas, et al.
+ * See LICENSE file for the license information
+ * -------------------------------------------------------------------------- */
+
+#ifndef GATED_ASSIGNMENT_HPP
+#define GATED_ASSIGNMENT_HPP
+
+#include <vector>
+
+namespace tp  // Tracker and predictor
+{
+struct assignmentEdge
+{
+  int row;
+  int col;
+  double cost;
+};
+
+// Rectangular assignment problem in which only some (row, col) pairs are allowed (the ones that passed the gating).
+// Rows and columns are split into the connected components of the bipartite graph formed by the allowed pairs, and
+// each component is solved independently with shortest augmenting paths (Jonker-Volgenant style, with potentials) that
+// only explore the allowed pairs. Within each component, the number of assigned rows is maximized first, and then the
+// total cost of the assignment is minimized (as HungarianAlgorithm does with the dense matrix).
+class GatedAssignment
+{
+public:
+  // assignment[row] is the column assigned to that row, or -1 if it hasn't been assigned
+  void solve(int num_rows, int num_cols, const std::vector<tp::assignmentEdge>& edges, std::vector<int>& assignment);
+
+private:
+  void solveComponent(const std::vector<int>& rows, const std::vector<int>& cols, std::vector<int>& assignment);
+
+  // Edges of each row, with the columns as local indexes of the component (see solve())
+  std::vector<std::vector<std::pair<int, double>>> edges_of_row_;
+  std::vector<int> local_col_;  // index of each column within its component
+  double cost_unassigned_;
+};
+}  // namespace tp
+
+#endif
@@ -0,0 +1,69 @@
+/* ----------------------------------------------------------------------------
+ * Copyright 2021, Jesus Tordesillas Torres, Aerospace Controls Laboratory
+ * Massachusetts Institute of Technology
+ * All Rights Reserved
+ * Authors: Jesus Tordesillas, et al.
+ * See LICENSE file for the license information
+ * -------------------------------------------------------------------------- */
+
+#ifndef GRID_CLUSTERING_HPP
+#define GRID_CLUSTERING_HPP
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include <Eigen/Dense>
+
+#include <pcl/point_cloud.h>
+#include <pcl/point_types.h>
+
+namespace tp  // Tracker and predictor
+{
+struct clusterStats
+{
+  Eigen::Vector3d centroid;
+  Eigen::Vector3d min;
+  Eigen::Vector3d max;
+  int num_points;
+};
+
+// Euclidean clustering with the same semantics as pcl::EuclideanClusterExtraction (two points are in the same cluster
+// if they are connected by a chain of points with distance <= tolerance between consecutive ones, and only the clusters
+// with min_size <= size <= max_size are returned, sorted by decreasing size). Instead of a KdTree, it uses a spatial
+// hash with cells of side tolerance (so that only the 27 neighboring cells need to be checked), and a lock-free
+// union-find whose unions are computed in parallel. The centroid and bounds of each cluster are computed in the same
+// pass that labels the points
+class GridClustering
+{
+public:
+  GridClustering(int num_threads);
+
+  void cluster(const pcl::PointCloud<pcl::PointXYZ>& cloud, double tolerance, int min_size, int max_size,
+               std::vector<tp::clusterStats>& clusters);
+
+private:
+  int find(int i);
+  void unite(int a, int b);
+  int findCell(uint64_t key) const;
+  void uniteCells(const pcl::PointCloud<pcl::PointXYZ>& cloud, int first_cell, int last_cell, float tolerance);
+
+  int num_threads_;
+
+  // Hash table (open addressing) voxel key --> index of the cell. Kept between calls (only the used slots are cleared)
+  std::vector<uint64_t> table_keys_;
+  std::vector<int> table_values_;
+  int log2_table_size_ = 0;
+
+  std::vector<uint64_t> cell_keys_;  // key of each cell
+  std::vector<int> cell_start_;      // the points of cell i are cell_points_[cell_start_[i]...cell_start_[i+1]-1]
+  std::vector<int> cell_points_;     // indexes of the points, grouped by cell
+  std::vector<int> cell_of_point_;   // cell of each point
+
+  std::unique_ptr<std::atomic<int>[]> parent_;  // union-find
+  size_t parent_capacity_ = 0;
+};
+}  // namespace tp
+
+#endif
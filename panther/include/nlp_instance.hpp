@@ -0,0 +1,55 @@
+/* ----------------------------------------------------------------------------
+ * Copyright 2021, Jesus Tordesillas Torres, Aerospace Controls Laboratory
+ * Massachusetts Institute of Technology
+ * All Rights Reserved
+ * Authors: Jesus Tordesillas, et al.
+ * See LICENSE file for the license information
+ * -------------------------------------------------------------------------- */
+
+#ifndef NLP_INSTANCE_HPP
+#define NLP_INSTANCE_HPP
+
+#include <casadi/casadi.hpp>
+#include <iostream>
+#include <map>
+#include <string>
+
+namespace mt
+{
+// Everything needed to solve again (offline) one of the NLPs solved by SolverIpopt
+struct nlpInstance
+{
+  std::string function_name;  // "op" or "op_fixed_pos"
+  std::string status;         // return_status of IPOPT
+  int iter_count = -1;        // number of iterations of IPOPT (-1 if not available)
+  double ms_opt = 0.0;        // time needed to solve it
+  double ms_budget_opt = 0.0;
+
+  std::map<std::string, casadi::DM> arguments;  // parameters and initial guesses
+  std::map<std::string, casadi::DM> result;
+
+  void print() const
+  {
+    std::cout << function_name << ": " << status << ", " << iter_count << " iterations, " << ms_opt << " ms (budget "
+              << ms_budget_opt << " ms)" << std::endl;
+  }
+};
+}  // namespace mt
+
+// Binary format (little endian, as written by the machine):
+// "PNLP", uint32 version, function_name, status, int32 iter_count, double ms_opt, double ms_budget_opt,
+// and then the maps arguments and result. Each map is uint32 num_of_entries followed by, for each entry,
+// name, uint32 rows, uint32 cols and rows*cols doubles (column-major). Strings are uint32 length + chars.
+bool saveNlpInstance(const std::string& file, const mt::nlpInstance& instance);
+bool loadNlpInstance(const std::string& file, mt::nlpInstance& instance);
+
+// Returns the status and iterations of the last call to the IPOPT solver inside cf
+// index_instruction is the one returned by getIndexInstructionSolver()
+void getStatusAndIterCount(casadi::Function& cf, int index_instruction, std::string& status, int& iter_count);
+
+// Index of the instruction of cf (generated by main.m as function_name, "op" or "op_fixed_pos") that calls IPOPT. It's
+// read from the file saved by get_stats() in main.m (index_instruction.txt for op, index_instruction_fixed_pos.txt for
+// op_fixed_pos), and searched in cf if that file doesn't exist. Returns -1 if it's not found
+int getIndexInstructionSolver(casadi::Function& cf, const std::string& folder, const std::string& function_name);
+
+#endif
@@ -216,10 +216,10 @@ private:
   double z_min_ = -std::numeric_limits<double>::max();
   double z_max_ = std::numeric_limits<double>::max();
 
-  // transformation between the B-spline control points and other basis (MINVO or Bezier)
-  std::vector<Eigen::Matrix<double, 4, 4>> M_pos_bs2basis_;
-  std::vector<Eigen::Matrix<double, 3, 3>> M_vel_bs2basis_;
-  std::vector<Eigen::Matrix<double, 4, 4>> M_pos_bs2basis_inverse_;  // Mbs2basis_
+  // transformation between the B-spline control points and other basis (MINVO or Bezier). Shared, see
+  // mt::basisTables::get()
+  const mt::basisTables* pos_basis_tables_;
+  const mt::basisTables* vel_basis_tables_;
 
   int num_seg_;
 
@@ -14,6 +14,9 @@
 #include "cgal_utils.hpp"
 
 #include <mutex>
+#include <future>
+#include <atomic>
+#include <unordered_map>
 
 #include "panther_types.hpp"
 // #include "solver_nlopt.hpp"
@@ -29,7 +32,11 @@ class Panther
 public:
   Panther(mt::parameters par);
   bool replan(mt::Edges& edges_obstacles_out, std::vector<mt::state>& X_safe_out, std::vector<Hyperplane3D>& planes,
-              int& num_of_LPs_run, int& num_of_QCQPs_run, mt::PieceWisePol& pwp_out, mt::log& log);
+              int& num_of_LPs_run, int& num_of_QCQPs_run, mt::log& log);
+
+  // What has been committed from now on. It's updated in place by replan() (not copied), and it's empty if replan()
+  // hasn't succeeded yet
+  const mt::PieceWisePolDeque& getCommittedPwp() const;
   void updateState(mt::state data);
 
   bool getNextGoal(mt::state& next_goal);
@@ -40,6 +47,7 @@ public:
 
   bool IsTranslating();
   void updateTrajObstacles(mt::dynTraj traj);
+  void updateTrajObstacles(mt::dynTrajCompiled traj_compiled);  // For trajectories that are already compiled
 
 private:
   mt::state M_;
@@ -47,17 +55,22 @@ private:
 
   Eigen::Vector3d evalMeanDynTrajCompiled(const mt::dynTrajCompiled& traj, double t);
   Eigen::Vector3d evalVarDynTrajCompiled(const mt::dynTrajCompiled& traj, double t);
+  void evalDynTrajCompiled(const mt::dynTrajCompiled& traj, const std::vector<double>& times,
+                           mt::dynTrajSamples& samples, bool compute_dmean = false);
 
   bool isReplanningNeeded();
 
   void logAndTimeReplan(const std::string& info, const bool& success, mt::log& log);
 
   void dynTraj2dynTrajCompiled(const mt::dynTraj& traj, mt::dynTrajCompiled& traj_compiled);
+  void addTrajObstacle(mt::dynTrajCompiled& traj_compiled);
 
   bool initializedStateAndTermGoal();
 
   bool safetyCheckAfterOpt(mt::PieceWisePol pwp_optimized);
 
+  void solveAndSpliceYaw(SolverIpopt::yawJob job, int id_solution, long int abs_index_start);
+
   bool trajsAndPwpAreInCollision(mt::dynTrajCompiled traj, mt::PieceWisePol pwp_optimized, double t_start,
                                  double t_end);
 
@@ -76,6 +89,8 @@ private:
   void updateInitialCond(int i);
 
   void changeDroneStatus(int new_status);
+  bool changeDroneStatusIf(int expected_status, int new_status);
+  void printDroneStatusChange(int old_status, int new_status);
 
   bool appendToPlan(int k_end_whole, const std::vector<mt::state>& whole, int k_safe,
                     const std::vector<mt::state>& safe);
@@ -96,6 +111,24 @@ private:
 
   double t_;  // variable where the expressions of the trajs of the dyn obs are evaluated
 
+  // Cache of the compiled expressions of the trajs of the dyn obs, keyed on the expression. Note that copies of an
+  // exprtk::expression share the compiled program (through a reference count that is not atomic). Hence, this cache
+  // and the copies of the trajs in trajs_ are only created/destroyed with mtx_t_ and mtx_trajs_ locked
+  struct cachedExpression
+  {
+    exprtk::expression<double> expression;
+    bool derivative_computed = false;
+    exprtk::expression<double> derivative;  // d(expression)/dt. Only valid if has_derivative==true
+    bool has_derivative = false;
+    mt::nativeExpression native;  // Only valid if has_native==true
+    bool has_native = false;
+  };
+  std::unordered_map<std::string, cachedExpression> expression_cache_;
+  long int num_expression_cache_hits_ = 0;
+  long int num_expression_cache_misses_ = 0;
+
+  cachedExpression& getCachedExpression(const std::string& s, bool need_derivative);
+
   std::mutex mtx_trajs_;
   std::vector<mt::dynTrajCompiled> trajs_;
 
@@ -106,7 +139,8 @@ private:
 
   bool terminal_goal_initialized_ = false;
 
-  int drone_status_ = DroneStatus::TRAVELING;  // status_ can be TRAVELING, GOAL_SEEN, GOAL_REACHED
+  // status_ can be TRAVELING, GOAL_SEEN, GOAL_REACHED. Atomic because getNextGoal() changes it without locking
+  std::atomic<int> drone_status_{ DroneStatus::TRAVELING };
   int planner_status_ = PlannerStatus::FIRST_PLAN;
 
   std::mutex mtx_goals;
@@ -132,7 +166,7 @@ private:
   int solutions_found_ = 0;
   int total_replannings_ = 0;
 
-  mt::PieceWisePol pwp_prev_;
+  mt::PieceWisePolDeque pwp_prev_;  // what has been committed from now on
 
   bool exists_previous_pwp_ = false;
 
@@ -148,14 +182,7 @@ private:
   // SolverGurobi* solver_;  // pointer to the optimization solver
   SolverIpopt* solver_;  // pointer to the optimization solver
 
-  Eigen::Matrix<double, 2, 2> A_basis_deg1_rest_;
-  Eigen::Matrix<double, 2, 2> A_basis_deg1_rest_inverse_;
-
-  Eigen::Matrix<double, 3, 3> A_basis_deg2_rest_;
-  Eigen::Matrix<double, 3, 3> A_basis_deg2_rest_inverse_;
-
-  Eigen::Matrix<double, 4, 4> A_basis_deg3_rest_;
-  Eigen::Matrix<double, 4, 4> A_basis_deg3_rest_inverse_;
+  const mt::basisTables* basis_tables_;  // basis used for collision (shared, see mt::basisTables::get())
 
   separator::Separator* separator_solver_;
 
@@ -164,6 +191,10 @@ private:
   mt::state last_state_tracked_;
 
   bool need_to_do_stuff_term_goal_ = false;
+
+  // Used to splice the yaw solved in another thread (pipelined_py) in the right place of plan_
+  int id_last_solution_committed_ = 0;  // incremented each time plan_ changes its tail (protected by mtx_plan_)
+  std::future<void> yaw_future_;        // declared last, so that it's destroyed (i.e. waited for) first
 };
 
 #endif
\ No newline at end of file
@@ -21,10 +21,14 @@
 
 #include <panther_msgs/WhoPlans.h>
 #include <panther_msgs/DynTraj.h>
+#include <std_msgs/Float32MultiArray.h>
+#include <std_msgs/UInt8MultiArray.h>
 
 #include "utils.hpp"
 #include "panther.hpp"
 #include "panther_types.hpp"
+#include "compact_traj.hpp"
+#include "traj_batch.hpp"
 
 #include "timer.hpp"
 
@@ -44,7 +48,7 @@ private:
 
   //
 
-  void publishOwnTraj(const mt::PieceWisePol& pwp);
+  void publishOwnTraj(const mt::PieceWisePolDeque& pwp);
   void publishPlanes(std::vector<Hyperplane3D>& planes);
 
   // class methods
@@ -56,6 +60,9 @@ private:
   void pubCB(const ros::TimerEvent& e);
   void replanCB(const ros::TimerEvent& e);
   void trajCB(const panther_msgs::DynTraj& msg);
+  void trajCompactCB(const std_msgs::UInt8MultiArray& msg);
+  void trajBatchCB(const std_msgs::UInt8MultiArray& msg);
+  bool isInFOV(const Eigen::Vector3d& w_pos);
 
   // void clearMarkerSetOfArrows();
   void clearMarkerActualTraj();
@@ -105,17 +112,21 @@ private:
 
   ros::Publisher pub_text_;
   ros::Publisher pub_traj_;
+  ros::Publisher pub_traj_compact_;
 
   ros::Publisher poly_safe_pub_;
 
   ros::Publisher pub_fov_;
   ros::Publisher pub_obstacles_;
   ros::Publisher pub_log_;
+  ros::Publisher pub_opt_budget_;
 
   ros::Subscriber sub_term_goal_;
   ros::Subscriber sub_whoplans_;
   ros::Subscriber sub_state_;
   ros::Subscriber sub_traj_;
+  ros::Subscriber sub_traj_compact_;
+  ros::Subscriber sub_traj_batch_;
 
   ros::Timer pubCBTimer_;
   ros::Timer replanCBTimer_;
@@ -139,7 +150,13 @@ private:
 
   Eigen::Affine3d w_T_b_;
 
-  mt::PieceWisePol pwp_last_;
+  mt::PieceWisePolDeque pwp_initial_;                   // static, at the initial position
+  const mt::PieceWisePolDeque* pwp_last_ = &pwp_initial_;  // pwp_initial_ or Panther::getCommittedPwp()
+  mt::PieceWisePol pwp_zero_var_;                       // variance of the own trajectory
+
+  std::unique_ptr<CompactTrajEncoder> compact_traj_encoder_;
+  CompactTrajDecoder compact_traj_decoder_;
+  std::vector<uint8_t> compact_traj_buffer_;
 
   PANTHER_timers::Timer timer_stop_;
 
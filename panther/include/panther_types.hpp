@@ -11,10 +11,14 @@
 #include <iostream>
 #include <iomanip>  // std::setprecision
 #include <deque>
+#include <algorithm>
+#include <atomic>
+#include <array>
 #include "exprtk.hpp"
 #include "termcolor.hpp"
 #include <Eigen/Dense>
 #include "timer.hpp"
+#include "expression_tree.hpp"
 
 typedef Eigen::Matrix<double, 3, Eigen::Dynamic> Polyhedron_Std;
 typedef std::vector<Polyhedron_Std> ConvexHullsOfCurve_Std;
@@ -58,6 +62,13 @@ struct log
   double final_pos_cost = 0.0;
   double final_yaw_cost = 0.0;
 
+  double ms_budget_opt = 0.0;              // time budget left for IPOPT when the solve starts
+  bool opt_truncated_by_deadline = false;  // IPOPT stopped because of ms_budget_opt (or max_cpu_time)
+  bool opt_exceeded_budget = false;        // IPOPT took longer than ms_budget_opt
+
+  long int num_expression_cache_hits = 0;    // expressions of the trajs of the dyn obs that did not need to be parsed
+  long int num_expression_cache_misses = 0;  // expressions of the trajs of the dyn obs that needed to be parsed
+
   Eigen::Vector3d tracking_now_pos;
   Eigen::Vector3d tracking_now_vel;
 
@@ -569,12 +580,338 @@ struct basisConverter
   }
 };
 
+// Conversion matrices of one basis, shared by Panther, SolverIpopt and OctopusSearch (use basisTables::get()). Only the
+// distinct matrices are stored (the ones of the first/last segments of the clamped B-Spline, and the one of the rest),
+// and the inverses are precomputed. They are computed only once (the first time they are requested), and they are
+// never modified afterwards
+class basisTables
+{
+public:
+  // basis can be "MINVO", "BEZIER" or "B_SPLINE". Returns nullptr if the basis is not implemented
+  static const basisTables* get(const std::string& basis)
+  {
+    // Note that the initialization of these static variables is thread-safe
+    static const basisTables minvo("MINVO");
+    static const basisTables bezier("BEZIER");
+    static const basisTables bspline("B_SPLINE");
+
+    if (basis == "MINVO")
+    {
+      return &minvo;
+    }
+    if (basis == "BEZIER")
+    {
+      return &bezier;
+    }
+    if (basis == "B_SPLINE")
+    {
+      return &bspline;
+    }
+    return nullptr;
+  }
+
+  // Position (deg 3): matrix that converts the B-Spline control points of the interval to this basis (and its inverse)
+  const Eigen::Matrix<double, 4, 4>& getMPosBs2Basis(int interval, int num_seg) const
+  {
+    return M_pos_bs2basis_[indexDeg3(interval, num_seg)];
+  }
+
+  const Eigen::Matrix<double, 4, 4>& getMPosBs2BasisInverse(int interval, int num_seg) const
+  {
+    return M_pos_bs2basis_inverse_[indexDeg3(interval, num_seg)];
+  }
+
+  // Velocity (deg 2): matrix that converts the B-Spline control points of the interval to this basis
+  const Eigen::Matrix<double, 3, 3>& getMVelBs2Basis(int interval, int num_seg) const
+  {
+    return M_vel_bs2basis_[indexDeg2(interval, num_seg)];
+  }
+
+  // Matrix A of the position B-Spline in the interval (the same for all the bases)
+  const Eigen::Matrix<double, 4, 4>& getAPosBSpline(int interval, int num_seg) const
+  {
+    return A_pos_bs_[indexDeg3(interval, num_seg)];
+  }
+
+  // Matrices A of this basis (the same for all the intervals), and their inverses
+  Eigen::Matrix<double, 2, 2> A_rest_deg1, A_rest_deg1_inverse;
+  Eigen::Matrix<double, 3, 3> A_rest_deg2, A_rest_deg2_inverse;
+  Eigen::Matrix<double, 4, 4> A_rest_deg3, A_rest_deg3_inverse;
+
+private:
+  basisTables(const std::string& basis)
+  {
+    basisConverter c;
+
+    // Obtained with 5 segments (i.e., with one "rest" segment, see indexDeg3() and indexDeg2())
+    std::vector<Eigen::Matrix<double, 4, 4>> M_pos;
+    std::vector<Eigen::Matrix<double, 3, 3>> M_vel;
+    if (basis == "MINVO")
+    {
+      M_pos = c.getMinvoDeg3Converters(5);
+      M_vel = c.getMinvoDeg2Converters(5);
+      A_rest_deg1 = c.getArestMinvoDeg1();
+      A_rest_deg2 = c.getArestMinvoDeg2();
+      A_rest_deg3 = c.getArestMinvoDeg3();
+    }
+    else if (basis == "BEZIER")
+    {
+      M_pos = c.getBezierDeg3Converters(5);
+      M_vel = c.getBezierDeg2Converters(5);
+      A_rest_deg1 = c.getArestBezierDeg1();
+      A_rest_deg2 = c.getArestBezierDeg2();
+      A_rest_deg3 = c.getArestBezierDeg3();
+    }
+    else
+    {
+      M_pos = c.getBSplineDeg3Converters(5);
+      M_vel = c.getBSplineDeg2Converters(5);
+      A_rest_deg1 = c.getArestBSplineDeg1();
+      A_rest_deg2 = c.getArestBSplineDeg2();
+      A_rest_deg3 = c.getArestBSplineDeg3();
+    }
+    std::vector<Eigen::Matrix<double, 4, 4>> A_pos_bs = c.getABSplineDeg3(5);
+
+    for (int i = 0; i < 5; i++)
+    {
+      M_pos_bs2basis_[i] = M_pos[i];
+      M_pos_bs2basis_inverse_[i] = M_pos[i].inverse();
+      A_pos_bs_[i] = A_pos_bs[i];
+    }
+    M_vel_bs2basis_[0] = M_vel[0];
+    M_vel_bs2basis_[1] = M_vel[1];
+    M_vel_bs2basis_[2] = M_vel.back();
+
+    A_rest_deg1_inverse = A_rest_deg1.inverse();
+    A_rest_deg2_inverse = A_rest_deg2.inverse();
+    A_rest_deg3_inverse = A_rest_deg3.inverse();
+  }
+
+  // Same element as the one in the vector returned by basisConverter::get*Deg3*(num_seg), which is
+  // [seg0, seg1, rest, ..., rest, seg_last2, seg_last]
+  static int indexDeg3(int interval, int num_seg)
+  {
+    int num_rest = std::max(num_seg - 4, 0);
+    if (interval < 2)
+    {
+      return interval;
+    }
+    if (interval < 2 + num_rest)
+    {
+      return 2;
+    }
+    return 3 + (interval - 2 - num_rest);
+  }
+
+  // Same element as the one in the vector returned by basisConverter::get*Deg2Converters(num_seg), which is
+  // [seg0, rest, ..., rest, seg_last]
+  static int indexDeg2(int interval, int num_seg)
+  {
+    int num_rest = std::max(num_seg - 3, 0);
+    if (interval < 1)
+    {
+      return 0;
+    }
+    if (interval < 1 + num_rest)
+    {
+      return 1;
+    }
+    return 2;
+  }
+
+  std::array<Eigen::Matrix<double, 4, 4>, 5> M_pos_bs2basis_;
+  std::array<Eigen::Matrix<double, 4, 4>, 5> M_pos_bs2basis_inverse_;
+  std::array<Eigen::Matrix<double, 4, 4>, 5> A_pos_bs_;
+  std::array<Eigen::Matrix<double, 3, 3>, 3> M_vel_bs2basis_;  // seg0, rest, seg_last
+};
+
 struct polytope
 {
   Eigen::MatrixXd A;
   Eigen::MatrixXd b;
 };
 
+// Used to store the samples of several times in SoA form: row 0 has the x of all the samples, row 1 the y,...
+typedef Eigen::Matrix<double, 3, Eigen::Dynamic, Eigen::RowMajor> Matrix3XRowMajor;
+
+// Returns the interval j such that times[j] <= t < times[j+1] (saturated to [0, num_intervals-1]).
+// hint is the interval found in the previous call (-1 if none): consecutive evaluations usually fall in the same
+// interval or in the next one, so these two are checked before doing the binary search. The hint is owned by the caller
+// (and not by the polynomial) so that the same polynomial can be evaluated from several threads
+inline int findInterval(const std::vector<double>& times, double t, int& hint)
+{
+  int num_intervals = times.size() - 1;
+  if (t >= times[num_intervals])
+  {
+    hint = num_intervals - 1;
+    return hint;
+  }
+  if (t < times[0])
+  {
+    hint = 0;
+    return hint;
+  }
+  if (hint >= 0 && hint < num_intervals && times[hint] <= t)
+  {
+    if (t < times[hint + 1])
+    {
+      return hint;
+    }
+    if ((hint + 2) <= num_intervals && t < times[hint + 2])
+    {
+      hint = hint + 1;
+      return hint;
+    }
+  }
+  hint = std::upper_bound(times.begin(), times.end(), t) - times.begin() - 1;
+  return hint;
+}
+
+inline int findInterval(const std::vector<double>& times, double t)
+{
+  int hint = -1;
+  return findInterval(times, t, hint);
+}
+
+// Piecewise polynomial of degree <= Deg, with the coefficients of all the intervals stored contiguously and
+// interleaved in x,y,z:
+//    interval j --> [a_x a_y a_z b_x b_y b_z ... ] (Deg+1 triplets), with pol(t)=a*u^Deg + b*u^(Deg-1) + ...
+// with u=(t-t_min_that_interval)/(t_max_that_interval- t_min_that_interval)
+// Use it (see PieceWisePol::toFixed()) when the same polynomial is evaluated many times
+template <int Deg>
+struct PieceWisePolFixed
+{
+  typedef Eigen::Matrix<double, 3, Deg + 1> CoeffMatrix;
+
+  std::vector<double> times;  // [t0,t1,t2,...,tn+1]
+  std::vector<double> coeff;  // 3*(Deg+1) elements per interval
+
+  void clear()
+  {
+    times.clear();
+    coeff.clear();
+  }
+
+  int getNumOfIntervals() const
+  {
+    return (times.size() - 1);
+  }
+
+  void addInterval(const Eigen::Ref<const CoeffMatrix>& coeff_interval, double t_end)
+  {
+    coeff.insert(coeff.end(), coeff_interval.data(), coeff_interval.data() + 3 * (Deg + 1));
+    times.push_back(t_end);
+  }
+
+  Eigen::Map<const CoeffMatrix> getCoeffInterval(int j) const
+  {
+    return Eigen::Map<const CoeffMatrix>(&coeff[3 * (Deg + 1) * j]);
+  }
+
+  // hint: see findInterval(). When evaluating at increasing times, pass the same hint to all the calls
+  Eigen::Vector3d eval(double t, int& hint) const
+  {
+    double tt = std::min(std::max(t, times.front()), times.back());
+
+    int j = findInterval(times, tt, hint);
+    double u = (tt - times[j]) / (times[j + 1] - times[j]);
+    u = std::min(std::max(u, 0.0), 1.0);
+
+    Eigen::Map<const CoeffMatrix> C = getCoeffInterval(j);
+
+    // Horner
+    Eigen::Vector3d result = C.col(0);
+    for (int k = 1; k <= Deg; k++)
+    {
+      result = result * u + C.col(k);
+    }
+    return result;
+  }
+
+  Eigen::Vector3d eval(double t) const
+  {
+    int hint = -1;
+    return eval(t, hint);
+  }
+
+  // Evaluates the polynomial at all the times (faster if they are sorted). Column i of result is the value at times[i]
+  void evalBatch(const std::vector<double>& times_eval, mt::Matrix3XRowMajor& result) const
+  {
+    int num_samples = times_eval.size();
+    result.resize(3, num_samples);
+
+    // Interval and u of each sample
+    std::vector<int> all_j(num_samples);
+    Eigen::Array<double, 1, Eigen::Dynamic> all_u(num_samples);
+    int hint = -1;
+    for (int i = 0; i < num_samples; i++)
+    {
+      double tt = std::min(std::max(times_eval[i], times.front()), times.back());
+      int j = findInterval(times, tt, hint);
+      double u = (tt - times[j]) / (times[j + 1] - times[j]);
+      all_j[i] = j;
+      all_u(i) = std::min(std::max(u, 0.0), 1.0);
+    }
+
+    // Horner on each run of consecutive samples that fall in the same interval
+    int start = 0;
+    while (start < num_samples)
+    {
+      int end = start + 1;
+      while (end < num_samples && all_j[end] == all_j[start])
+      {
+        end++;
+      }
+      int n = end - start;
+
+      Eigen::Map<const CoeffMatrix> C = getCoeffInterval(all_j[start]);
+      auto U = all_u.segment(start, n);
+      for (int d = 0; d < 3; d++)
+      {
+        auto r = result.row(d).segment(start, n).array();
+        r.setConstant(C(d, 0));
+        for (int k = 1; k <= Deg; k++)
+        {
+          r = r * U + C(d, k);
+        }
+      }
+      start = end;
+    }
+  }
+
+  // Same as evalBatch, but for the derivative wrt t (which is zero outside [times.front(), times.back()])
+  void evalDerivativeBatch(const std::vector<double>& times_eval, mt::Matrix3XRowMajor& result) const
+  {
+    int num_samples = times_eval.size();
+    result.resize(3, num_samples);
+
+    int hint = -1;
+    for (int i = 0; i < num_samples; i++)
+    {
+      double t = times_eval[i];
+      if (Deg == 0 || t < times.front() || t > times.back())
+      {
+        result.col(i).setZero();
+        continue;
+      }
+
+      int j = findInterval(times, t, hint);
+      double delta = times[j + 1] - times[j];
+      double u = std::min(std::max((t - times[j]) / delta, 0.0), 1.0);
+
+      Eigen::Map<const CoeffMatrix> C = getCoeffInterval(j);
+
+      // Horner on the derivative of the polynomial in u, and then chain rule (du/dt=1/delta)
+      Eigen::Vector3d tmp = Deg * C.col(0);
+      for (int k = 1; k < Deg; k++)
+      {
+        tmp = tmp * u + (Deg - k) * C.col(k);
+      }
+      result.col(i) = tmp / delta;
+    }
+  }
+};
+
 struct PieceWisePol
 {
   // Interval 0: t\in[t0, t1)
@@ -628,24 +965,7 @@ struct PieceWisePol
 
   int getInterval(double t) const
   {
-    if (t >= times[times.size() - 1])
-    {
-      return (getNumOfIntervals() - 1);
-    }
-    if (t < times[0])
-    {
-      return 0;
-    }
-    for (int i = 0; i < (times.size() - 1); i++)
-    {
-      if (times[i] <= t && t < times[i + 1])
-      {
-        return i;
-      }
-    }
-    std::cout << "[getInterval] THIS SHOULD NEVER HAPPEN" << std::endl;
-    abort();
-    return 0;
+    return findInterval(times, t);
   }
 
   void saturateMinMax(double& var, const double min, const double max) const
@@ -682,6 +1002,13 @@ struct PieceWisePol
   }
 
   Eigen::Vector3d eval(double t) const
+  {
+    int hint = -1;
+    return eval(t, hint);
+  }
+
+  // hint: see findInterval(). When evaluating at increasing times, pass the same hint to all the calls
+  Eigen::Vector3d eval(double t, int& hint) const
   {
     Eigen::Vector3d result;
 
@@ -689,21 +1016,87 @@ struct PieceWisePol
     // Saturate
     saturateMinMax(tt, times[0], times[times.size() - 1]);
 
-    double u = t2u(tt);
-    int j = getInterval(tt);  // TODO [Improve efficiency]: note that t2u is already calling getInterval()
+    int j = findInterval(times, tt, hint);
+    double u = (tt - times[j]) / (times[j + 1] - times[j]);
+    saturateMinMax(u, 0.0, 1.0);
 
     // std::cout << "tt= " << tt << std::endl;
     // std::cout << "u= " << u << std::endl;
     // std::cout << "j= " << j << std::endl;
 
-    Eigen::VectorXd tmp = getU(u);
+    const Eigen::VectorXd& cx = all_coeff_x[j];
+    const Eigen::VectorXd& cy = all_coeff_y[j];
+    const Eigen::VectorXd& cz = all_coeff_z[j];
 
-    result.x() = all_coeff_x[j].transpose() * tmp;
-    result.y() = all_coeff_y[j].transpose() * tmp;
-    result.z() = all_coeff_z[j].transpose() * tmp;
+    // Horner
+    result << cx(0), cy(0), cz(0);
+    for (int k = 1; k < cx.size(); k++)
+    {
+      result.x() = result.x() * u + cx(k);
+      result.y() = result.y() * u + cy(k);
+      result.z() = result.z() * u + cz(k);
+    }
     return result;
   }
 
+  // Derivative wrt t (zero outside [times.front(), times.back()], where eval() is saturated)
+  Eigen::Vector3d evalDerivative(double t) const
+  {
+    int hint = -1;
+    return evalDerivative(t, hint);
+  }
+
+  Eigen::Vector3d evalDerivative(double t, int& hint) const
+  {
+    Eigen::Vector3d result = Eigen::Vector3d::Zero();
+    if (t < times[0] || t > times[times.size() - 1])
+    {
+      return result;
+    }
+
+    int j = findInterval(times, t, hint);
+    double delta = times[j + 1] - times[j];
+    double u = (t - times[j]) / delta;
+    saturateMinMax(u, 0.0, 1.0);
+
+    const Eigen::VectorXd& cx = all_coeff_x[j];
+    const Eigen::VectorXd& cy = all_coeff_y[j];
+    const Eigen::VectorXd& cz = all_coeff_z[j];
+    int deg = cx.size() - 1;
+
+    for (int k = 0; k < deg; k++)
+    {
+      result.x() = result.x() * u + (deg - k) * cx(k);
+      result.y() = result.y() * u + (deg - k) * cy(k);
+      result.z() = result.z() * u + (deg - k) * cz(k);
+    }
+    return result / delta;
+  }
+
+  // Returns false (and leaves pwp_fixed empty) if the degree of this polynomial is > Deg. Lower degrees are padded
+  // with zeros
+  template <int Deg>
+  bool toFixed(PieceWisePolFixed<Deg>& pwp_fixed) const
+  {
+    pwp_fixed.clear();
+    if (getDeg() > Deg || times.size() < 2)
+    {
+      return false;
+    }
+
+    pwp_fixed.times.push_back(times[0]);
+    for (int j = 0; j < getNumOfIntervals(); j++)
+    {
+      typename PieceWisePolFixed<Deg>::CoeffMatrix C = PieceWisePolFixed<Deg>::CoeffMatrix::Zero();
+      int deg_j = all_coeff_x[j].size() - 1;
+      C.row(0).tail(deg_j + 1) = all_coeff_x[j].transpose();
+      C.row(1).tail(deg_j + 1) = all_coeff_y[j].transpose();
+      C.row(2).tail(deg_j + 1) = all_coeff_z[j].transpose();
+      pwp_fixed.addInterval(C, times[j + 1]);
+    }
+    return true;
+  }
+
   void print() const
   {
     std::cout << "all_coeff_x.size()= " << all_coeff_x.size() << std::endl;
@@ -719,6 +1112,104 @@ struct PieceWisePol
   }
 };
 
+// Piecewise polynomial stored as a deque of intervals, so that intervals can be removed from the front and
+// removed/appended at the back in O(number of intervals changed). See composePieceWisePol() in utils.hpp
+struct PieceWisePolDeque
+{
+  struct interval
+  {
+    double t_end;
+    Eigen::VectorXd coeff_x;  // same convention as in PieceWisePol (u \in [0,1] in the interval)
+    Eigen::VectorXd coeff_y;
+    Eigen::VectorXd coeff_z;
+  };
+
+  double t_start = 0.0;
+  std::deque<interval> intervals;
+
+  bool empty() const
+  {
+    return intervals.empty();
+  }
+
+  void clear()
+  {
+    intervals.clear();
+  }
+
+  double timeEnd() const
+  {
+    return intervals.back().t_end;
+  }
+
+  // start time of the interval i
+  double timeStart(int i) const
+  {
+    return (i == 0) ? t_start : intervals[i - 1].t_end;
+  }
+
+  void fromPieceWisePol(const mt::PieceWisePol& pwp)
+  {
+    intervals.clear();
+    t_start = pwp.times.front();
+    appendPieceWisePol(pwp);
+  }
+
+  void appendPieceWisePol(const mt::PieceWisePol& pwp)
+  {
+    for (int i = 0; i < pwp.getNumOfIntervals(); i++)
+    {
+      intervals.push_back({ pwp.times[i + 1], pwp.all_coeff_x[i], pwp.all_coeff_y[i], pwp.all_coeff_z[i] });
+    }
+  }
+
+  mt::PieceWisePol toPieceWisePol() const
+  {
+    mt::PieceWisePol pwp;
+    pwp.times.push_back(t_start);
+    for (auto& interval_i : intervals)
+    {
+      pwp.times.push_back(interval_i.t_end);
+      pwp.all_coeff_x.push_back(interval_i.coeff_x);
+      pwp.all_coeff_y.push_back(interval_i.coeff_y);
+      pwp.all_coeff_z.push_back(interval_i.coeff_z);
+    }
+    return pwp;
+  }
+
+  // Same as PieceWisePol::toFixed(), without creating the intermediate PieceWisePol
+  template <int Deg>
+  bool toFixed(PieceWisePolFixed<Deg>& pwp_fixed) const
+  {
+    pwp_fixed.clear();
+    if (intervals.empty())
+    {
+      return false;
+    }
+    for (auto& interval_i : intervals)
+    {
+      if (interval_i.coeff_x.size() > Deg + 1 || interval_i.coeff_y.size() > Deg + 1 ||
+          interval_i.coeff_z.size() > Deg + 1)
+      {
+        return false;
+      }
+    }
+
+    pwp_fixed.times.reserve(intervals.size() + 1);
+    pwp_fixed.coeff.reserve(3 * (Deg + 1) * intervals.size());
+    pwp_fixed.times.push_back(t_start);
+    for (auto& interval_i : intervals)
+    {
+      typename PieceWisePolFixed<Deg>::CoeffMatrix C = PieceWisePolFixed<Deg>::CoeffMatrix::Zero();
+      C.row(0).tail(interval_i.coeff_x.size()) = interval_i.coeff_x.transpose();
+      C.row(1).tail(interval_i.coeff_y.size()) = interval_i.coeff_y.transpose();
+      C.row(2).tail(interval_i.coeff_z.size()) = interval_i.coeff_z.transpose();
+      pwp_fixed.addInterval(C, interval_i.t_end);
+    }
+    return true;
+  }
+};
+
 struct dynTraj
 {
   bool use_pwp_field;  // If true, pwp is used. If false, the string is used
@@ -741,9 +1232,21 @@ struct dynTrajCompiled
 
   std::vector<exprtk::expression<double>> s_mean;
   std::vector<exprtk::expression<double>> s_var;
+  std::vector<exprtk::expression<double>> s_dmean;  // derivative of s_mean. Empty if it could not be obtained
+
+  // Native versions of s_mean and s_var, used instead of them (only if use_pwp_field==false and all of them could be
+  // obtained, see lowerExpression())
+  bool use_native = false;
+  std::vector<mt::nativeExpression> native_mean;
+  std::vector<mt::nativeExpression> native_var;
   mt::PieceWisePol pwp_mean;
   mt::PieceWisePol pwp_var;
 
+  // Copies of pwp_mean and pwp_var used for the evaluations (only if use_pwp_field==true and degree<=3)
+  bool use_pwp_fixed = false;
+  mt::PieceWisePolFixed<3> pwp_mean_fixed;
+  mt::PieceWisePolFixed<3> pwp_var_fixed;
+
   Eigen::Vector3d bbox;
   int id;
   double time_received;  // time at which this trajectory was received from an agent
@@ -751,6 +1254,15 @@ struct dynTrajCompiled
   bool is_static;
 };
 
+// Samples of a dynTrajCompiled at several times (see Panther::evalDynTrajCompiled). Column i corresponds to times[i]
+struct dynTrajSamples
+{
+  std::vector<double> times;
+  mt::Matrix3XRowMajor mean;
+  mt::Matrix3XRowMajor var;
+  mt::Matrix3XRowMajor dmean;  // derivative of the mean wrt t. Only filled if requested
+};
+
 // struct mt::PieceWisePolWithInfo
 // {
 //   mt::PieceWisePol pwp;
@@ -777,6 +1289,8 @@ struct parameters
   double Ra;
 
   bool impose_FOV_in_trajCB = false;
+  bool use_compact_traj_broadcast = false;  // broadcast the own trajectory encoded as in compact_traj.hpp
+  int compact_traj_keyframe_period = 10;    // every how many broadcasts a full (i.e., non-delta) one is sent
 
   double ydot_max;
 
@@ -815,6 +1329,14 @@ struct parameters
   double lower_bound_runtime_snlopt;
   double kappa;
   double mu;
+  double max_cpu_time_ipopt;        // hard ceiling for each IPOPT solve (see main.m)
+  std::string linear_solver_ipopt;  // linear solver of IPOPT (see main.m)
+  int print_level_ipopt;
+  double max_inf_pr_truncated_opt;  // a solve stopped by the deadline is accepted if inf_pr is below this
+
+  bool record_nlp_instances = false;  // save each NLP solved in folder_nlp_instances (see replay_nlp_instances)
+  std::string folder_nlp_instances;
+  bool pipelined_py = false;  // "py" mode: commit the position first and solve for yaw in another thread
 
   double max_seconds_keeping_traj = 1e6;
 
@@ -844,6 +1366,8 @@ struct parameters
   double c_smooth_yaw_search = 0.0;
   double c_visibility_yaw_search = 1.0;
   int num_of_yaw_per_layer = 10;
+  bool use_boost_yaw_search = false;  // true --> Boost A* (validation), false --> dynamic programming over the layers
+  bool use_casadi_visibility = false;  // true --> visibility.casadi (validation), false --> native implementation
 
   // weights
   double c_pos_smooth = 1.0;
@@ -861,75 +1385,159 @@ struct parameters
   Eigen::Affine3d c_T_b;
 };
 
+// Plan committed by the planner, and consumed (one state every dc) by the publisher of the goals.
+// It's a fixed-capacity ring buffer indexed with absolute indexes (they never wrap around): the states not consumed
+// yet are [headIndex(), tailIndex()).
+// - Only one thread consumes it (popFront), and it never takes a lock: it only reads head_ and tail_
+// - The writers (push_back, splice, clear) must be serialized by the user (Panther uses mtx_plan_). A writer only
+//   writes the states at indexes >= tail_ after having checked that the consumer cannot be reading them, and then
+//   publishes them by moving tail_ (see splice)
+// The states are never modified in place, so any state in [headIndex(), tailIndex()) can be read by the writers
 struct committedTrajectory
 {
-  std::deque<mt::state> content;
+  committedTrajectory(int capacity = (1 << 14))
+  {
+    int capacity_pow2 = 1;
+    while (capacity_pow2 < capacity)
+    {
+      capacity_pow2 = capacity_pow2 << 1;
+    }
+    content.resize(capacity_pow2);
+    mask_ = capacity_pow2 - 1;
+  }
 
   void print()
   {
-    for (auto state_i : content)
+    for (long int i = headIndex(); i < tailIndex(); i++)
     {
+      mt::state state_i = getAbs(i);
       state_i.printHorizontal();
     }
   }
 
-  // now define the functions operating on the member of this struct directly
-  int size()
+  int capacity() const
   {
     return content.size();
   }
 
-  void clear()
+  int size() const
   {
-    content.clear();
+    return std::max(tail_.load() - head_.load(), 0L);
   }
 
-  void push_back(mt::state tmp)
+  long int headIndex() const
   {
-    content.push_back(tmp);
+    return head_.load();
   }
 
-  void erase(std::deque<mt::state>::iterator a, std::deque<mt::state>::iterator b)
+  long int tailIndex() const
   {
-    content.erase(a, b);
+    return tail_.load();
   }
 
-  mt::state front()
+  const mt::state& getAbs(long int i) const
   {
-    return content.front();
+    return content[i & mask_];
   }
 
-  mt::state back()
+  // i is relative to the head (which may be moved by the consumer at any moment)
+  const mt::state& get(int i) const
   {
-    return content.back();
+    return getAbs(headIndex() + i);
   }
 
-  void pop_front()
+  const mt::state& front() const
   {
-    content.pop_front();
+    return getAbs(headIndex());
   }
 
-  std::deque<mt::state>::iterator end()
+  const mt::state& back() const
   {
-    return content.end();
+    return getAbs(tailIndex() - 1);
   }
 
-  std::deque<mt::state>::iterator begin()
+  ////////////////////////// WRITERS
+
+  // Must not be called while the consumer is running
+  void clear()
   {
-    return content.begin();
+    tail_.store(head_.load());
   }
 
-  mt::state get(int i)
+  bool push_back(const mt::state& tmp)
   {
-    return content[i];
+    return splice(tailIndex(), std::vector<mt::state>(1, tmp));
   }
 
-  std::vector<mt::state> toStdVector()
+  // Replaces the states [from, tailIndex()) with states. Returns false (and leaves the plan unchanged) if the state
+  // "from" may have already been consumed, or if there is no space
+  bool splice(long int from, const std::vector<mt::state>& states)
+  {
+    long int old_tail = tail_.load();
+    if (from > old_tail)
+    {
+      return false;
+    }
+
+    // After this, the consumer cannot read beyond from-1 (unless it read the old tail before, see below)
+    tail_.store(from);
+
+    // The consumer may still be reading the state head (and it reads the state head only if head<tail, so a
+    // consumer that read the old tail can only read states < from if head<from now)
+    long int head = head_.load();
+    bool from_can_be_written = (head < from) || (head == from && from == old_tail);
+    if (!from_can_be_written || (from + (long int)states.size() - head) > capacity())
+    {
+      tail_.store(old_tail);
+      return false;
+    }
+
+    for (int i = 0; i < states.size(); i++)
+    {
+      content[(from + i) & mask_] = states[i];
+    }
+
+    tail_.store(from + states.size());  // publish them
+    return true;
+  }
+
+  ////////////////////////// CONSUMER
+
+  // Returns in next the first state not consumed yet, and consumes it if it's not the last one (i.e., the last state
+  // is returned until more states are added). Returns false if the plan is empty
+  bool popFront(mt::state& next)
+  {
+    long int head = head_.load();
+    long int tail = tail_.load();
+    if (head >= tail)
+    {
+      return false;
+    }
+    next = content[head & mask_];
+    if ((tail - head) > 1)
+    {
+      head_.store(head + 1);
+    }
+    return true;
+  }
+
+  std::vector<mt::state> toStdVector() const
   {
     std::vector<mt::state> my_vector;
-    std::copy(content.begin(), content.end(), std::back_inserter(my_vector));
+    long int tail = tailIndex();
+    for (long int i = headIndex(); i < tail; i++)
+    {
+      my_vector.push_back(getAbs(i));
+    }
     return my_vector;
   }
+
+private:
+  std::vector<mt::state> content;
+  long int mask_;
+
+  std::atomic<long int> head_{ 0 };  // only written by the consumer
+  std::atomic<long int> tail_{ 0 };  // only written by the writers
 };
 
 typedef std::vector<mt::state> trajectory;
@@ -21,6 +21,8 @@
 #include "timer.hpp"
 #include "separator.hpp"
 #include "octopus_search.hpp"
+#include "nlp_instance.hpp"
+#include "casadi_op.hpp"
 
 // For the yaw search:
 #include <boost/graph/astar_search.hpp>
@@ -52,6 +54,17 @@ public:
   }
   mt::trajectory traj_solution_;
 
+  // Yaw problem left to be solved after the position one (only in "py" mode with par_.pipelined_py==true)
+  struct yawJob
+  {
+    std::map<std::string, casadi::DM> arguments;  // pCPs is the position solution
+    std::vector<Eigen::Vector3d> qp;
+    Eigen::RowVectorXd knots;
+  };
+  bool getPendingYawJob(yawJob &job);
+  // It only uses op_fixed_pos_, so it can be called from another thread while optimize() is running
+  bool solveYawJob(const yawJob &job, mt::trajectory &traj_yaw);
+
   // getters
   void getPlanes(std::vector<Hyperplane3D> &planes);
   int getNumOfLPsRun();
@@ -116,6 +129,15 @@ private:
 
   casadi::DM generateYawGuess(casadi::DM matrix_qp_guess, casadi::DM all_w_fe, double y0, double ydot0, double ydotf,
                               double t0, double tf);
+  void computeVisibilityMatrix(const casadi::DM &matrix_qp_guess, const casadi::DM &all_w_fe, double total_time);
+  void computeVisibilityMatrixCasadi(const casadi::DM &matrix_qp_guess, const casadi::DM &all_w_fe, double total_time);
+  bool searchYawDP(double y0, double deltaT, std::vector<double> &yaw_path);
+  bool searchYawBoostAStar(double y0, double deltaT, std::vector<double> &yaw_path);
+  void createBoostYawGraph();
+
+  std::map<std::string, casadi::DM> callOptimizer(CasadiOp &op, std::map<std::string, casadi::DM> &arguments,
+                                                  double ms_budget);
+  bool isSolutionUsable(CasadiOp &op, std::string &status, bool &truncated);
 
   std::vector<Eigen::Vector3d> n_;  // Each n_[i] has 3 elements (nx,ny,nz)
   std::vector<double> d_;           // d_[i] has 1 element
@@ -130,8 +152,6 @@ private:
 
   int Ny_;
 
-  double index_instruction_;  // hack
-
   int num_of_normals_;
 
   int num_of_obst_;
@@ -151,7 +171,7 @@ private:
 
   ConvexHullsOfCurves_Std hulls_;
 
-  MyTimer opt_timer_;
+  MyTimer opt_timer_;  // measures the whole optimize() call (guesses + IPOPT)
 
   double max_runtime_ = 2;  //[seconds]
 
@@ -165,20 +185,23 @@ private:
   double mu_ = 0.5;     // mu_*max_runtime_ is spent on the optimization
 
   int num_of_QCQPs_run_ = 0;
+  int num_of_nlp_instances_recorded_ = 0;
+  std::string prefix_nlp_instances_;  // folder_nlp_instances + "nlp_instance_<date>_<time>_<pid>_"
+
+  yawJob yaw_job_;
+  bool yaw_job_pending_ = false;
 
-  // transformation between the B-spline control points and other basis
-  std::vector<Eigen::Matrix<double, 4, 4>> M_pos_bs2basis_;
-  std::vector<Eigen::Matrix<double, 3, 3>> M_vel_bs2basis_;
-  std::vector<Eigen::Matrix<double, 4, 4>> A_pos_bs_;
+  // transformation between the B-spline control points and other basis (shared, see mt::basisTables::get())
+  const mt::basisTables* basis_tables_;
 
   // double a_star_bias_ = 1.0;
 
   std::unique_ptr<separator::Separator> separator_solver_ptr_;
   std::unique_ptr<OctopusSearch> octopusSolver_ptr_;
 
-  casadi::Function cf_op_;
+  CasadiOp op_;
   // casadi::Function cf_op_force_final_pos_;
-  casadi::Function cf_fixed_pos_op_;
+  CasadiOp op_fixed_pos_;
   casadi::Function cf_fit_yaw_;
   casadi::Function cf_visibility_;
 
@@ -225,6 +248,17 @@ private:
   std::vector<std::vector<vd>> all_vertexes_;
   casadi::DM vector_yaw_samples_;
 
+  // For the dynamic-programming yaw search. All of them are row-major, with one row per layer
+  std::vector<double> vis_matrix_;        // (num_of_layers_)x(num_of_yaw_per_layer_), values in [0,1]
+  std::vector<double> dist_yaw_samples_;  // (num_of_yaw_per_layer_)x(num_of_yaw_per_layer_), |yaw_j-yaw_k| wrapped
+  std::vector<double> yaw_samples_;       // Same as vector_yaw_samples_
+  std::vector<double> cos_yaw_samples_;
+  std::vector<double> sin_yaw_samples_;
+  double gamma_visibility_ = 5.0;  // Steepness of the sigmoid used for the visibility. Must be the gamma of main.m
+  std::vector<double> dp_transition_;     // (num_of_yaw_per_layer_)x(num_of_yaw_per_layer_), smoothness+ydot_max costs
+  std::vector<double> dp_cost_;           // 2x(num_of_yaw_per_layer_), cost-to-come of the previous/current layer
+  std::vector<int> dp_predecessor_;       // (num_of_layers_)x(num_of_yaw_per_layer_)
+
   std::shared_ptr<mt::log> log_ptr_;
 
   casadi::DM eigen2casadi(const Eigen::Vector3d &a);
@@ -25,8 +25,19 @@
 #include <pcl/kdtree/kdtree.h>
 #include <pcl/segmentation/extract_clusters.h>
 #include <pcl/common/centroid.h>
+#include <atomic>
+#include <cstdio>
+#include <memory>
+#include <mutex>
 #include <string>  // std::string, std::stoi
+#include <thread>
+#include <panther_msgs/DynTraj.h>
 #include <panther_msgs/Logtp.h>
+#include "async_logger.hpp"
+#include "bounded_queue.hpp"
+#include "gated_assignment.hpp"
+#include "grid_clustering.hpp"
+#include "traj_batch.hpp"
 
 #ifndef TRACKER_PREDICTOR_HPP
 #define TRACKER_PREDICTOR_HPP
@@ -37,12 +48,9 @@ namespace tp  // Tracker and predictor
 {
 struct logtp
 {
-  PANTHER_timers::Timer tim_total_tp;        //
-  PANTHER_timers::Timer tim_conversion_pcl;  //
+  PANTHER_timers::Timer tim_total_tp;        // from the reception of the point cloud to the end of its publishing stage
   PANTHER_timers::Timer tim_tf_transform;    //
-  PANTHER_timers::Timer tim_remove_nans;     //
-  PANTHER_timers::Timer tim_passthrough;     //
-  PANTHER_timers::Timer tim_voxel_grid;      //
+  PANTHER_timers::Timer tim_preprocessing;   // conversion+transform+remove NaNs+box filter+voxel grid (single pass)
   PANTHER_timers::Timer tim_pub_filtered;    //
   PANTHER_timers::Timer tim_tree;            //
   PANTHER_timers::Timer tim_clustering;      //
@@ -50,6 +58,21 @@ struct logtp
   PANTHER_timers::Timer tim_hungarian;       //
   PANTHER_timers::Timer tim_fitting;         //
   PANTHER_timers::Timer tim_pub;             //
+
+  // Whole stages of the pipeline (see TrackerPredictor)
+  PANTHER_timers::Timer tim_stage_preprocessing;  // tf + preprocessing + publishing the filtered point cloud
+  PANTHER_timers::Timer tim_stage_clustering;     //
+  PANTHER_timers::Timer tim_stage_association;    // association + fitting
+  PANTHER_timers::Timer tim_stage_publishing;     //
+};
+
+struct voxelSum  // Accumulated points of one voxel (see TrackerPredictor::preprocessCloud())
+{
+  float sum_x;
+  float sum_y;
+  float sum_z;
+  int num_points;
+  size_t slot;  // position of this voxel in the hash table
 };
 
 struct cluster  // one observation
@@ -67,28 +90,88 @@ struct cluster  // one observation
   }
 };
 
+// Constant-acceleration Kalman filter of the centroid of a track. All the axes have the same dynamics and noises, so
+// they share the covariance of the state. Each observation is incorporated in O(1), independently of the size of the
+// sliding window
+struct trackFilter
+{
+  Eigen::Matrix3d x;  // column i is the state [position velocity acceleration] of axis i
+  Eigen::Matrix3d P;  // covariance of the state of each axis
+  double time;        // time of the last observation
+
+  void init(const tp::cluster& c, double measurement_noise)
+  {
+    x = Eigen::Matrix3d::Zero();
+    x.row(0) = c.centroid.transpose();
+    P = Eigen::Vector3d(measurement_noise, 100.0, 100.0).asDiagonal();  // velocity and acceleration are unknown
+    time = c.time;
+  }
+
+  // process_noise is the spectral density of the (white) jerk, and measurement_noise the variance of the centroid
+  void update(const tp::cluster& c, double process_noise, double measurement_noise)
+  {
+    double dt = c.time - time;
+    if (dt > 0.0)
+    {
+      Eigen::Matrix3d F;
+      F << 1.0, dt, dt * dt / 2.0,  //////
+          0.0, 1.0, dt,             //////
+          0.0, 0.0, 1.0;
+
+      double dt2 = dt * dt;
+      double dt3 = dt2 * dt;
+      Eigen::Matrix3d Q;
+      Q << dt3 * dt2 / 20.0, dt2 * dt2 / 8.0, dt3 / 6.0,  //////
+          dt2 * dt2 / 8.0, dt3 / 3.0, dt2 / 2.0,          //////
+          dt3 / 6.0, dt2 / 2.0, dt;
+
+      x = F * x;
+      P = F * P * F.transpose() + process_noise * Q;
+      time = c.time;
+    }
+
+    // Measurement: position
+    Eigen::Vector3d K = P.col(0) / (P(0, 0) + measurement_noise);
+    x = x + K * (c.centroid.transpose() - x.row(0));
+    P = P - K * P.row(0);
+  }
+};
+
+// The history of the track (sliding window) is a ring buffer with capacity max_ssw, allocated only once. The tracks
+// removed by TrackerPredictor are kept and reused with reset(), so that in steady state no memory is allocated
 class track
 {
 public:
   bool is_new = true;
-  track(const tp::cluster& c, const int& min_ssw_tmp, const int& max_ssw_tmp)
+  track(const tp::cluster& c, const int& min_ssw_tmp, const int& max_ssw_tmp, int id)
   {
     max_ssw = max_ssw_tmp;
     min_ssw = min_ssw_tmp;
 
-    is_new = true;
+    history = std::vector<tp::cluster>(max_ssw);
 
-    history = std::deque<tp::cluster>(min_ssw, c);  // Constant initialization
+    reset(c, id);
+  }
+
+  // Leaves the track as if it had just been created with the observation c
+  void reset(const tp::cluster& c, int id)
+  {
+    is_new = true;
+    num_frames_skipped = 0;
 
     // We have only one observation --> we assume the obstacle has always been there
     // std::cout << termcolor::magenta << "c.time= " << c.time << termcolor::reset << std::endl;
+    history_first = 0;
+    history_size = min_ssw;
     for (int i = 0; i < min_ssw; i++)
     {
+      history[i] = c;  // Constant initialization
       history[i].time = c.time - (min_ssw - i - 1);
       //   c.time - (size - i - 1) * c.time / size;  // I need to have different times, if not A will become singular
       // std::cout << termcolor::magenta << "i= " << i << "history[i].time= " << history[i].time << termcolor::reset
       //           << std::endl;
     }
+    max_bbox = c.bbox;
 
     num_diff_samples = 1;
 
@@ -96,46 +179,62 @@ public:
                             ((double)rand() / (RAND_MAX)),   ////// g
                             ((double)rand() / (RAND_MAX)));  ////// b
 
-    // use its hex value as the id
+    // use its hex value as the id_string
     // https://www.codespeedy.com/convert-rgb-to-hex-color-code-in-cpp/
     int r = color.x() * 255;
     int g = color.y() * 255;
     int b = color.z() * 255;
 
-    std::stringstream ss;
-    ss << "#";
-    ss << std::hex << (r << 16 | g << 8 | b);
-    id_string = ss.str();
-
-    id_int = stoi(std::to_string(r) + std::to_string(g) + std::to_string(b));  // concatenate r, g, b
+    char hex[16];
+    snprintf(hex, sizeof(hex), "#%x", (r << 16 | g << 8 | b));
+    id_string = hex;  // Short enough to not allocate memory
 
-    // TODO: The previous approach will **almost** always generate different ids, but not always
+    // Unique and stable during the whole life of the track (the ones obtained from the color could be repeated)
+    id_int = id;
   }
 
   void addToHistory(const tp::cluster& c)
   {
-    history.push_back(c);
-
-    if (num_diff_samples < min_ssw)
+    // Same as pushing c to the back of the window and then removing the oldest element if the window hasn't been
+    // filled with different samples yet or if it has more than max_ssw elements
+    bool recompute_max_bbox = false;
+    if (num_diff_samples < min_ssw || history_size == max_ssw)
     {
-      history.pop_front();  // Delete the oldest element
+      // The max bbox only needs to be recomputed if the removed element is the one that had it
+      const Eigen::Vector3d& bbox_removed = history[history_first].bbox;
+      recompute_max_bbox = (bbox_removed.array() >= max_bbox.array()).any();
+
+      history_first = (history_first + 1 == max_ssw) ? 0 : (history_first + 1);  // Delete the oldest element
+      history_size--;
     }
 
-    if (history.size() > max_ssw)
+    history[index(history_size)] = c;
+    history_size++;
+
+    if (recompute_max_bbox)
+    {
+      max_bbox = history[history_first].bbox;
+      for (int i = 1; i < history_size; i++)
+      {
+        max_bbox = max_bbox.cwiseMax(history[index(i)].bbox);
+      }
+    }
+    else
     {
-      history.pop_front();  // Delete the oldest element
+      max_bbox = max_bbox.cwiseMax(c.bbox);
     }
+
     num_diff_samples = num_diff_samples + 1;
   }
 
-  unsigned int getSizeSW()
+  unsigned int getSizeSW() const
   {
-    return history.size();
+    return history_size;
   }
 
-  Eigen::Vector3d getCentroidHistory(int i)
+  Eigen::Vector3d getCentroidHistory(int i) const
   {
-    return history[i].centroid;
+    return history[index(i)].centroid;
   }
 
   int getNumDiffSamples() const
@@ -143,70 +242,59 @@ public:
     return num_diff_samples;
   }
 
-  bool shouldPublish()
+  bool shouldPublish() const
   {
     return (num_diff_samples >= min_ssw);
   }
 
-  double getTimeHistory(int i)
+  double getTimeHistory(int i) const
   {
-    return history[i].time;
+    return history[index(i)].time;
   }
 
-  double getTotalTimeSW()  // Total time of the sliding window
+  double getTotalTimeSW() const  // Total time of the sliding window
   {
-    return (history.back().time - history.front().time);
+    return (getLatest().time - getOldest().time);
   }
 
-  double getOldestTimeSW()
+  double getOldestTimeSW() const
   {
-    return (history.front().time);
+    return (getOldest().time);
   }
 
-  double getRelativeTimeHistory(int i)
+  double getRelativeTimeHistory(int i) const
   {
-    return (history[i].time - history.front().time);
+    return (history[index(i)].time - getOldest().time);
   }
 
-  double getLatestTimeSW()
+  double getLatestTimeSW() const
   {
-    return (history.back().time);
+    return (getLatest().time);
   }
 
-  double getRelativeOldestTimeSW()
+  double getRelativeOldestTimeSW() const
   {
     return 0.0;
   }
 
-  double getRelativeLatestTimeSW()
+  double getRelativeLatestTimeSW() const
   {
-    return (history.back().time - history.front().time);
+    return (getLatest().time - getOldest().time);
   }
 
-  Eigen::Vector3d getLatestCentroid()
+  Eigen::Vector3d getLatestCentroid() const
   {
-    return history.back().centroid;
+    return getLatest().centroid;
   }
 
-  Eigen::Vector3d getLatestBbox()
+  Eigen::Vector3d getLatestBbox() const
   {
-    return history.back().bbox;
+    return getLatest().bbox;
   }
 
-  Eigen::Vector3d getMaxBbox()
+  Eigen::Vector3d getMaxBbox() const  // Of the whole sliding window (maintained in addToHistory())
   {
-    double max_x = -std::numeric_limits<double>::max();
-    double max_y = -std::numeric_limits<double>::max();
-    double max_z = -std::numeric_limits<double>::max();
-
-    for (auto& c : history)
-    {
-      max_x = std::max(c.bbox.x(), max_x);
-      max_y = std::max(c.bbox.y(), max_y);
-      max_z = std::max(c.bbox.z(), max_z);
-    }
-
-    return Eigen::Vector3d(max_x, max_y, max_z);
+    return max_bbox;
   }
 
   void printPrediction(double seconds, int samples)
@@ -221,64 +309,202 @@ public:
     }
   }
 
-  void printHistory()
+  void printHistory() const
   {
     std::cout << "Track History= " << std::endl;
 
-    for (auto& c : history)
+    for (int i = 0; i < history_size; i++)
     {
-      c.print();
+      history[index(i)].print();
     }
   }
 
   mt::PieceWisePol pwp_mean;
   mt::PieceWisePol pwp_var;
 
+  tp::trackFilter filter;  // Only used if use_kalman_prediction==true
+
   unsigned int num_frames_skipped = 0;
   Eigen::Vector3d color;
   std::string id_string;
   int id_int;
 
 private:
-  unsigned int max_ssw;  // max size of the sliding window
-  unsigned int min_ssw;  // min size of the sliding window
-  unsigned int id;
+  // Position in history of the i-th element of the sliding window (i=0 is the oldest one)
+  int index(int i) const
+  {
+    int k = history_first + i;
+    return (k >= max_ssw) ? (k - max_ssw) : k;
+  }
+
+  const tp::cluster& getOldest() const
+  {
+    return history[history_first];
+  }
+
+  const tp::cluster& getLatest() const
+  {
+    return history[index(history_size - 1)];
+  }
+
+  int max_ssw;  // max size of the sliding window
+  int min_ssw;  // min size of the sliding window
   int num_diff_samples;
 
-  // This deque will ALWAYS have ssw elements
-  std::deque<tp::cluster> history;  //[t-N], [t-N+1],...,[t] (i.e. index of the oldest element is 0)
-};                                  // namespace tp
+  // Ring buffer with the sliding window: [t-N], [t-N+1],...,[t] are history[index(0)], history[index(1)],...
+  std::vector<tp::cluster> history;
+  int history_first;  // position of the oldest element
+  int history_size;   // between min_ssw and max_ssw
+
+  Eigen::Vector3d max_bbox;  // max of the bboxes of the sliding window (per axis)
+};                           // namespace tp
+
+struct trackSnapshot  // What the publishing stage needs from a track (the tracks are owned by the association stage)
+{
+  // Copies the track into this snapshot. Once the snapshot has been used, the memory of the pwps (and of id_string) is
+  // reused, as the sizes don't change between frames
+  void copyFrom(const tp::track& track)
+  {
+    pwp_mean = track.pwp_mean;
+    pwp_var = track.pwp_var;
+    color = track.color;
+    id_string = track.id_string;
+    id_int = track.id_int;
+    latest_centroid = track.getLatestCentroid();
+    latest_bbox = track.getLatestBbox();
+    max_bbox = track.getMaxBbox();
+  }
+
+  mt::PieceWisePol pwp_mean;
+  mt::PieceWisePol pwp_var;
+  Eigen::Vector3d color;
+  std::string id_string;
+  int id_int;
+  Eigen::Vector3d latest_centroid;
+  Eigen::Vector3d latest_bbox;
+  Eigen::Vector3d max_bbox;
+};
+
+// One point cloud, as it goes through the stages of the pipeline. The frames are reused (see
+// TrackerPredictor::getFreeFrame()), keeping the memory of cloud, clusters and tracks
+struct frame
+{
+  // Leaves the frame as if it had just been created
+  void reset()
+  {
+    msg.reset();
+    valid = true;
+    clusters.clear();
+    num_tracks = 0;
+    log = tp::logtp();
+  }
+
+  sensor_msgs::PointCloud2ConstPtr msg;  // Only until the preprocessing stage
+  std_msgs::Header header;
+
+  // false if there is no transform for this point cloud or if it's empty after the filtering. In that case, only the
+  // bookkeeping of the tracks (frames skipped) is done
+  bool valid = true;
+
+  pcl::PointCloud<pcl::PointXYZ>::Ptr cloud;  // filtered point cloud (in world frame)
+  std::vector<tp::cluster> clusters;
+
+  // Tracks to publish: only the first num_tracks are valid. The rest are kept so that their memory can be reused
+  std::vector<tp::trackSnapshot> tracks;
+  int num_tracks = 0;
+
+  tp::logtp log;
+};
 
 };  // namespace tp
+
+// The point clouds are processed by a pipeline of four stages, each one running on its own thread and connected by
+// bounded queues: preprocessing --> clustering --> association (+fitting) --> publishing. This way, the preprocessing
+// of a point cloud overlaps with the association of the previous one, etc. cloud_cb() only pushes the point cloud into
+// the pipeline (discarding the oldest one if the preprocessing stage is busy)
 class TrackerPredictor
 {
 public:
   TrackerPredictor(ros::NodeHandle nh);
+  ~TrackerPredictor();
 
   void cloud_cb(const sensor_msgs::PointCloud2ConstPtr& input);
   // void cloud_cb(const pcl::PointCloud<pcl::PointXYZ>::ConstPtr& input_cloud1);
 
   void printAllTracks();
 
+  // Uses the Kalman filter of the track if use_kalman_prediction==true. If not, it fits the sliding window: with the
+  // native fit if use_native_prediction==true (validating it against the CasADi one if
+  // validate_native_prediction==true), and with the CasADi function otherwise
   void generatePredictedPwpForTrack(tp::track& track_j);
 
 protected:
 private:
-  double getCostRowColum(tp::cluster& a, tp::track& b, double time);
   void addNewTrack(const tp::cluster& c);
+  void generatePredictedPwpForTrackNative(tp::track& track_j) const;
+  void generatePredictedPwpForTrackCasadi(tp::track& track_j);
+  casadi::Function& getMeanVariancePredFunction(int window_size);
+  void generatePredictedPwpForTrackKalman(tp::track& track_j) const;
   void deleteMarkers();
 
+  // Stages of the pipeline
+  void preprocessingStage();
+  void clusteringStage();
+  void associationStage();
+  void publishingStage();
+
+  // Converts the point cloud to the world frame, removes the NaNs, applies the box filter and the voxel grid filter,
+  // all in a single pass over the buffer of msg (without creating intermediate point clouds). The result is stored in
+  // cloud. Returns false if the point cloud doesn't have float32 x, y and z fields
+  bool preprocessCloud(const sensor_msgs::PointCloud2& msg, const Eigen::Affine3d& w_T_b,
+                       pcl::PointCloud<pcl::PointXYZ>& cloud);
+
   panther_msgs::Logtp logtp2LogtpMsg(tp::logtp log);
 
-  visualization_msgs::MarkerArray getBBoxesAsMarkerArray();
+  panther_msgs::DynTraj getDynTrajMsg(const tp::trackSnapshot& track_j, double t_now);
+
+  visualization_msgs::MarkerArray getBBoxesAsMarkerArray(const tp::frame& frame);
+
+  // Frames that have gone through the pipeline (or that have been discarded), reused by cloud_cb(). This way, no frame
+  // (nor its point cloud, clusters or tracks) is allocated per point cloud once the pipeline is full
+  std::shared_ptr<tp::frame> getFreeFrame();
+  void releaseFrame(std::shared_ptr<tp::frame>& frame);
+  std::vector<std::shared_ptr<tp::frame>> free_frames_;
+  std::mutex mtx_free_frames_;
 
+  // Tracks currently alive (their order is not preserved when one is removed)
   std::vector<tp::track> all_tracks_;
+  std::vector<tp::track> free_tracks_;  // Removed tracks, whose memory is reused by addNewTrack()
+  int next_track_id_;
+
+  // Scratch buffers of the association, kept between frames to avoid allocating them every time
+  std::vector<Eigen::Vector3d> predicted_pos_;
+  std::vector<tp::assignmentEdge> edges_;
+  std::vector<bool> cluster_is_gated_;
+  std::vector<int> track_assigned_to_cluster_;
 
   // casadi::Function cf_get_mean_variance_pred_;
 
+  // get_mean_variance_pred_N for each window size N (only the ones loaded so far), protected by the mutex
   std::map<int, casadi::Function> cf_get_mean_variance_pred_;
+  std::mutex mtx_cf_get_mean_variance_pred_;
+  std::string casadi_folder_;
+  std::vector<int> preload_prediction_functions_;  // window sizes whose function is loaded in the constructor
+  bool load_prediction_functions_in_background_;   // true --> all the functions are loaded by loader_thread_
+  std::thread loader_thread_;
+  std::atomic<bool> stop_loader_thread_{ false };
+
+  PANTHER_timers::Timer timer_startup_;  // Started at the beginning of the constructor
+  bool first_prediction_published_ = false;
 
   int num_seg_prediction_;  // Comes from Matlab
+  int deg_pos_prediction_;  // Comes from Matlab
+  double secs_prediction_;  // Comes from Matlab
+  bool use_native_prediction_;
+  bool validate_native_prediction_;
+  bool use_kalman_prediction_;
+  double kalman_process_noise_;
+  double kalman_measurement_noise_;
 
   double x_min_;
   double x_max_;
@@ -298,6 +524,7 @@ private:
   int max_cluster_size_;
   int min_dim_cluster_size_;
   double leaf_size_filter_;
+  bool use_grid_clustering_;  // true --> tp::GridClustering, false --> pcl::EuclideanClusterExtraction
 
   std::unique_ptr<tf2_ros::TransformListener> tf_listener_ptr_;
   tf2_ros::Buffer tf_buffer_;
@@ -305,28 +532,45 @@ private:
   ros::Publisher pub_marker_predicted_traj_;
   ros::Publisher pub_marker_bbox_obstacles_;
   ros::Publisher pub_traj_;
+  ros::Publisher pub_traj_batch_;
   ros::Publisher pub_pcloud_filtered_;
   ros::Publisher pub_log_;
+  ros::Publisher pub_latency_;
 
   ros::NodeHandle nh_;
 
   pcl::search::KdTree<pcl::PointXYZ>::Ptr tree_;
+  tp::GridClustering grid_clustering_;
+  tp::GatedAssignment gated_assignment_;
+  std::vector<tp::clusterStats> clusters_stats_;
 
   std::string namespace_markers = "predictor";
 
   std::vector<int> ids_markers_published_;
 
-  tp::logtp log_;
-
-  pcl::PointCloud<pcl::PointXYZ>::Ptr input_cloud2_;
-  pcl::PointCloud<pcl::PointXYZ>::Ptr input_cloud3_;
-  pcl::PointCloud<pcl::PointXYZ>::Ptr input_cloud4_;
-  pcl::PointCloud<pcl::PointXYZ>::Ptr input_cloud_;
-  pcl::PointCloud<pcl::PointXYZ>::Ptr input_cloud1;
+  // Hash table (open addressing) used by the voxel grid filter: voxel key --> index in voxels_. It's kept between
+  // calls to preprocessCloud() to avoid allocating it every time (only the used slots are cleared)
+  std::vector<uint64_t> voxel_table_keys_;
+  std::vector<int> voxel_table_values_;
+  std::vector<tp::voxelSum> voxels_;
 
   ros::Subscriber sub_;
   std::string name_file_;
+  bool use_async_logging_;  // true --> the file is written by async_logger_, false --> directly by associationStage()
+  std::unique_ptr<tp::AsyncLogger> async_logger_;
+
+  bool publish_traj_batch_;    // true --> trajs_predicted_batch (one message per frame), false --> DynTraj per track
+  bool publish_traj_strings_;  // fill s_mean of the DynTraj messages
+  double visualization_rate_;  // max rate (Hz) at which the markers are published (<=0 --> never)
+  double last_time_visualization_ = 0.0;
+  TrajBatchEncoder traj_batch_encoder_;
   // double last_time_done_logging_ = -100.0;
+
+  tp::BoundedQueue<std::shared_ptr<tp::frame>> queue_preprocessing_;
+  tp::BoundedQueue<std::shared_ptr<tp::frame>> queue_clustering_;
+  tp::BoundedQueue<std::shared_ptr<tp::frame>> queue_association_;
+  tp::BoundedQueue<std::shared_ptr<tp::frame>> queue_publishing_;
+  std::vector<std::thread> stage_threads_;
 };
 
 #endif
\ No newline at end of file
@@ -0,0 +1,55 @@
+/* ----------------------------------------------------------------------------
+ * Copyright 2021, Jesus Tordesillas Torres, Aerospace Controls Laboratory
+ * Massachusetts Institute of Technology
+ * All Rights Reserved
+ * Authors: Jesus Tordesillas, et al.
+ * See LICENSE file for the license information
+ * -------------------------------------------------------------------------- */
+
+#ifndef TRAJ_BATCH_HPP
+#define TRAJ_BATCH_HPP
+
+#include <cstdint>
+#include <vector>
+
+#include "compact_traj.hpp"
+#include "panther_types.hpp"
+
+// Binary encoding of several trajectories in a single buffer, used by the tracker to publish the predictions of all
+// the tracks of a frame in one message (instead of one panther_msgs::DynTraj per track). Compared to DynTraj:
+//  - The coefficients are floats, and all the intervals of the batch have the same degree (deg_mean for the mean,
+//    deg_var for the variance, padded with zeros if needed)
+//  - The times are floats relative to the first time of each trajectory (which is a double)
+//  - The mean and the variance share the times of the intervals
+//  - There is no string form of the trajectories
+// The buffer uses the byte order of the machine, as in compact_traj.hpp
+
+class TrajBatchEncoder
+{
+public:
+  // Starts a new batch (the buffer of the previous one is reused)
+  void start(int deg_mean, int deg_var);
+
+  // Returns false (and the trajectory is not added) if it cannot be encoded (degree higher than the ones of the batch,
+  // mean and variance with different times or too many intervals)
+  bool add(const mt::PieceWisePol& pwp_mean, const mt::PieceWisePol& pwp_var, const mt::compactTrajInfo& info);
+
+  int getNumTrajs() const;
+  const std::vector<uint8_t>& getBuffer() const;
+
+private:
+  int deg_mean_ = 0;
+  int deg_var_ = 0;
+  uint16_t num_trajs_ = 0;
+  std::vector<uint8_t> buffer_;
+};
+
+class TrajBatchDecoder
+{
+public:
+  // Returns false if the buffer is not valid. infos[i] and trajs[i] are the info and trajectory of the i-th element
+  static bool decode(const uint8_t* data, size_t size, std::vector<mt::compactTrajInfo>& infos,
+                     std::vector<mt::dynTraj>& trajs);
+};
+
+#endif
@@ -84,6 +84,7 @@ mt::PieceWisePol createPwpFromStaticPosition(const mt::state& current_state);
 
 mt::PieceWisePol pwpMsg2Pwp(const panther_msgs::PieceWisePolTraj& pwp_msg);
 panther_msgs::PieceWisePolTraj pwp2PwpMsg(const mt::PieceWisePol& pwp);
+panther_msgs::PieceWisePolTraj pwp2PwpMsg(const mt::PieceWisePolDeque& pwp);
 
 visualization_msgs::Marker edges2Marker(const mt::Edges& edges, std_msgs::ColorRGBA color_marker);
 
@@ -91,6 +92,9 @@ geometry_msgs::Pose identityGeometryMsgsPose();
 
 mt::PieceWisePol composePieceWisePol(const double t, const double dc, mt::PieceWisePol& p1, mt::PieceWisePol& p2);
 
+// Same as above, but modifying p1 in place: it keeps only the part of p1 in [t, p2.times.front()] and appends p2
+void composePieceWisePol(const double t, const double dc, mt::PieceWisePolDeque& p1, mt::PieceWisePol& p2);
+
 bool boxIntersectsSphere(Eigen::Vector3d center, double r, Eigen::Vector3d c1, Eigen::Vector3d c2);
 
 void printStateDeque(std::deque<mt::state>& data);
@@ -44,7 +44,9 @@ num_of_yaw_per_layer=40; %This will be used in the graph yaw search of C++
                          %Note that the initial layer will have only one yaw (which is given) 
 basis="MINVO"; %MINVO OR B_SPLINE or BEZIER. This is the basis used for collision checking (in position, velocity, accel and jerk space), both in Matlab and in C++
 linear_solver_name='ma27'; %mumps [default, comes when installing casadi], ma27, ma57, ma77, ma86, ma97 
+save_copy_for_replay=false; %If true, op_<linear_solver_name>.casadi is also saved (used by replay_nlp_instances in C++)
 print_level=5; %From 0 (no verbose) to 12 (very verbose), default is 5
+max_cpu_time_ipopt=0.35; %[seconds] Hard ceiling for each IPOPT solve (below it, C++ stops each solve at its own deadline, see casadi_op.hpp). Should be upper_bound_runtime_snlopt
 
 t0_n=0.0; 
 tf_n=1.0;
@@ -499,6 +501,7 @@ opts.print_time=true;
 opts.ipopt.print_level=print_level; 
 opts.ipopt.print_frequency_iter=1e10;%1e10 %Big if you don't want to print all the iteratons
 opts.ipopt.linear_solver=linear_solver_name;
+opts.ipopt.max_cpu_time=max_cpu_time_ipopt; %If reached, IPOPT returns Maximum_CpuTime_Exceeded with the last iterate
 opti.solver('ipopt',opts); %{"ipopt.hessian_approximation":"limited-memory"} 
 % if(strcmp(linear_solver_name,'ma57'))
 %    opts.ipopt.ma57_automatic_scaling='no';
@@ -532,6 +535,28 @@ if(pos_is_fixed==true)
 else
     my_function.save('./casadi_generated_files/op.casadi') %Optimization Problam. The file generated is quite big
 end
+%The same problem split in three functions. C++ creates IPOPT itself from them (see casadi_op.hpp), so that each solve
+%can be stopped at a deadline given at run time. pre computes the inputs of IPOPT, nlp is the problem and post computes the
+%outputs of my_function from the solution of IPOPT
+pre_function = Function('pre', vars, {opti.x, opti.p, opti.lbg, opti.ubg}, names, {'x0','p','lbg','ubg'});
+nlp_function = Function('nlp', {opti.x, opti.p}, {opti.f, opti.g}, {'x','p'}, {'f','g'});
+post_function = Function('post', {opti.x, opti.p}, results_vars, {'x','p'}, results_names);
+if(pos_is_fixed==true)
+    name_op='op_fixed_pos';
+else
+    name_op='op';
+end
+pre_function.save(['./casadi_generated_files/' name_op '_pre.casadi'])
+nlp_function.save(['./casadi_generated_files/' name_op '_nlp.casadi'])
+post_function.save(['./casadi_generated_files/' name_op '_post.casadi'])
+
+if(save_copy_for_replay==true)
+    if(pos_is_fixed==true)
+        my_function.save(['./casadi_generated_files/op_fixed_pos_' linear_solver_name '.casadi'])
+    else
+        my_function.save(['./casadi_generated_files/op_' linear_solver_name '.casadi'])
+    end
+end
 
 
 % opti_tmp=opti.copy;
@@ -544,8 +569,10 @@ end
 tic();
 sol=my_function( names_value{:});
 toc();
-if(pos_is_fixed==false)
-    statistics=get_stats(my_function); %See functions defined below
+if(pos_is_fixed==true)
+    statistics=get_stats(my_function,'./casadi_generated_files/index_instruction_fixed_pos.txt'); %See functions defined below
+else
+    statistics=get_stats(my_function,'./casadi_generated_files/index_instruction.txt'); %See functions defined below
 end
 full(sol.pCPs)
 full(sol.yCPs)
@@ -561,6 +588,9 @@ fprintf(my_file,'num_max_of_obst: %d\n',num_max_of_obst);
 fprintf(my_file,'num_samples_simpson: %d\n',num_samples_simpson);
 fprintf(my_file,'num_of_yaw_per_layer: %d\n',num_of_yaw_per_layer); % except in the initial layer, that has only one value
 fprintf(my_file,'basis: "%s"\n',basis);
+fprintf(my_file,'max_cpu_time_ipopt: %f\n',max_cpu_time_ipopt);
+fprintf(my_file,'linear_solver_ipopt: "%s"\n',linear_solver_name);
+fprintf(my_file,'print_level_ipopt: %d\n',print_level);
 
 %%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
 %%%%%%% FUNCTION TO GENERATE VISIBILITY AT EACH POINT  %%%%%%%%%
@@ -762,7 +792,8 @@ end
 
 %Taken from https://gist.github.com/jgillis/9d12df1994b6fea08eddd0a3f0b0737f
 %See discussion at https://groups.google.com/g/casadi-users/c/1061E0eVAXM/m/dFHpw1CQBgAJ
-function [stats] = get_stats(f)
+%The index of the instruction that calls the solver is saved in file_name (it's different for op and op_fixed_pos)
+function [stats] = get_stats(f, file_name)
   dep = 0;
   % Loop over the algorithm
   for k=0:f.n_instructions()-1
@@ -771,8 +802,9 @@ function [stats] = get_stats(f)
       fprintf("Found k= %d\n", k)
       d = f.instruction_MX(k).which_function();
       if d.name()=='solver'
-        my_file=fopen('./casadi_generated_files/index_instruction.txt','w'); %Overwrite content
+        my_file=fopen(file_name,'w'); %Overwrite content
         fprintf(my_file,'%d\n',k);
+        fclose(my_file);
         dep = d;
         break
       end
@@ -33,6 +33,7 @@ fprintf(my_file,'#If you want to change a parameter, change it in the correspond
 fprintf(my_file,'min_size_sliding_window: %d\n',min_size_sliding_window);
 fprintf(my_file,'max_size_sliding_window: %d\n',max_size_sliding_window);
 fprintf(my_file,'deg_pos_prediction: %d\n',deg_pos_prediction);
+fprintf(my_file,'secs_prediction: %f\n',secs_prediction);
 
 % This file follows the notation of https://otexts.com/fpp2/regression-matrices.html#regression-matrices
 % Which is a generalization of the eq. 5.4 of https://otexts.com/fpp2/forecasting-regression.html 
@@ -0,0 +1,143 @@
+/* ----------------------------------------------------------------------------
+ * Copyright 2021, Jesus Tordesillas Torres, Aerospace Controls Laboratory
+ * Massachusetts Institute of Technology
+ * All Rights Reserved
+ * Authors: Jesus Tordesillas, et al.
+ * See LICENSE file for the license information
+ * -------------------------------------------------------------------------- */
+
+#include "async_logger.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+
+#include "termcolor.hpp"
+
+namespace tp
+{
+namespace
+{
+const int WRITER_PERIOD_MS = 50;  // The writer thread sleeps this time when the buffer is empty
+}
+
+AsyncLogger::AsyncLogger(const std::string& file_name, size_t capacity)
+{
+  size_t size = 2;
+  while (size < capacity)
+  {
+    size = 2 * size;
+  }
+  slots_.reset(new slot[size]);
+  mask_ = size - 1;
+  for (size_t i = 0; i < size; i++)
+  {
+    slots_[i].sequence.store(i, std::memory_order_relaxed);
+  }
+  enqueue_pos_.store(0, std::memory_order_relaxed);
+  stop_.store(false);
+  num_dropped_.store(0);
+
+  file_.open(file_name, std::ios::out | std::ios::binary | std::ios::trunc);
+  if (!file_.is_open())
+  {
+    std::cout << termcolor::red << "AsyncLogger: could not open " << file_name << ", nothing will be logged"
+              << termcolor::reset << std::endl;
+  }
+  file_ << "TPLOG1\n";
+
+  writer_ = std::thread(&AsyncLogger::writerLoop, this);
+}
+
+AsyncLogger::~AsyncLogger()
+{
+  stop_.store(true);
+  writer_.join();  // It writes the records that are still in the buffer before finishing
+  file_.close();
+}
+
+// Bounded MPMC queue of D. Vyukov (used here with a single consumer): each slot has a sequence number that tells if
+// it's free for the producer of position pos (sequence==pos) or ready for the consumer (sequence==pos+1)
+bool AsyncLogger::log(logRecordType type, double time, const float* values, int num_values)
+{
+  size_t pos = enqueue_pos_.load(std::memory_order_relaxed);
+  slot* s;
+  while (true)
+  {
+    s = &slots_[pos & mask_];
+    size_t sequence = s->sequence.load(std::memory_order_acquire);
+    intptr_t diff = intptr_t(sequence) - intptr_t(pos);
+    if (diff == 0)
+    {
+      if (enqueue_pos_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+      {
+        break;
+      }
+    }
+    else if (diff < 0)
+    {
+      num_dropped_.fetch_add(1, std::memory_order_relaxed);  // Full
+      return false;
+    }
+    else
+    {
+      pos = enqueue_pos_.load(std::memory_order_relaxed);
+    }
+  }
+
+  s->record.type = type;
+  s->record.num_values = std::min(std::max(num_values, 0), LOG_MAX_VALUES);
+  s->record.time = time;
+  std::copy(values, values + s->record.num_values, s->record.values);
+  s->sequence.store(pos + 1, std::memory_order_release);
+  return true;
+}
+
+bool AsyncLogger::pop(tp::logRecord& record)
+{
+  slot& s = slots_[dequeue_pos_ & mask_];
+  if (s.sequence.load(std::memory_order_acquire) != dequeue_pos_ + 1)
+  {
+    return false;  // Empty (or the next record is still being written)
+  }
+  record = s.record;
+  s.sequence.store(dequeue_pos_ + mask_ + 1, std::memory_order_release);
+  dequeue_pos_++;
+  return true;
+}
+
+void AsyncLogger::writerLoop()
+{
+  tp::logRecord record;
+  while (true)
+  {
+    bool stop = stop_.load();  // Read before draining, so that nothing logged before the destructor is lost
+
+    bool written = false;
+    while (pop(record))
+    {
+      file_.write(reinterpret_cast<const char*>(&record.type), sizeof(record.type));
+      file_.write(reinterpret_cast<const char*>(&record.num_values), sizeof(record.num_values));
+      file_.write(reinterpret_cast<const char*>(&record.time), sizeof(record.time));
+      file_.write(reinterpret_cast<const char*>(record.values), record.num_values * sizeof(float));
+      written = true;
+    }
+    if (written)
+    {
+      file_.flush();
+    }
+
+    if (stop)
+    {
+      return;
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(WRITER_PERIOD_MS));
+  }
+}
+
+uint64_t AsyncLogger::getNumDropped() const
+{
+  return num_dropped_.load(std::memory_order_relaxed);
+}
+
+}  // namespace tp
@@ -37,69 +37,86 @@ void CPs2TrajAndPwp(std::vector<Eigen::Vector3d> &qp, std::vector<double> &qy, s
   }
 
   /////////////////////////////////////////////////////////////////////
-  /// CONSTRUCT THE PIECE-WISE POLYNOMIAL FOR POSITION
+  /// CONSTRUCT THE PIECE-WISE POLYNOMIALS FOR POSITION AND YAW
   /////////////////////////////////////////////////////////////////////
-  Eigen::Matrix<double, 4, 4> M;
-  M << 1, 4, 1, 0,   //////
-      -3, 0, 3, 0,   //////
-      3, -6, 3, 0,   //////
-      -1, 3, -3, 1;  //////
-  M = M / 6.0;       // *1/3!
+  Eigen::RowVectorXd knots_y = knots_p.block(0, 1, 1, knots_p.size() - 2);  // remove first and last position knot
 
-  pwp_p.clear();
+  // std::cout << std::setprecision(15) << "knots_y= " << knots_y << std::endl;
 
-  for (int i = param_pp; i < (param_pp + num_seg + 1); i++)  // i < knots.size() - p
-  {
-    pwp_p.times.push_back(knots_p(i));
-  }
+  // Construct now the B-Spline, see https://github.com/libigl/eigen/blob/master/unsupported/test/splines.cpp#L37
+  Eigen::Spline<double, 3, Eigen::Dynamic> spline_p(knots_p, qp_matrix);
+  Eigen::Spline<double, 1, Eigen::Dynamic> spline_y(knots_y, qy_matrix);
+
+  // Note that the breakpoints (and t_min and t_max) are the same for both yaw and position
+  // The coefficients of each segment are obtained from the derivatives of the spline at the beginning of that segment
+  // (Taylor expansion). Note that the first and last segments of the clamped spline are not uniform
+  std::vector<Eigen::Matrix<double, 3, 4>> coeff_p(num_seg);  // pos(u)=coeff_p*[u^3 u^2 u 1]'
+  std::vector<Eigen::Matrix<double, 1, 3>> coeff_y(num_seg);  // yaw(u)=coeff_y*[u^2 u 1]'
+  std::vector<double> delta_seg(num_seg);
+
+  pwp_p.clear();
 
   for (int j = 0; j < num_seg; j++)
   {
-    Eigen::Matrix<double, 4, 1> cps_x = (qp_matrix.block(0, j, 1, 4).transpose());
-    Eigen::Matrix<double, 4, 1> cps_y = (qp_matrix.block(1, j, 1, 4).transpose());
-    Eigen::Matrix<double, 4, 1> cps_z = (qp_matrix.block(2, j, 1, 4).transpose());
-
-    pwp_p.all_coeff_x.push_back((M * cps_x).reverse());  // at^3 + bt^2 + ct + d --> [a b c d]'
-    pwp_p.all_coeff_y.push_back((M * cps_y).reverse());  // at^3 + bt^2 + ct + d --> [a b c d]'
-    pwp_p.all_coeff_z.push_back((M * cps_z).reverse());  // at^3 + bt^2 + ct + d --> [a b c d]'
+    double t_j = knots_p(param_pp + j);
+    double delta = knots_p(param_pp + j + 1) - t_j;
+    delta_seg[j] = delta;
+
+    Eigen::Matrix<double, 3, 4> derivatives_p = spline_p.derivatives(t_j, 3);
+    Eigen::Matrix<double, 1, 3> derivatives_y = spline_y.derivatives(t_j, 2);
+
+    coeff_p[j].col(3) = derivatives_p.col(0);
+    coeff_p[j].col(2) = derivatives_p.col(1) * delta;
+    coeff_p[j].col(1) = derivatives_p.col(2) * delta * delta / 2.0;
+    coeff_p[j].col(0) = derivatives_p.col(3) * delta * delta * delta / 6.0;
+
+    coeff_y[j](2) = derivatives_y(0);
+    coeff_y[j](1) = derivatives_y(1) * delta;
+    coeff_y[j](0) = derivatives_y(2) * delta * delta / 2.0;
+
+    pwp_p.times.push_back(t_j);
+    pwp_p.all_coeff_x.push_back(coeff_p[j].row(0).transpose());  // at^3 + bt^2 + ct + d --> [a b c d]'
+    pwp_p.all_coeff_y.push_back(coeff_p[j].row(1).transpose());  // at^3 + bt^2 + ct + d --> [a b c d]'
+    pwp_p.all_coeff_z.push_back(coeff_p[j].row(2).transpose());  // at^3 + bt^2 + ct + d --> [a b c d]'
   }
+  pwp_p.times.push_back(knots_p(param_pp + num_seg));
 
   /////////////////////////////////////////////////////////////////////
   /// FILL ALL THE FIELDS OF TRAJ (BOTH POSITION AND YAW)
   /////////////////////////////////////////////////////////////////////
-  Eigen::RowVectorXd knots_y = knots_p.block(0, 1, 1, knots_p.size() - 2);  // remove first and last position knot
-
-  // std::cout << std::setprecision(15) << "knots_y= " << knots_y << std::endl;
-
-  // Construct now the B-Spline, see https://github.com/libigl/eigen/blob/master/unsupported/test/splines.cpp#L37
-  Eigen::Spline<double, 3, Eigen::Dynamic> spline_p(knots_p, qp_matrix);
-  Eigen::Spline<double, 1, Eigen::Dynamic> spline_y(knots_y, qy_matrix);
 
-  // Note that t_min and t_max are the same for both yaw and position
   double t_min = knots_p.minCoeff();
   double t_max = knots_p.maxCoeff();
 
   // Clear and fill the trajectory
   traj.clear();
+  traj.reserve((int)((t_max - t_min) / dc) + 2);
 
+  int j = 0;  // segment
   for (double t = t_min; t <= t_max; t = t + dc)
   {
     // std::cout << "t= " << t << std::endl;
-    Eigen::MatrixXd derivatives_p = spline_p.derivatives(t, 4);  // compute the derivatives up to that order
-    Eigen::MatrixXd derivatives_y = spline_y.derivatives(t, 3);
+    while (j < (num_seg - 1) && t >= pwp_p.times[j + 1])
+    {
+      j++;
+    }
 
-    mt::state state_i;
+    const Eigen::Matrix<double, 3, 4> &P = coeff_p[j];
+    const Eigen::Matrix<double, 1, 3> &Y = coeff_y[j];
+    double delta = delta_seg[j];
+    double u = (t - pwp_p.times[j]) / delta;
 
-    state_i.setPos(derivatives_p.col(0));  // First column
-    state_i.setVel(derivatives_p.col(1));
-    state_i.setAccel(derivatives_p.col(2));
-    state_i.setJerk(derivatives_p.col(3));
+    mt::state state_i;
 
-    // std::cout << "derivatives_y= " << derivatives_y << std::endl;
+    // Horner (and chain rule for the derivatives, du/dt=1/delta)
+    state_i.setPos(((P.col(0) * u + P.col(1)) * u + P.col(2)) * u + P.col(3));
+    state_i.setVel(((3.0 * P.col(0)) * u + 2.0 * P.col(1)) * u / delta + P.col(2) / delta);
+    state_i.setAccel((6.0 * P.col(0) * u + 2.0 * P.col(1)) / (delta * delta));
+    state_i.setJerk(6.0 * P.col(0) / (delta * delta * delta));
 
-    state_i.setYaw(derivatives_y(0, 0));
-    state_i.setDYaw(derivatives_y(0, 1));
-    state_i.setDDYaw(derivatives_y(0, 2));
+    state_i.setYaw((Y(0) * u + Y(1)) * u + Y(2));
+    state_i.setDYaw((2.0 * Y(0) * u + Y(1)) / delta);
+    state_i.setDDYaw(2.0 * Y(0) / (delta * delta));
 
     traj.push_back(state_i);
   }
@@ -0,0 +1,207 @@
+/* ----------------------------------------------------------------------------
+ * Copyright 2021, Jesus Tordesillas Torres, Aerospace Controls Laboratory
+ * Massachusetts Institute of Technology
+ * All Rights Reserved
+ * Authors: Jesus Tordesillas, et al.
+ * See LICENSE file for the license information
+ * -------------------------------------------------------------------------- */
+
+#include "casadi_op.hpp"
+
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <limits>
+
+#include "nlp_instance.hpp"
+#include "termcolor.hpp"
+
+using namespace termcolor;
+
+// Called by IPOPT (through casadi) after each iteration, with the outputs of nlpsol as inputs. Returning 1 stops the
+// solver
+class DeadlineCallback : public casadi::Callback
+{
+public:
+  DeadlineCallback(const std::string& name, casadi_int nx, casadi_int ng, casadi_int np) : nx_(nx), ng_(ng), np_(np)
+  {
+    construct(name);
+  }
+
+  void setDeadline(double ms_budget)
+  {
+    has_deadline_ = (ms_budget > 0);
+    deadline_ = std::chrono::steady_clock::now() + std::chrono::microseconds(static_cast<int64_t>(1000 * ms_budget));
+  }
+
+  casadi_int get_n_in() override
+  {
+    return casadi::nlpsol_n_out();
+  }
+
+  casadi_int get_n_out() override
+  {
+    return 1;
+  }
+
+  std::string get_name_in(casadi_int i) override
+  {
+    return casadi::nlpsol_out(i);
+  }
+
+  std::string get_name_out(casadi_int i) override
+  {
+    return "ret";
+  }
+
+  casadi::Sparsity get_sparsity_in(casadi_int i) override
+  {
+    std::string name = casadi::nlpsol_out(i);
+    if (name == "f")
+    {
+      return casadi::Sparsity::scalar();
+    }
+    else if (name == "x" || name == "lam_x")
+    {
+      return casadi::Sparsity::dense(nx_);
+    }
+    else if (name == "g" || name == "lam_g")
+    {
+      return casadi::Sparsity::dense(ng_);
+    }
+    else if (name == "lam_p")
+    {
+      return casadi::Sparsity::dense(np_);
+    }
+    return casadi::Sparsity(0, 0);
+  }
+
+  std::vector<casadi::DM> eval(const std::vector<casadi::DM>& arg) const override
+  {
+    bool stop = has_deadline_ && (std::chrono::steady_clock::now() > deadline_);
+    return { casadi::DM(stop ? 1 : 0) };
+  }
+
+private:
+  casadi_int nx_;
+  casadi_int ng_;
+  casadi_int np_;
+  bool has_deadline_ = false;
+  std::chrono::steady_clock::time_point deadline_;
+};
+
+CasadiOp::CasadiOp()
+{
+}
+
+CasadiOp::~CasadiOp()
+{
+}
+
+bool CasadiOp::load(const std::string& folder, const std::string& name, const casadi::Dict& opts_solver)
+{
+  name_ = name;
+
+  std::string file_pre = folder + name + "_pre.casadi";
+  std::string file_nlp = folder + name + "_nlp.casadi";
+  std::string file_post = folder + name + "_post.casadi";
+
+  has_deadline_ = std::ifstream(file_pre).good() && std::ifstream(file_nlp).good() && std::ifstream(file_post).good();
+  try
+  {
+    if (has_deadline_)
+    {
+      pre_ = casadi::Function::load(file_pre);
+      post_ = casadi::Function::load(file_post);
+      casadi::Function nlp = casadi::Function::load(file_nlp);
+
+      deadline_callback_ = std::unique_ptr<DeadlineCallback>(
+          new DeadlineCallback(name + "_deadline", nlp.size1_in("x"), nlp.size1_out("g"), nlp.size1_in("p")));
+
+      casadi::Dict opts = opts_solver;
+      opts["iteration_callback"] = *deadline_callback_;
+      solver_ = casadi::nlpsol(name + "_solver", "ipopt", nlp, opts);
+    }
+    else
+    {
+      std::cout << bold << yellow << file_pre << " (and/or " << name << "_nlp.casadi, " << name
+                << "_post.casadi) not found, using " << name << ".casadi. The time budget of each replan is NOT "
+                << "enforced (IPOPT can only be stopped by its max_cpu_time). Run main.m again to generate them"
+                << reset << std::endl;
+      cf_ = casadi::Function::load(folder + name + ".casadi");
+      index_instruction_ = getIndexInstructionSolver(cf_, folder, name);
+      if (index_instruction_ < 0)
+      {
+        std::cout << red << "The call to IPOPT was not found in " << name << ".casadi" << reset << std::endl;
+        return false;
+      }
+    }
+  }
+  catch (std::exception& e)
+  {
+    std::cout << red << "Could not load " << name << ": " << e.what() << reset << std::endl;
+    return false;
+  }
+  return true;
+}
+
+std::map<std::string, casadi::DM> CasadiOp::solve(const std::map<std::string, casadi::DM>& arguments,
+                                                  double ms_budget)
+{
+  if (has_deadline_ == false)
+  {
+    return cf_(arguments);
+  }
+
+  std::map<std::string, casadi::DM> input_solver = pre_(arguments);  // x0, p, lbg and ubg
+
+  deadline_callback_->setDeadline(ms_budget);
+  std::map<std::string, casadi::DM> output_solver = solver_(input_solver);
+
+  return post_(std::map<std::string, casadi::DM>{ { "x", output_solver["x"] }, { "p", input_solver["p"] } });
+}
+
+casadi::Dict CasadiOp::getStats()
+{
+  return solver_.stats();
+}
+
+void CasadiOp::getStatusAndIterCount(std::string& status, int& iter_count)
+{
+  if (has_deadline_ == false)
+  {
+    ::getStatusAndIterCount(cf_, index_instruction_, status, iter_count);
+    return;
+  }
+  casadi::Dict stats = getStats();
+  status = std::string(stats["return_status"]);
+  iter_count = stats.count("iter_count") ? int(stats["iter_count"].to_int()) : -1;
+}
+
+double CasadiOp::getInfPrLastIterate()
+{
+  try
+  {
+    casadi::Dict stats = has_deadline_ ? getStats() : cf_.instruction_MX(index_instruction_).which_function().stats(1);
+    std::vector<double> inf_pr_all = std::map<std::string, casadi::GenericType>(stats["iterations"])["inf_pr"];
+    if (inf_pr_all.size() > 0)
+    {
+      return inf_pr_all.back();
+    }
+  }
+  catch (std::exception& e)
+  {
+    std::cout << red << "Could not obtain inf_pr: " << e.what() << reset << std::endl;
+  }
+  return std::numeric_limits<double>::infinity();
+}
+
+bool CasadiOp::hasDeadline() const
+{
+  return has_deadline_;
+}
+
+const std::string& CasadiOp::getName() const
+{
+  return name_;
+}
@@ -0,0 +1,369 @@
+/* ----------------------------------------------------------------------------
+ * Copyright 2021, Jesus Tordesillas Torres, Aerospace Controls Laboratory
+ * Massachusetts Institute of Technology
+ * All Rights Reserved
+ * Authors: Jesus Tordesillas, et al.
+ * See LICENSE file for the license information
+ * -------------------------------------------------------------------------- */
+
+#include "compact_traj.hpp"
+
+#include <algorithm>
+#include <limits>
+#include <utility>
+
+#include "byte_buffer.hpp"
+
+// Layout of the buffer:
+//  header:   uint8 version | uint8 flags | int32 id | uint32 seq | uint32 base_seq | float bbox[3] | float pos[3]
+//  mean:     double t0 | uint16 num_runs | runs
+//              run NEW:  uint8 RUN_NEW  | uint16 count | count x interval
+//              run COPY: uint8 RUN_COPY | uint16 count | uint16 start (index of the interval in the broadcast base_seq)
+//  variance: (only if FLAG_HAS_VAR) double t0 | uint16 num_intervals | num_intervals x interval
+// where interval = float t_end-t0 | float coeff[12] (same layout as in PieceWisePolFixed<3>)
+
+namespace
+{
+const uint8_t VERSION = 1;
+
+const uint8_t FLAG_IS_AGENT = 1 << 0;
+const uint8_t FLAG_HAS_VAR = 1 << 1;
+const uint8_t FLAG_IS_DELTA = 1 << 2;
+
+const uint8_t RUN_NEW = 0;
+const uint8_t RUN_COPY = 1;
+
+const int NUM_COEFF = 3 * 4;  // per interval
+const size_t SIZE_HEADER = 2 * sizeof(uint8_t) + sizeof(int32_t) + 2 * sizeof(uint32_t) + 6 * sizeof(float);
+const size_t SIZE_INTERVAL = (1 + NUM_COEFF) * sizeof(float);
+
+void writeInterval(std::vector<uint8_t>& buffer, const mt::PieceWisePolFixed<3>& pwp, int j, double t0)
+{
+  mt::writeBytes<float>(buffer, pwp.times[j + 1] - t0);
+  for (int k = 0; k < NUM_COEFF; k++)
+  {
+    mt::writeBytes<float>(buffer, pwp.coeff[NUM_COEFF * j + k]);
+  }
+}
+
+// Appends the interval to pwp
+bool readInterval(mt::byteReader& r, mt::PieceWisePolFixed<3>& pwp, double t0)
+{
+  float tmp[1 + NUM_COEFF];
+  if (!r.readArray(tmp, 1 + NUM_COEFF))
+  {
+    return false;
+  }
+  pwp.times.push_back(t0 + tmp[0]);
+  pwp.coeff.insert(pwp.coeff.end(), tmp + 1, tmp + 1 + NUM_COEFF);
+  return true;
+}
+
+bool readHeader(mt::byteReader& r, uint8_t& flags, uint32_t& seq, uint32_t& base_seq, mt::compactTrajInfo& info)
+{
+  uint8_t version;
+  int32_t id;
+  float bbox[3], pos[3];
+
+  bool ok = r.read(version) && version == VERSION && r.read(flags) && r.read(id) && r.read(seq) && r.read(base_seq);
+  for (int i = 0; i < 3; i++)
+  {
+    ok = ok && r.read(bbox[i]);
+  }
+  for (int i = 0; i < 3; i++)
+  {
+    ok = ok && r.read(pos[i]);
+  }
+  if (!ok)
+  {
+    return false;
+  }
+
+  info.id = id;
+  info.is_agent = (flags & FLAG_IS_AGENT);
+  info.bbox << bbox[0], bbox[1], bbox[2];
+  info.pos << pos[0], pos[1], pos[2];
+  return true;
+}
+
+bool isZero(const mt::PieceWisePolFixed<3>& pwp)
+{
+  return std::all_of(pwp.coeff.begin(), pwp.coeff.end(), [](double c) { return c == 0.0; });
+}
+
+// Returns the index of the interval of base that is exactly equal to the interval j of pwp (or -1 if there is none)
+int findSameInterval(const mt::PieceWisePolFixed<3>& base, const mt::PieceWisePolFixed<3>& pwp, int j)
+{
+  if (base.times.size() < 2)
+  {
+    return -1;
+  }
+
+  auto it = std::lower_bound(base.times.begin(), base.times.end() - 1, pwp.times[j]);
+  if (it == base.times.end() - 1 || *it != pwp.times[j] || *(it + 1) != pwp.times[j + 1])
+  {
+    return -1;
+  }
+
+  int k = it - base.times.begin();
+  bool same_coeff = std::equal(pwp.coeff.begin() + NUM_COEFF * j, pwp.coeff.begin() + NUM_COEFF * (j + 1),
+                               base.coeff.begin() + NUM_COEFF * k);
+  return same_coeff ? k : -1;
+}
+
+void fixedToPieceWisePol(const mt::PieceWisePolFixed<3>& pwp_fixed, mt::PieceWisePol& pwp)
+{
+  pwp.clear();
+  pwp.times = pwp_fixed.times;
+  for (int j = 0; j < pwp_fixed.getNumOfIntervals(); j++)
+  {
+    Eigen::Map<const mt::PieceWisePolFixed<3>::CoeffMatrix> C = pwp_fixed.getCoeffInterval(j);
+    pwp.all_coeff_x.push_back(C.row(0).transpose());
+    pwp.all_coeff_y.push_back(C.row(1).transpose());
+    pwp.all_coeff_z.push_back(C.row(2).transpose());
+  }
+}
+}  // namespace
+
+CompactTrajEncoder::CompactTrajEncoder(int keyframe_period) : keyframe_period_(keyframe_period)
+{
+}
+
+bool CompactTrajEncoder::encode(const mt::PieceWisePol& pwp_mean, const mt::PieceWisePol& pwp_var,
+                                const mt::compactTrajInfo& info, std::vector<uint8_t>& buffer)
+{
+  return pwp_mean.toFixed(mean_) && encodeFixed(pwp_var, info, buffer);
+}
+
+bool CompactTrajEncoder::encode(const mt::PieceWisePolDeque& pwp_mean, const mt::PieceWisePol& pwp_var,
+                                const mt::compactTrajInfo& info, std::vector<uint8_t>& buffer)
+{
+  return pwp_mean.toFixed(mean_) && encodeFixed(pwp_var, info, buffer);
+}
+
+// Encodes mean_ (already filled by encode())
+bool CompactTrajEncoder::encodeFixed(const mt::PieceWisePol& pwp_var, const mt::compactTrajInfo& info,
+                                     std::vector<uint8_t>& buffer)
+{
+  const mt::PieceWisePolFixed<3>& mean = mean_;
+  const mt::PieceWisePolFixed<3>& var = var_;
+  if (!pwp_var.toFixed(var_) ||
+      mean.getNumOfIntervals() > std::numeric_limits<uint16_t>::max() ||
+      var.getNumOfIntervals() > std::numeric_limits<uint16_t>::max())
+  {
+    return false;
+  }
+
+  bool has_var = !isZero(var);
+  bool is_delta = (num_since_keyframe_ < keyframe_period_ - 1) && (last_mean_.times.size() >= 2);
+
+  //////////////////// Runs of the mean
+  // Each run is (start, count), where start is the index of its first interval in last_mean_ (or -1 for NEW runs)
+  std::vector<std::pair<int, int>> runs;
+  for (int j = 0; j < mean.getNumOfIntervals(); j++)
+  {
+    int k = is_delta ? findSameInterval(last_mean_, mean, j) : -1;
+
+    bool continues_run = !runs.empty() && runs.back().second < std::numeric_limits<uint16_t>::max() &&
+                         ((k == -1 && runs.back().first == -1) ||
+                          (k != -1 && runs.back().first != -1 && runs.back().first + runs.back().second == k));
+    if (continues_run)
+    {
+      runs.back().second++;
+    }
+    else
+    {
+      runs.push_back(std::make_pair(k, 1));
+    }
+  }
+
+  //////////////////// Write the buffer
+  buffer.clear();
+  buffer.reserve(SIZE_HEADER + sizeof(double) + sizeof(uint16_t) + runs.size() * 2 * sizeof(uint16_t) +
+                 mean.getNumOfIntervals() * (SIZE_INTERVAL + 1) +
+                 (has_var ? var.getNumOfIntervals() * SIZE_INTERVAL + sizeof(double) + sizeof(uint16_t) : 0));
+
+  uint8_t flags = (info.is_agent ? FLAG_IS_AGENT : 0) | (has_var ? FLAG_HAS_VAR : 0) | (is_delta ? FLAG_IS_DELTA : 0);
+
+  mt::writeBytes<uint8_t>(buffer, VERSION);
+  mt::writeBytes<uint8_t>(buffer, flags);
+  mt::writeBytes<int32_t>(buffer, info.id);
+  mt::writeBytes<uint32_t>(buffer, seq_ + 1);
+  mt::writeBytes<uint32_t>(buffer, seq_);  // base_seq
+  for (int i = 0; i < 3; i++)
+  {
+    mt::writeBytes<float>(buffer, info.bbox(i));
+  }
+  for (int i = 0; i < 3; i++)
+  {
+    mt::writeBytes<float>(buffer, info.pos(i));
+  }
+
+  double t0 = mean.times.front();
+  mt::writeBytes<double>(buffer, t0);
+  mt::writeBytes<uint16_t>(buffer, runs.size());
+  int j = 0;
+  for (auto& run : runs)
+  {
+    if (run.first == -1)
+    {
+      mt::writeBytes<uint8_t>(buffer, RUN_NEW);
+      mt::writeBytes<uint16_t>(buffer, run.second);
+      for (int i = 0; i < run.second; i++)
+      {
+        writeInterval(buffer, mean, j + i, t0);
+      }
+    }
+    else
+    {
+      mt::writeBytes<uint8_t>(buffer, RUN_COPY);
+      mt::writeBytes<uint16_t>(buffer, run.second);
+      mt::writeBytes<uint16_t>(buffer, run.first);
+    }
+    j += run.second;
+  }
+
+  if (has_var)
+  {
+    double t0_var = var.times.front();
+    mt::writeBytes<double>(buffer, t0_var);
+    mt::writeBytes<uint16_t>(buffer, var.getNumOfIntervals());
+    for (int i = 0; i < var.getNumOfIntervals(); i++)
+    {
+      writeInterval(buffer, var, i, t0_var);
+    }
+  }
+
+  seq_++;
+  num_since_keyframe_ = is_delta ? (num_since_keyframe_ + 1) : 0;
+  std::swap(last_mean_, mean_);  // keeps the memory of both for the next broadcast
+
+  return true;
+}
+
+bool CompactTrajDecoder::decodeInfo(const uint8_t* data, size_t size, mt::compactTrajInfo& info)
+{
+  mt::byteReader r(data, size);
+  uint8_t flags;
+  uint32_t seq, base_seq;
+  return readHeader(r, flags, seq, base_seq, info);
+}
+
+bool CompactTrajDecoder::decode(const uint8_t* data, size_t size, mt::dynTrajCompiled& traj)
+{
+  mt::byteReader r(data, size);
+  uint8_t flags;
+  uint32_t seq, base_seq;
+  mt::compactTrajInfo info;
+  if (!readHeader(r, flags, seq, base_seq, info))
+  {
+    return false;
+  }
+
+  const mt::PieceWisePolFixed<3>* base = nullptr;
+  if (flags & FLAG_IS_DELTA)
+  {
+    auto it = last_decoded_.find(info.id);
+    if (it == last_decoded_.end() || it->second.seq != base_seq)
+    {
+      return false;  // I don't have the broadcast this delta refers to
+    }
+    base = &(it->second.mean);
+  }
+
+  //////////////////// Mean
+  mt::PieceWisePolFixed<3>& mean = traj.pwp_mean_fixed;
+  mean.clear();
+
+  double t0;
+  uint16_t num_runs;
+  if (!r.read(t0) || !r.read(num_runs) || num_runs == 0)
+  {
+    return false;
+  }
+  mean.times.push_back(t0);
+
+  for (int i = 0; i < num_runs; i++)
+  {
+    uint8_t type;
+    uint16_t count;
+    if (!r.read(type) || !r.read(count))
+    {
+      return false;
+    }
+
+    if (type == RUN_NEW)
+    {
+      for (int k = 0; k < count; k++)
+      {
+        if (!readInterval(r, mean, t0))
+        {
+          return false;
+        }
+      }
+    }
+    else if (type == RUN_COPY)
+    {
+      uint16_t start;
+      if (!r.read(start) || base == nullptr || (start + count) > base->getNumOfIntervals())
+      {
+        return false;
+      }
+      mean.times.insert(mean.times.end(), base->times.begin() + start + 1, base->times.begin() + start + count + 1);
+      mean.coeff.insert(mean.coeff.end(), base->coeff.begin() + NUM_COEFF * start,
+                        base->coeff.begin() + NUM_COEFF * (start + count));
+    }
+    else
+    {
+      return false;
+    }
+  }
+
+  if (mean.times.size() < 2)
+  {
+    return false;
+  }
+
+  //////////////////// Variance
+  mt::PieceWisePolFixed<3>& var = traj.pwp_var_fixed;
+  var.clear();
+
+  if (flags & FLAG_HAS_VAR)
+  {
+    double t0_var;
+    uint16_t num_intervals;
+    if (!r.read(t0_var) || !r.read(num_intervals) || num_intervals == 0)
+    {
+      return false;
+    }
+    var.times.push_back(t0_var);
+    for (int k = 0; k < num_intervals; k++)
+    {
+      if (!readInterval(r, var, t0_var))
+      {
+        return false;
+      }
+    }
+  }
+  else
+  {
+    var.times = { mean.times.front(), mean.times.back() };
+    var.coeff.assign(NUM_COEFF, 0.0);
+  }
+
+  lastDecoded& last = last_decoded_[info.id];
+  last.seq = seq;
+  last.mean = mean;
+
+  //////////////////// Rest of the fields
+  traj.use_pwp_field = true;
+  traj.use_pwp_fixed = true;
+  fixedToPieceWisePol(mean, traj.pwp_mean);  // Needed by Panther::vertexesOfInterval()
+  fixedToPieceWisePol(var, traj.pwp_var);
+  traj.is_static = ((mean.eval(0.0) - mean.eval(1e30)).norm() < 1e-5);  // Same as in dynTraj2dynTrajCompiled
+  traj.bbox = info.bbox;
+  traj.id = info.id;
+  traj.is_agent = info.is_agent;
+
+  return true;
+}
@@ -0,0 +1,191 @@
+/* ----------------------------------------------------------------------------
+ * Copyright 2021, Jesus Tordesillas Torres, Aerospace Controls Laboratory
+ * Massachusetts Institute of Technology
+ * All Rights Reserved
+ * Authors: Jesus Tordesillas, et al.
+ * See LICENSE file for the license information
+ * -------------------------------------------------------------------------- */
+
+// Compares the expression tree (parseExpression, expressionToString, differentiateExpression and lowerExpression)
+// against exprtk, using the trajectories of dynamic_corridor.py, the strings of pieceWisePol2String() and some corner
+// cases of precedence. Returns 0 if all the checks pass
+
+#include "utils.hpp"
+#include "exprtk.hpp"
+#include "expression_tree.hpp"
+#include "termcolor.hpp"
+
+using namespace termcolor;
+
+typedef exprtk::symbol_table<double> symbol_table_t;
+typedef exprtk::expression<double> expression_t;
+typedef exprtk::parser<double> parser_t;
+
+int num_failed = 0;
+
+void check(bool condition, const std::string& info)
+{
+  if (condition == false)
+  {
+    std::cout << red << "FAILED: " << info << reset << std::endl;
+    num_failed++;
+  }
+}
+
+bool isClose(double a, double b, double tol)
+{
+  return fabs(a - b) <= tol * (1.0 + fabs(b));
+}
+
+// All the exprtk expressions use the same variable t
+class exprtkExpression
+{
+public:
+  exprtkExpression(double& t)
+  {
+    symbol_table_.add_variable("t", t);
+    expression_.register_symbol_table(symbol_table_);
+  }
+
+  bool compile(const std::string& s)
+  {
+    parser_t parser;
+    return parser.compile(s, expression_);
+  }
+
+  double value()
+  {
+    return expression_.value();
+  }
+
+private:
+  symbol_table_t symbol_table_;
+  expression_t expression_;
+};
+
+// times should not be at the discontinuities of s (the derivative is checked with finite differences)
+void testExpression(const std::string& s, const std::vector<double>& times, bool can_be_lowered)
+{
+  std::cout << "Testing " << s.substr(0, 100) << (s.size() > 100 ? "..." : "") << std::endl;
+
+  mt::exprNodePtr root;
+  if (parseExpression(s, root) == false)
+  {
+    check(false, "parseExpression(" + s + ")");
+    return;
+  }
+  mt::exprNodePtr derivative = differentiateExpression(root);
+  if (derivative == nullptr)
+  {
+    check(false, "differentiateExpression(" + s + ")");
+    return;
+  }
+
+  double t;
+  exprtkExpression original(t), printed(t), printed_derivative(t);
+  check(original.compile(s), "exprtk could not compile " + s);
+  check(printed.compile(expressionToString(root)), "exprtk could not compile " + expressionToString(root));
+  check(printed_derivative.compile(expressionToString(derivative)),
+        "exprtk could not compile " + expressionToString(derivative));
+
+  mt::nativeExpression native;
+  bool lowered = lowerExpression(root, times.front(), native);
+  check(lowered == can_be_lowered, "lowerExpression(" + s + ") returned " + std::to_string(lowered));
+
+  for (double ti : times)
+  {
+    t = ti;
+    double value = original.value();
+    double value_printed = printed.value();
+    double value_derivative = printed_derivative.value();
+
+    double h = 1e-5;
+    t = ti + h;
+    double value_plus = original.value();
+    t = ti - h;
+    double value_minus = original.value();
+    double value_derivative_fd = (value_plus - value_minus) / (2 * h);
+
+    std::string at_t = " at t=" + std::to_string(ti);
+    check(isClose(value_printed, value, 1e-12),
+          "parse->print: " + std::to_string(value_printed) + " vs exprtk " + std::to_string(value) + at_t);
+    check(isClose(value_derivative, value_derivative_fd, 1e-5),
+          "derivative: " + std::to_string(value_derivative) + " vs finite differences " +
+              std::to_string(value_derivative_fd) + at_t);
+
+    if (lowered)
+    {
+      check(isClose(native.eval(ti), value, 1e-9),
+            "native: " + std::to_string(native.eval(ti)) + " vs exprtk " + std::to_string(value) + at_t);
+      check(isClose(native.evalDerivative(ti), value_derivative, 1e-9),
+            "native derivative: " + std::to_string(native.evalDerivative(ti)) + " vs " +
+                std::to_string(value_derivative) + at_t);
+    }
+  }
+}
+
+int main()
+{
+  std::vector<double> times = { 0.0, 0.37, 1.1, 2.9, 10.3, 123.4, 1000.7, 1e5 + 0.3 };
+
+  ////////////////// Trajectories of dynamic_corridor.py (the strings are the ones Python generates)
+  // trefoil(2.0, -3.0, 1.0, 2.0, 2.5, 1.0, 0.5, 1.5)
+  testExpression("0.3333333333333333*(sin(t/1.5+0.5) + 2 * sin(2 * t/1.5+0.5))+2.0", times, true);
+  testExpression("0.5*(cos(t/1.5+0.5) - 2 * cos(2 * t/1.5+0.5))+-3.0", times, true);
+  testExpression("0.5*(-sin(3 * t/1.5+0.5))+1.0", times, true);
+
+  // wave_in_z(1.0, 2.0, 1.5, 0.5, 0.3, 2.0)
+  testExpression("1.0", times, true);
+  testExpression("2.0", times, true);
+  testExpression("0.5*(-sin( t/2.0+0.3))+1.5", times, true);
+
+  // square(-1.0, 2.0, 1.0, 1.5, 1.5, 1.5, 0.7, 1.2)
+  std::string cost = "cos((t+0.7)/1.2)";
+  std::string sint = "sin((t+0.7)/1.2)";
+  std::string x_square = "1.5*0.5*(abs(" + cost + ")*" + cost + "+abs(" + sint + ")*" + sint + ")";
+  std::string y_square = "1.5*0.5*(abs(" + cost + ")*" + cost + "-abs(" + sint + ")*" + sint + ")";
+  testExpression("(cos(0.7)*" + x_square + "-sin(0.7)*" + y_square + ")+-1.0", times, false);
+  testExpression("(sin(0.7)*" + x_square + "+cos(0.7)*" + y_square + ")+2.0", times, false);
+  testExpression(x_square + "+1.0", times, false);
+
+  // static(1.0, -2.0, 3.5)
+  testExpression("1.0", times, true);
+  testExpression("-2.0", times, true);
+  testExpression("3.5", times, true);
+
+  ////////////////// Strings of pieceWisePol2String()
+  mt::PieceWisePol pwp;
+  pwp.times = { 10.0, 11.0, 12.5, 14.0 };
+  Eigen::Matrix<double, 4, 1> coeffs;
+  for (int i = 0; i < 3; i++)
+  {
+    coeffs << 1.0 + i, -2.0 + 0.5 * i, 3.0, 4.0 - i;
+    pwp.all_coeff_x.push_back(coeffs);
+    pwp.all_coeff_y.push_back(-coeffs);
+    pwp.all_coeff_z.push_back(0.1 * coeffs);
+  }
+  std::vector<double> times_pwp = { 9.3, 10.2, 10.9, 11.7, 12.4, 13.1, 13.9, 15.2 };
+  for (auto& s : pieceWisePol2String(pwp))
+  {
+    testExpression(s, times_pwp, false);
+  }
+
+  ////////////////// Precedence
+  std::vector<double> times_precedence = { 0.37, 1.1, 2.9 };  // t^-1 is not defined at t=0
+  for (std::string s : { "-2^2", "2^3^2", "2*-t", "-t^2", "-(t-1)^3", "3-t-1", "1+2*t^2-t/4" })
+  {
+    testExpression(s, times_precedence, true);
+  }
+  for (std::string s : { "t^-1", "2^-t", "t^2^0.5", "8/t/2" })  // Not of the form of mt::nativeExpression
+  {
+    testExpression(s, times_precedence, false);
+  }
+
+  if (num_failed > 0)
+  {
+    std::cout << red << num_failed << " checks failed" << reset << std::endl;
+    return 1;
+  }
+  std::cout << green << "All the checks passed" << reset << std::endl;
+  return 0;
+}
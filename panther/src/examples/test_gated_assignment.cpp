@@ -0,0 +1,195 @@
+/* ----------------------------------------------------------------------------
+ * Copyright 2021, Jesus Tordesillas Torres, Aerospace Controls Laboratory
+ * Massachusetts Institute of Technology
+ * All Rights Reserved
+ * Authors: Jesus Tordesillas, et al.
+ * See LICENSE file for the license information
+ * -------------------------------------------------------------------------- */
+
+// Compares GatedAssignment with a brute-force search over all the assignments that only use the allowed pairs, on
+// small random instances (several connected components, rows/columns without edges, more rows than columns and vice
+// versa). Returns 0 if all the checks pass
+
+#include "gated_assignment.hpp"
+#include "termcolor.hpp"
+
+#include <cmath>
+#include <iostream>
+#include <random>
+#include <string>
+
+using namespace termcolor;
+
+int num_failed = 0;
+
+void check(bool condition, const std::string& info)
+{
+  if (condition == false)
+  {
+    std::cout << red << "FAILED: " << info << reset << std::endl;
+    num_failed++;
+  }
+}
+
+// cost[row][col] is the cost of the pair, or -1 if the pair is not allowed
+typedef std::vector<std::vector<double>> costMatrix;
+
+// Best assignment of the rows [row, num_rows): the number of assigned rows is maximized first, and then the total
+// cost is minimized
+void bruteForce(const costMatrix& cost, int row, std::vector<bool>& col_used, int num_assigned, double total_cost,
+                int& best_num_assigned, double& best_cost)
+{
+  if (row == cost.size())
+  {
+    if (num_assigned > best_num_assigned || (num_assigned == best_num_assigned && total_cost < best_cost))
+    {
+      best_num_assigned = num_assigned;
+      best_cost = total_cost;
+    }
+    return;
+  }
+
+  bruteForce(cost, row + 1, col_used, num_assigned, total_cost, best_num_assigned, best_cost);  // row unassigned
+  for (int col = 0; col < cost[row].size(); col++)
+  {
+    if (cost[row][col] >= 0.0 && !col_used[col])
+    {
+      col_used[col] = true;
+      bruteForce(cost, row + 1, col_used, num_assigned + 1, total_cost + cost[row][col], best_num_assigned, best_cost);
+      col_used[col] = false;
+    }
+  }
+}
+
+// Checks that the assignment only uses allowed pairs and different columns, and that it is as good as the one found
+// by brute force
+void checkAssignment(const costMatrix& cost, const std::vector<int>& assignment, const std::string& info)
+{
+  int num_cols = cost.empty() ? 0 : cost[0].size();
+  check(assignment.size() == cost.size(), info + ", size of the assignment");
+  if (assignment.size() != cost.size())
+  {
+    return;
+  }
+
+  std::vector<bool> col_used(num_cols, false);
+  int num_assigned = 0;
+  double total_cost = 0.0;
+  for (int row = 0; row < assignment.size(); row++)
+  {
+    int col = assignment[row];
+    if (col == -1)
+    {
+      continue;
+    }
+    bool valid = (col >= 0 && col < num_cols && cost[row][col] >= 0.0 && !col_used[col]);
+    check(valid, info + ", row " + std::to_string(row) + " assigned to column " + std::to_string(col));
+    if (!valid)
+    {
+      return;
+    }
+    col_used[col] = true;
+    num_assigned++;
+    total_cost += cost[row][col];
+  }
+
+  int best_num_assigned = -1;
+  double best_cost = 0.0;
+  std::vector<bool> col_used_bf(num_cols, false);
+  bruteForce(cost, 0, col_used_bf, 0, 0.0, best_num_assigned, best_cost);
+
+  check(num_assigned == best_num_assigned, info + ", assigned rows: " + std::to_string(num_assigned) +
+                                               " (brute force: " + std::to_string(best_num_assigned) + ")");
+  check(std::abs(total_cost - best_cost) <= 1e-9 * (1.0 + best_cost),
+        info + ", cost: " + std::to_string(total_cost) + " (brute force: " + std::to_string(best_cost) + ")");
+}
+
+std::vector<tp::assignmentEdge> getEdges(const costMatrix& cost)
+{
+  std::vector<tp::assignmentEdge> edges;
+  for (int row = 0; row < cost.size(); row++)
+  {
+    for (int col = 0; col < cost[row].size(); col++)
+    {
+      if (cost[row][col] >= 0.0)
+      {
+        edges.push_back(tp::assignmentEdge{ row, col, cost[row][col] });
+      }
+    }
+  }
+  return edges;
+}
+
+void testHandMade()
+{
+  tp::GatedAssignment solver;  // reused between the instances, as in the tracker
+  std::vector<int> assignment;
+
+  // No edges: nothing is assigned
+  solver.solve(3, 2, {}, assignment);
+  check(assignment == std::vector<int>({ -1, -1, -1 }), "no edges");
+
+  // No columns
+  solver.solve(2, 0, {}, assignment);
+  check(assignment == std::vector<int>({ -1, -1 }), "no columns");
+
+  // Assigning both rows is preferred over the cheapest assignment of row 0
+  costMatrix cost = { { 1.0, 100.0 }, { 1.0, -1.0 } };
+  solver.solve(2, 2, getEdges(cost), assignment);
+  check(assignment == std::vector<int>({ 1, 0 }), "two rows assigned instead of the cheapest pair");
+  checkAssignment(cost, assignment, "two rows assigned instead of the cheapest pair");
+
+  // Two independent components: {row 0, row 2, col 1} and {row 1, col 0, col 2}
+  cost = { { -1.0, 2.0, -1.0 }, { 3.0, -1.0, 1.0 }, { -1.0, 1.0, -1.0 } };
+  solver.solve(3, 3, getEdges(cost), assignment);
+  check(assignment == std::vector<int>({ -1, 2, 1 }), "two components");
+  checkAssignment(cost, assignment, "two components");
+}
+
+void testRandom()
+{
+  std::mt19937 gen(7);
+  std::uniform_int_distribution<int> size_dist(1, 6);
+  std::uniform_real_distribution<double> cost_dist(0.0, 10.0);
+  std::uniform_real_distribution<double> unit_dist(0.0, 1.0);
+
+  tp::GatedAssignment solver;
+  std::vector<int> assignment;
+  for (int instance = 0; instance < 2000; instance++)
+  {
+    int num_rows = size_dist(gen);
+    int num_cols = size_dist(gen);
+    double prob_allowed = unit_dist(gen);  // from almost dense to almost empty
+
+    costMatrix cost(num_rows, std::vector<double>(num_cols, -1.0));
+    for (auto& row : cost)
+    {
+      for (auto& c : row)
+      {
+        if (unit_dist(gen) < prob_allowed)
+        {
+          // Some integer costs so that there are ties
+          c = (instance % 2 == 0) ? cost_dist(gen) : std::floor(cost_dist(gen) / 3.0);
+        }
+      }
+    }
+
+    solver.solve(num_rows, num_cols, getEdges(cost), assignment);
+    checkAssignment(cost, assignment, "random instance " + std::to_string(instance) + " (" +
+                                          std::to_string(num_rows) + "x" + std::to_string(num_cols) + ")");
+  }
+}
+
+int main()
+{
+  testHandMade();
+  testRandom();
+
+  if (num_failed > 0)
+  {
+    std::cout << red << num_failed << " checks failed" << reset << std::endl;
+    return 1;
+  }
+  std::cout << green << "All the checks passed" << reset << std::endl;
+  return 0;
+}
@@ -0,0 +1,255 @@
+/* ----------------------------------------------------------------------------
+ * Copyright 2021, Jesus Tordesillas Torres, Aerospace Controls Laboratory
+ * Massachusetts Institute of Technology
+ * All Rights Reserved
+ * Authors: Jesus Tordesillas, et al.
+ * See LICENSE file for the license information
+ * -------------------------------------------------------------------------- */
+
+// Compares GridClustering with a brute-force clustering (BFS over all the pairs of points): chains of points exactly at
+// distance tolerance, negative coordinates (the index of the cell is the floor), filtering by min_size/max_size, and
+// clouds big enough to use several threads. Returns 0 if all the checks pass
+
+#include "grid_clustering.hpp"
+#include "termcolor.hpp"
+
+#include <algorithm>
+#include <iostream>
+#include <queue>
+#include <random>
+#include <string>
+
+using namespace termcolor;
+
+int num_failed = 0;
+
+void check(bool condition, const std::string& info)
+{
+  if (condition == false)
+  {
+    std::cout << red << "FAILED: " << info << reset << std::endl;
+    num_failed++;
+  }
+}
+
+// Same distance check as GridClustering (squared distance in float, <= tolerance^2)
+bool areClose(const pcl::PointXYZ& a, const pcl::PointXYZ& b, float tolerance)
+{
+  float dx = a.x - b.x;
+  float dy = a.y - b.y;
+  float dz = a.z - b.z;
+  return dx * dx + dy * dy + dz * dz <= tolerance * tolerance;
+}
+
+std::vector<tp::clusterStats> bruteForce(const pcl::PointCloud<pcl::PointXYZ>& cloud, double tolerance, int min_size,
+                                         int max_size)
+{
+  const int num_points = cloud.points.size();
+  std::vector<bool> visited(num_points, false);
+  std::vector<tp::clusterStats> clusters;
+  for (int seed = 0; seed < num_points; seed++)
+  {
+    if (visited[seed])
+    {
+      continue;
+    }
+    std::vector<int> members;
+    std::queue<int> queue;
+    queue.push(seed);
+    visited[seed] = true;
+    while (!queue.empty())
+    {
+      int p = queue.front();
+      queue.pop();
+      members.push_back(p);
+      for (int q = 0; q < num_points; q++)
+      {
+        if (!visited[q] && areClose(cloud.points[p], cloud.points[q], tolerance))
+        {
+          visited[q] = true;
+          queue.push(q);
+        }
+      }
+    }
+
+    if (members.size() < min_size || members.size() > max_size)
+    {
+      continue;
+    }
+    std::sort(members.begin(), members.end());  // Same summation order as GridClustering
+    tp::clusterStats stats;
+    stats.num_points = members.size();
+    stats.centroid = Eigen::Vector3d::Zero();
+    stats.min = Eigen::Vector3d::Constant(std::numeric_limits<double>::infinity());
+    stats.max = -stats.min;
+    for (int p : members)
+    {
+      const Eigen::Vector3d point(cloud.points[p].x, cloud.points[p].y, cloud.points[p].z);
+      stats.centroid += point;
+      stats.min = stats.min.cwiseMin(point);
+      stats.max = stats.max.cwiseMax(point);
+    }
+    stats.centroid = stats.centroid / stats.num_points;
+    clusters.push_back(stats);
+  }
+  return clusters;
+}
+
+// Clusters of the same size can be returned in any order: sorted by size and then by the lower bound
+void sortClusters(std::vector<tp::clusterStats>& clusters)
+{
+  std::sort(clusters.begin(), clusters.end(), [](const tp::clusterStats& a, const tp::clusterStats& b) {
+    if (a.num_points != b.num_points)
+    {
+      return a.num_points > b.num_points;
+    }
+    return std::lexicographical_compare(a.min.data(), a.min.data() + 3, b.min.data(), b.min.data() + 3);
+  });
+}
+
+void checkClustering(tp::GridClustering& grid_clustering, const pcl::PointCloud<pcl::PointXYZ>& cloud,
+                     double tolerance, int min_size, int max_size, const std::string& info)
+{
+  std::vector<tp::clusterStats> clusters;
+  grid_clustering.cluster(cloud, tolerance, min_size, max_size, clusters);
+  std::vector<tp::clusterStats> expected = bruteForce(cloud, tolerance, min_size, max_size);
+
+  for (int i = 1; i < clusters.size(); i++)
+  {
+    check(clusters[i - 1].num_points >= clusters[i].num_points, info + ", clusters sorted by decreasing size");
+  }
+
+  check(clusters.size() == expected.size(), info + ", number of clusters: " + std::to_string(clusters.size()) +
+                                                " (brute force: " + std::to_string(expected.size()) + ")");
+  if (clusters.size() != expected.size())
+  {
+    return;
+  }
+
+  sortClusters(clusters);
+  sortClusters(expected);
+  for (int i = 0; i < clusters.size(); i++)
+  {
+    std::string info_cluster = info + ", cluster " + std::to_string(i);
+    check(clusters[i].num_points == expected[i].num_points,
+          info_cluster + ", size: " + std::to_string(clusters[i].num_points) +
+              " (brute force: " + std::to_string(expected[i].num_points) + ")");
+    check(clusters[i].min == expected[i].min && clusters[i].max == expected[i].max, info_cluster + ", bounds");
+    check((clusters[i].centroid - expected[i].centroid).norm() <= 1e-9 * (1.0 + expected[i].centroid.norm()),
+          info_cluster + ", centroid");
+  }
+}
+
+// Chains of points exactly at distance tolerance (exact in float), in all the octants
+void testExactDistance()
+{
+  tp::GridClustering grid_clustering(1);
+  const double tolerance = 0.5;
+
+  pcl::PointCloud<pcl::PointXYZ> cloud;
+  for (int i = 0; i < 8; i++)  // Along x, crossing x=0: one cluster
+  {
+    cloud.push_back(pcl::PointXYZ(-2.0 + 0.5 * i, -3.0, 1.0));
+  }
+  for (int i = 0; i < 5; i++)  // Along z, negative: one cluster
+  {
+    cloud.push_back(pcl::PointXYZ(4.0, 4.0, -0.25 - 0.5 * i));
+  }
+  for (int i = 0; i < 4; i++)  // Along y, with one step slightly bigger than tolerance: two clusters
+  {
+    cloud.push_back(pcl::PointXYZ(-7.0, -1.0 + 0.5 * i + (i >= 2 ? 0.001 : 0.0), -7.0));
+  }
+  cloud.push_back(pcl::PointXYZ(-10.0, -10.0, -10.0));  // Isolated point
+
+  checkClustering(grid_clustering, cloud, tolerance, 1, 100, "exact distance");
+
+  std::vector<tp::clusterStats> clusters;
+  grid_clustering.cluster(cloud, tolerance, 1, 100, clusters);
+  check(clusters.size() == 5, "exact distance, number of clusters");
+  if (clusters.size() == 5)
+  {
+    check(clusters[0].num_points == 8 && clusters[1].num_points == 5, "exact distance, sizes of the chains");
+  }
+
+  // Filtering: only the clusters with 2 <= size <= 5
+  checkClustering(grid_clustering, cloud, tolerance, 2, 5, "exact distance, min_size=2, max_size=5");
+  grid_clustering.cluster(cloud, tolerance, 2, 5, clusters);
+  check(clusters.size() == 3, "exact distance, number of clusters with 2 <= size <= 5");
+}
+
+// Random blobs (some of them with negative coordinates, some of them touching) plus noise
+pcl::PointCloud<pcl::PointXYZ> createRandomCloud(std::mt19937& gen, int num_blobs, int num_points_blob,
+                                                 int num_points_noise)
+{
+  std::uniform_real_distribution<float> center_dist(-10.0, 10.0);
+  std::uniform_real_distribution<float> size_dist(0.1, 1.5);
+  std::uniform_real_distribution<float> unit_dist(-1.0, 1.0);
+  std::uniform_int_distribution<int> num_points_dist(1, num_points_blob);
+
+  pcl::PointCloud<pcl::PointXYZ> cloud;
+  for (int b = 0; b < num_blobs; b++)
+  {
+    float cx = center_dist(gen), cy = center_dist(gen), cz = center_dist(gen);
+    float size = size_dist(gen);
+    int num_points = num_points_dist(gen);
+    for (int i = 0; i < num_points; i++)
+    {
+      cloud.push_back(
+          pcl::PointXYZ(cx + size * unit_dist(gen), cy + size * unit_dist(gen), cz + size * unit_dist(gen)));
+    }
+  }
+  for (int i = 0; i < num_points_noise; i++)
+  {
+    cloud.push_back(pcl::PointXYZ(center_dist(gen), center_dist(gen), center_dist(gen)));
+  }
+  return cloud;
+}
+
+void testRandom()
+{
+  std::mt19937 gen(3);
+  tp::GridClustering grid_clustering(4);  // Reused between the calls, as in the tracker
+
+  for (int instance = 0; instance < 20; instance++)
+  {
+    pcl::PointCloud<pcl::PointXYZ> cloud = createRandomCloud(gen, 15, 60, 100);
+    double tolerance = (instance % 2 == 0) ? 0.2 : 0.35;
+    std::string info = "random cloud " + std::to_string(instance);
+    checkClustering(grid_clustering, cloud, tolerance, 1, 100000, info);
+    checkClustering(grid_clustering, cloud, tolerance, 5, 40, info + ", min_size=5, max_size=40");
+  }
+
+  // More than MIN_POINTS_PER_THREAD (2000) points per thread, so that the cells are split among several threads
+  for (int instance = 0; instance < 3; instance++)
+  {
+    pcl::PointCloud<pcl::PointXYZ> cloud = createRandomCloud(gen, 40, 200, 1000);
+    while (cloud.points.size() < 6000)
+    {
+      pcl::PointCloud<pcl::PointXYZ> more = createRandomCloud(gen, 10, 200, 0);
+      cloud.points.insert(cloud.points.end(), more.points.begin(), more.points.end());
+    }
+    std::string info = "multi-threaded, cloud " + std::to_string(instance) + " (" +
+                       std::to_string(cloud.points.size()) + " points)";
+    checkClustering(grid_clustering, cloud, 0.25, 1, 100000, info);
+    checkClustering(grid_clustering, cloud, 0.25, 10, 300, info + ", min_size=10, max_size=300");
+  }
+
+  // Empty cloud
+  std::vector<tp::clusterStats> clusters;
+  grid_clustering.cluster(pcl::PointCloud<pcl::PointXYZ>(), 0.2, 1, 100, clusters);
+  check(clusters.empty(), "empty cloud");
+}
+
+int main()
+{
+  testExactDistance();
+  testRandom();
+
+  if (num_failed > 0)
+  {
+    std::cout << red << num_failed << " checks failed" << reset << std::endl;
+    return 1;
+  }
+  std::cout << green << "All the checks passed" << reset << std::endl;
+  return 0;
+}
@@ -26,7 +26,7 @@ int main(int argc, char** argv)
   c.bbox = Eigen::Vector3d(1.0, 1.0, 1.0);
   c.time = ros::Time::now().toSec();
 
-  tp::track my_track(c, 10, 15);
+  tp::track my_track(c, 10, 15, 0);
 
   tracker_predictor.generatePredictedPwpForTrack(my_track);
 
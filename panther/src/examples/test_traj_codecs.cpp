@@ -0,0 +1,265 @@
+/* ----------------------------------------------------------------------------
+ * Copyright 2021, Jesus Tordesillas Torres, Aerospace Controls Laboratory
+ * Massachusetts Institute of Technology
+ * All Rights Reserved
+ * Authors: Jesus Tordesillas, et al.
+ * See LICENSE file for the license information
+ * -------------------------------------------------------------------------- */
+
+// Round trips of the binary encodings of the trajectories: TrajBatchEncoder --> TrajBatchDecoder and
+// CompactTrajEncoder --> CompactTrajDecoder (padding of the degree, truncated buffers, runs of the deltas and deltas
+// whose base has not been received). Returns 0 if all the checks pass
+
+#include "traj_batch.hpp"
+#include "compact_traj.hpp"
+#include "termcolor.hpp"
+
+using namespace termcolor;
+
+int num_failed = 0;
+
+void check(bool condition, const std::string& info)
+{
+  if (condition == false)
+  {
+    std::cout << red << "FAILED: " << info << reset << std::endl;
+    num_failed++;
+  }
+}
+
+// The coefficients and the times (relative to the first one) are sent as floats
+bool isClose(const Eigen::Vector3d& a, const Eigen::Vector3d& b)
+{
+  return (a - b).norm() <= 1e-4 * (1.0 + b.norm());
+}
+
+// Polynomial with one interval per element of durations, all of them of degree deg (deterministic coefficients)
+mt::PieceWisePol createPwp(double t0, const std::vector<double>& durations, int deg, double seed)
+{
+  mt::PieceWisePol pwp;
+  pwp.times.push_back(t0);
+  for (int j = 0; j < durations.size(); j++)
+  {
+    pwp.times.push_back(pwp.times.back() + durations[j]);
+    Eigen::VectorXd cx(deg + 1), cy(deg + 1), cz(deg + 1);
+    for (int i = 0; i <= deg; i++)
+    {
+      cx(i) = 3.0 * sin(seed + 1.1 * j + 0.7 * i);
+      cy(i) = 2.0 * cos(seed + 0.3 * j - 1.3 * i);
+      cz(i) = 0.5 * sin(seed + 2.1 * j + 0.2 * i) + 1.0;
+    }
+    pwp.all_coeff_x.push_back(cx);
+    pwp.all_coeff_y.push_back(cy);
+    pwp.all_coeff_z.push_back(cz);
+  }
+  return pwp;
+}
+
+// Times inside the intervals (and outside the polynomial), away from the ends of the intervals (the evaluation is
+// discontinuous there)
+std::vector<double> getSampleTimes(const mt::PieceWisePol& pwp)
+{
+  std::vector<double> times = { pwp.times.front() - 1.0, pwp.times.back() + 1.0 };
+  for (int j = 0; j < pwp.getNumOfIntervals(); j++)
+  {
+    for (double u : { 0.1, 0.5, 0.9 })
+    {
+      times.push_back(pwp.times[j] + u * (pwp.times[j + 1] - pwp.times[j]));
+    }
+  }
+  return times;
+}
+
+template <typename T>
+void checkSamePwp(const T& decoded, const mt::PieceWisePol& original, const std::string& info)
+{
+  for (double t : getSampleTimes(original))
+  {
+    check(isClose(decoded.eval(t), original.eval(t)), info + " at t=" + std::to_string(t));
+  }
+}
+
+void checkSameInfo(const mt::compactTrajInfo& decoded, const mt::compactTrajInfo& original, const std::string& info)
+{
+  check(decoded.id == original.id && decoded.is_agent == original.is_agent && isClose(decoded.bbox, original.bbox) &&
+            isClose(decoded.pos, original.pos),
+        info + ": id, is_agent, bbox or pos");
+}
+
+mt::compactTrajInfo createInfo(int id, bool is_agent)
+{
+  mt::compactTrajInfo info;
+  info.id = id;
+  info.is_agent = is_agent;
+  info.bbox = Eigen::Vector3d(0.5, 0.6, 0.7 + id);
+  info.pos = Eigen::Vector3d(1.0, -2.0, 3.0 * id);
+  return info;
+}
+
+void testTrajBatch()
+{
+  std::cout << "Testing TrajBatchEncoder --> TrajBatchDecoder" << std::endl;
+
+  // The first trajectory has degree 1 (padded to the degree 3 of the batch), and the variance of the second one has
+  // degree 2 (padded to 4)
+  mt::PieceWisePol mean0 = createPwp(1000.0, { 0.5, 1.5, 1.0 }, 1, 0.0);
+  mt::PieceWisePol var0 = createPwp(1000.0, { 0.5, 1.5, 1.0 }, 4, 1.0);
+  mt::PieceWisePol mean1 = createPwp(1234.5, { 2.0 }, 3, 2.0);
+  mt::PieceWisePol var1 = createPwp(1234.5, { 2.0 }, 2, 3.0);
+  mt::compactTrajInfo info0 = createInfo(1001, false);
+  mt::compactTrajInfo info1 = createInfo(3, true);
+
+  TrajBatchEncoder encoder;
+  encoder.start(3, 4);
+  check(encoder.add(mean0, var0, info0), "add() of a trajectory with degree 1");
+  check(encoder.add(mean1, var1, info1), "add() of a trajectory with degree 3");
+  check(!encoder.add(createPwp(0.0, { 1.0 }, 4, 0.0), var1, info1), "add() of a mean with degree 4 > 3");
+  check(!encoder.add(mean0, var1, info0), "add() of a mean and a variance with different times");
+  check(encoder.getNumTrajs() == 2, "getNumTrajs()");
+
+  std::vector<uint8_t> buffer = encoder.getBuffer();
+  std::vector<mt::compactTrajInfo> infos;
+  std::vector<mt::dynTraj> trajs;
+  check(TrajBatchDecoder::decode(buffer.data(), buffer.size(), infos, trajs), "decode()");
+  check(infos.size() == 2 && trajs.size() == 2, "number of decoded trajectories");
+  if (trajs.size() == 2 && infos.size() == 2)
+  {
+    checkSameInfo(infos[0], info0, "batch, trajectory 0");
+    checkSameInfo(infos[1], info1, "batch, trajectory 1");
+    check(trajs[0].pwp_mean.all_coeff_x[0].size() == 4, "batch, the mean of degree 1 is padded to degree 3");
+    check(trajs[1].pwp_var.all_coeff_x[0].size() == 5, "batch, the variance of degree 2 is padded to degree 4");
+    checkSamePwp(trajs[0].pwp_mean, mean0, "batch, mean 0");
+    checkSamePwp(trajs[0].pwp_var, var0, "batch, var 0");
+    checkSamePwp(trajs[1].pwp_mean, mean1, "batch, mean 1");
+    checkSamePwp(trajs[1].pwp_var, var1, "batch, var 1");
+  }
+
+  // Truncated buffers
+  for (size_t size = 0; size < buffer.size(); size++)
+  {
+    check(!TrajBatchDecoder::decode(buffer.data(), size, infos, trajs),
+          "batch, decode() of a buffer truncated to " + std::to_string(size) + " bytes");
+  }
+
+  // Empty batch
+  encoder.start(3, 4);
+  check(TrajBatchDecoder::decode(encoder.getBuffer().data(), encoder.getBuffer().size(), infos, trajs) &&
+            trajs.empty(),
+        "batch, decode() of an empty batch");
+}
+
+void testCompactTraj()
+{
+  std::cout << "Testing CompactTrajEncoder --> CompactTrajDecoder" << std::endl;
+
+  // Sequence of broadcasts as the ones of PantherRos::publishOwnTraj(): in each one, the first interval of the
+  // previous one is removed and a new one is appended. The mean has degree 2 (padded to 3)
+  std::vector<mt::PieceWisePol> means;
+  means.push_back(createPwp(500.0, { 0.3, 0.4, 0.5, 0.6 }, 2, 0.0));
+  for (int i = 1; i < 5; i++)
+  {
+    mt::PieceWisePol pwp = means.back();
+    mt::PieceWisePol pwp_new = createPwp(pwp.times.back(), { 0.2 + 0.1 * i }, 2, 10.0 * i);
+    pwp.times.erase(pwp.times.begin());
+    pwp.all_coeff_x.erase(pwp.all_coeff_x.begin());
+    pwp.all_coeff_y.erase(pwp.all_coeff_y.begin());
+    pwp.all_coeff_z.erase(pwp.all_coeff_z.begin());
+    pwp.times.push_back(pwp_new.times.back());
+    pwp.all_coeff_x.push_back(pwp_new.all_coeff_x[0]);
+    pwp.all_coeff_y.push_back(pwp_new.all_coeff_y[0]);
+    pwp.all_coeff_z.push_back(pwp_new.all_coeff_z[0]);
+    means.push_back(pwp);
+  }
+
+  mt::PieceWisePol var_zero = createPwp(0.0, { 1.0 }, 0, 0.0);
+  var_zero.all_coeff_x[0].setZero();
+  var_zero.all_coeff_y[0].setZero();
+  var_zero.all_coeff_z[0].setZero();
+  mt::compactTrajInfo info = createInfo(7, true);
+
+  // keyframe_period=3 --> keyframe, delta, delta, keyframe, delta
+  CompactTrajEncoder encoder(3);
+  CompactTrajEncoder encoder_deque(3);
+  std::vector<std::vector<uint8_t>> buffers(means.size());
+  for (int i = 0; i < means.size(); i++)
+  {
+    check(encoder.encode(means[i], var_zero, info, buffers[i]), "encode() of broadcast " + std::to_string(i));
+
+    // Same buffer when encoding the PieceWisePolDeque
+    mt::PieceWisePolDeque mean_deque;
+    mean_deque.fromPieceWisePol(means[i]);
+    std::vector<uint8_t> buffer_deque;
+    check(encoder_deque.encode(mean_deque, var_zero, info, buffer_deque) && buffer_deque == buffers[i],
+          "encode() of the PieceWisePolDeque of broadcast " + std::to_string(i));
+  }
+
+  // The deltas only have one NEW interval (the rest are COPY runs), so they are smaller than the keyframes
+  check(buffers[1].size() < buffers[0].size() && buffers[2].size() < buffers[0].size(),
+        "the deltas are smaller than the keyframe");
+  check(buffers[3].size() == buffers[0].size(), "broadcast 3 is a keyframe");
+  check(buffers[4].size() == buffers[1].size(), "broadcast 4 is a delta");
+
+  // Truncated buffers (before decoding the full ones, so that the decoder has the base of the deltas)
+  CompactTrajDecoder decoder;
+  mt::dynTrajCompiled traj;
+  for (int i = 0; i < means.size(); i++)
+  {
+    for (size_t size = 0; size < buffers[i].size(); size++)
+    {
+      check(!decoder.decode(buffers[i].data(), size, traj),
+            "decode() of broadcast " + std::to_string(i) + " truncated to " + std::to_string(size) + " bytes");
+    }
+
+    std::string name = "broadcast " + std::to_string(i);
+    check(decoder.decode(buffers[i].data(), buffers[i].size(), traj), "decode() of " + name);
+    checkSamePwp(traj.pwp_mean_fixed, means[i], name + ", mean (fixed)");
+    checkSamePwp(traj.pwp_mean, means[i], name + ", mean");
+    checkSamePwp(traj.pwp_var_fixed, var_zero, name + ", var (fixed)");
+    check(traj.id == info.id && traj.is_agent == info.is_agent && isClose(traj.bbox, info.bbox),
+          name + ": id, is_agent or bbox");
+
+    mt::compactTrajInfo info_decoded;
+    check(CompactTrajDecoder::decodeInfo(buffers[i].data(), buffers[i].size(), info_decoded),
+          "decodeInfo() of " + name);
+    checkSameInfo(info_decoded, info, name);
+  }
+
+  // A receiver that misses broadcast 1 cannot decode the delta 2 (its base), but it recovers with the keyframe 3
+  CompactTrajDecoder decoder_lossy;
+  check(decoder_lossy.decode(buffers[0].data(), buffers[0].size(), traj), "lossy, decode() of the keyframe 0");
+  check(!decoder_lossy.decode(buffers[2].data(), buffers[2].size(), traj), "lossy, decode() of the delta 2");
+  check(decoder_lossy.decode(buffers[3].data(), buffers[3].size(), traj), "lossy, decode() of the keyframe 3");
+  checkSamePwp(traj.pwp_mean_fixed, means[3], "lossy, mean of the keyframe 3");
+  check(decoder_lossy.decode(buffers[4].data(), buffers[4].size(), traj), "lossy, decode() of the delta 4");
+  checkSamePwp(traj.pwp_mean_fixed, means[4], "lossy, mean of the delta 4");
+
+  // A receiver that starts later cannot decode the deltas until it gets a keyframe
+  CompactTrajDecoder decoder_late;
+  check(!decoder_late.decode(buffers[1].data(), buffers[1].size(), traj), "late, decode() of the delta 1");
+  check(decoder_late.decode(buffers[3].data(), buffers[3].size(), traj), "late, decode() of the keyframe 3");
+
+  // Non-zero variance (degree 3), and a mean of degree 4 (cannot be encoded)
+  mt::PieceWisePol var = createPwp(500.0, { 0.5, 0.5 }, 3, 5.0);
+  std::vector<uint8_t> buffer;
+  CompactTrajEncoder encoder_var(3);
+  CompactTrajDecoder decoder_var;
+  check(encoder_var.encode(means[0], var, info, buffer), "encode() with variance");
+  check(decoder_var.decode(buffer.data(), buffer.size(), traj), "decode() with variance");
+  checkSamePwp(traj.pwp_var_fixed, var, "variance");
+  checkSamePwp(traj.pwp_var, var, "variance");
+  check(!encoder_var.encode(createPwp(0.0, { 1.0 }, 4, 0.0), var, info, buffer), "encode() of a mean with degree 4");
+}
+
+int main()
+{
+  testTrajBatch();
+  testCompactTraj();
+
+  if (num_failed > 0)
+  {
+    std::cout << red << num_failed << " checks failed" << reset << std::endl;
+    return 1;
+  }
+  std::cout << green << "All the checks passed" << reset << std::endl;
+  return 0;
+}
@@ -0,0 +1,819 @@
+/* ----------------------------------------------------------------------------
+ * Copyright 2021, Jesus Tordesillas Torres, Aerospace Controls Laboratory
+ * Massachusetts Institute of Technology
+ * All Rights Reserved
+ * Authors: Jesus Tordesillas, et al.
+ * See LICENSE file for the license information
+ * -------------------------------------------------------------------------- */
+
+#include "expression_tree.hpp"
+
+#include <math.h>
+#include <cctype>
+#include <cstdio>
+#include <cstdlib>
+#include <algorithm>
+
+typedef mt::exprNode Node;
+typedef mt::exprNodePtr NodePtr;
+
+namespace
+{
+NodePtr makeNode(Node::Type type, std::vector<NodePtr> children, const std::string& name = "")
+{
+  std::shared_ptr<Node> node = std::make_shared<Node>();
+  node->type = type;
+  node->name = name;
+  node->children = children;
+  return node;
+}
+
+NodePtr makeConstant(double value)
+{
+  std::shared_ptr<Node> node = std::make_shared<Node>();
+  node->type = Node::CONSTANT;
+  node->value = value;
+  return node;
+}
+
+bool isConstant(const NodePtr& a, double value)
+{
+  return (a->type == Node::CONSTANT && a->value == value);
+}
+
+//////////////////// Constructors with some simplifications (to keep the derivatives short)
+
+NodePtr makeAdd(const NodePtr& a, const NodePtr& b)
+{
+  if (isConstant(a, 0.0))
+  {
+    return b;
+  }
+  if (isConstant(b, 0.0))
+  {
+    return a;
+  }
+  if (a->type == Node::CONSTANT && b->type == Node::CONSTANT)
+  {
+    return makeConstant(a->value + b->value);
+  }
+  return makeNode(Node::ADD, { a, b });
+}
+
+NodePtr makeNeg(const NodePtr& a)
+{
+  if (a->type == Node::CONSTANT)
+  {
+    return makeConstant(-a->value);
+  }
+  return makeNode(Node::NEG, { a });
+}
+
+NodePtr makeSub(const NodePtr& a, const NodePtr& b)
+{
+  if (isConstant(b, 0.0))
+  {
+    return a;
+  }
+  if (isConstant(a, 0.0))
+  {
+    return makeNeg(b);
+  }
+  if (a->type == Node::CONSTANT && b->type == Node::CONSTANT)
+  {
+    return makeConstant(a->value - b->value);
+  }
+  return makeNode(Node::SUB, { a, b });
+}
+
+NodePtr makeMul(const NodePtr& a, const NodePtr& b)
+{
+  if (isConstant(a, 0.0) || isConstant(b, 0.0))
+  {
+    return makeConstant(0.0);
+  }
+  if (isConstant(a, 1.0))
+  {
+    return b;
+  }
+  if (isConstant(b, 1.0))
+  {
+    return a;
+  }
+  if (a->type == Node::CONSTANT && b->type == Node::CONSTANT)
+  {
+    return makeConstant(a->value * b->value);
+  }
+  return makeNode(Node::MUL, { a, b });
+}
+
+NodePtr makeDiv(const NodePtr& a, const NodePtr& b)
+{
+  if (isConstant(a, 0.0))
+  {
+    return makeConstant(0.0);
+  }
+  if (isConstant(b, 1.0))
+  {
+    return a;
+  }
+  return makeNode(Node::DIV, { a, b });
+}
+
+NodePtr makePow(const NodePtr& a, const NodePtr& b)
+{
+  if (isConstant(b, 1.0))
+  {
+    return a;
+  }
+  if (isConstant(b, 0.0))
+  {
+    return makeConstant(1.0);
+  }
+  return makeNode(Node::POW, { a, b });
+}
+
+NodePtr makeFunction(const std::string& name, std::vector<NodePtr> args)
+{
+  return makeNode(Node::FUNCTION, args, name);
+}
+
+//////////////////// Parser (recursive descent)
+
+class Parser
+{
+public:
+  Parser(const std::string& s) : s_(s)
+  {
+  }
+
+  NodePtr parse()
+  {
+    NodePtr result = parseOr();
+    skipSpaces();
+    if (result == nullptr || pos_ != s_.size())
+    {
+      return nullptr;
+    }
+    return result;
+  }
+
+private:
+  void skipSpaces()
+  {
+    while (pos_ < s_.size() && isspace(s_[pos_]))
+    {
+      pos_++;
+    }
+  }
+
+  // Consumes token if it's the next one. Words (and, or) must not be followed by an identifier character
+  bool accept(const std::string& token)
+  {
+    skipSpaces();
+    if (s_.compare(pos_, token.size(), token) != 0)
+    {
+      return false;
+    }
+    size_t next = pos_ + token.size();
+    if (isalpha(token[0]) && next < s_.size() && (isalnum(s_[next]) || s_[next] == '_'))
+    {
+      return false;
+    }
+    pos_ = next;
+    return true;
+  }
+
+  NodePtr parseOr()
+  {
+    NodePtr left = parseAnd();
+    while (left != nullptr && (accept("or") || accept("||") || accept("|")))
+    {
+      NodePtr right = parseAnd();
+      if (right == nullptr)
+      {
+        return nullptr;
+      }
+      left = makeNode(Node::OR, { left, right });
+    }
+    return left;
+  }
+
+  NodePtr parseAnd()
+  {
+    NodePtr left = parseComparison();
+    while (left != nullptr && (accept("and") || accept("&&") || accept("&")))
+    {
+      NodePtr right = parseComparison();
+      if (right == nullptr)
+      {
+        return nullptr;
+      }
+      left = makeNode(Node::AND, { left, right });
+    }
+    return left;
+  }
+
+  NodePtr parseComparison()
+  {
+    NodePtr left = parseAdd();
+    if (left == nullptr)
+    {
+      return nullptr;
+    }
+    // Longer operators first
+    for (std::string op : { "<=", ">=", "==", "!=", "<>", "<", ">", "=" })
+    {
+      if (accept(op))
+      {
+        NodePtr right = parseAdd();
+        if (right == nullptr)
+        {
+          return nullptr;
+        }
+        if (op == "<>")
+        {
+          op = "!=";
+        }
+        else if (op == "=")
+        {
+          op = "==";
+        }
+        return makeNode(Node::COMPARISON, { left, right }, op);
+      }
+    }
+    return left;
+  }
+
+  NodePtr parseAdd()
+  {
+    NodePtr left = parseMul();
+    while (left != nullptr)
+    {
+      if (accept("+"))
+      {
+        NodePtr right = parseMul();
+        left = (right == nullptr) ? nullptr : makeNode(Node::ADD, { left, right });
+      }
+      else if (accept("-"))
+      {
+        NodePtr right = parseMul();
+        left = (right == nullptr) ? nullptr : makeNode(Node::SUB, { left, right });
+      }
+      else
+      {
+        break;
+      }
+    }
+    return left;
+  }
+
+  NodePtr parseMul()
+  {
+    NodePtr left = parseUnary();
+    while (left != nullptr)
+    {
+      if (accept("*"))
+      {
+        NodePtr right = parseUnary();
+        left = (right == nullptr) ? nullptr : makeNode(Node::MUL, { left, right });
+      }
+      else if (accept("/"))
+      {
+        NodePtr right = parseUnary();
+        left = (right == nullptr) ? nullptr : makeNode(Node::DIV, { left, right });
+      }
+      else
+      {
+        break;
+      }
+    }
+    return left;
+  }
+
+  NodePtr parseUnary()
+  {
+    if (accept("-"))
+    {
+      NodePtr a = parseUnary();
+      return (a == nullptr) ? nullptr : makeNode(Node::NEG, { a });
+    }
+    if (accept("+"))
+    {
+      return parseUnary();
+    }
+    return parsePow();
+  }
+
+  NodePtr parsePow()
+  {
+    NodePtr base = parsePrimary();
+    if (base != nullptr && accept("^"))
+    {
+      NodePtr exponent = parseUnary();
+      return (exponent == nullptr) ? nullptr : makeNode(Node::POW, { base, exponent });
+    }
+    return base;
+  }
+
+  NodePtr parsePrimary()
+  {
+    skipSpaces();
+    if (pos_ >= s_.size())
+    {
+      return nullptr;
+    }
+
+    if (accept("("))
+    {
+      NodePtr inside = parseOr();
+      if (inside == nullptr || !accept(")"))
+      {
+        return nullptr;
+      }
+      return inside;
+    }
+
+    char c = s_[pos_];
+    if (isdigit(c) || c == '.')
+    {
+      const char* begin = s_.c_str() + pos_;
+      char* end;
+      double value = strtod(begin, &end);
+      if (end == begin)
+      {
+        return nullptr;
+      }
+      pos_ += (end - begin);
+      return makeConstant(value);
+    }
+
+    if (isalpha(c) || c == '_')
+    {
+      size_t start = pos_;
+      while (pos_ < s_.size() && (isalnum(s_[pos_]) || s_[pos_] == '_'))
+      {
+        pos_++;
+      }
+      std::string name = s_.substr(start, pos_ - start);
+
+      if (accept("("))
+      {
+        std::vector<NodePtr> args;
+        do
+        {
+          NodePtr arg = parseOr();
+          if (arg == nullptr)
+          {
+            return nullptr;
+          }
+          args.push_back(arg);
+        } while (accept(","));
+
+        if (!accept(")"))
+        {
+          return nullptr;
+        }
+
+        bool unary = (name == "sin" || name == "cos" || name == "tan" || name == "exp" || name == "log" ||
+                      name == "sqrt" || name == "abs" || name == "sgn");
+        bool binary = (name == "min" || name == "max");
+        if ((unary && args.size() == 1) || (binary && args.size() == 2))
+        {
+          return makeFunction(name, args);
+        }
+        return nullptr;
+      }
+
+      if (name == "t")
+      {
+        return makeNode(Node::VARIABLE, {}, name);
+      }
+      if (name == "pi")
+      {
+        return makeConstant(M_PI);
+      }
+      return nullptr;
+    }
+
+    return nullptr;
+  }
+
+  const std::string& s_;
+  size_t pos_ = 0;
+};
+}  // namespace
+
+bool parseExpression(const std::string& s, mt::exprNodePtr& root)
+{
+  Parser parser(s);
+  root = parser.parse();
+  return (root != nullptr);
+}
+
+mt::exprNodePtr differentiateExpression(const mt::exprNodePtr& node)
+{
+  const std::vector<NodePtr>& ch = node->children;
+
+  std::vector<NodePtr> d;  // derivatives of the children
+  if (node->type != Node::COMPARISON && node->type != Node::AND && node->type != Node::OR)
+  {
+    for (auto& child : ch)
+    {
+      NodePtr d_child = differentiateExpression(child);
+      if (d_child == nullptr)
+      {
+        return nullptr;
+      }
+      d.push_back(d_child);
+    }
+  }
+
+  switch (node->type)
+  {
+    case Node::CONSTANT:
+    case Node::COMPARISON:
+    case Node::AND:
+    case Node::OR:
+      return makeConstant(0.0);
+    case Node::VARIABLE:
+      return makeConstant(1.0);
+    case Node::ADD:
+      return makeAdd(d[0], d[1]);
+    case Node::SUB:
+      return makeSub(d[0], d[1]);
+    case Node::NEG:
+      return makeNeg(d[0]);
+    case Node::MUL:
+      return makeAdd(makeMul(d[0], ch[1]), makeMul(ch[0], d[1]));
+    case Node::DIV:
+      return makeDiv(makeSub(makeMul(d[0], ch[1]), makeMul(ch[0], d[1])), makePow(ch[1], makeConstant(2.0)));
+    case Node::POW:
+      if (ch[1]->type == Node::CONSTANT)
+      {  // n*a^(n-1)*a'
+        return makeMul(makeMul(ch[1], makePow(ch[0], makeConstant(ch[1]->value - 1.0))), d[0]);
+      }
+      // a^b*(b'*log(a)+b*a'/a)
+      return makeMul(node, makeAdd(makeMul(d[1], makeFunction("log", { ch[0] })),
+                                   makeDiv(makeMul(ch[1], d[0]), ch[0])));
+    case Node::FUNCTION:
+      if (node->name == "sin")
+      {
+        return makeMul(makeFunction("cos", ch), d[0]);
+      }
+      if (node->name == "cos")
+      {
+        return makeMul(makeNeg(makeFunction("sin", ch)), d[0]);
+      }
+      if (node->name == "tan")
+      {
+        return makeDiv(d[0], makePow(makeFunction("cos", ch), makeConstant(2.0)));
+      }
+      if (node->name == "exp")
+      {
+        return makeMul(node, d[0]);
+      }
+      if (node->name == "log")
+      {
+        return makeDiv(d[0], ch[0]);
+      }
+      if (node->name == "sqrt")
+      {
+        return makeDiv(d[0], makeMul(makeConstant(2.0), node));
+      }
+      if (node->name == "abs")
+      {
+        return makeMul(makeFunction("sgn", ch), d[0]);
+      }
+      if (node->name == "sgn")
+      {
+        return makeConstant(0.0);
+      }
+      if (node->name == "min" || node->name == "max")
+      {
+        // the derivative of the argument that is active (the first one in case of a tie)
+        NodePtr first_is_active = makeNode(Node::COMPARISON, ch, (node->name == "min") ? "<=" : ">=");
+        NodePtr second_is_active = makeNode(Node::COMPARISON, ch, (node->name == "min") ? ">" : "<");
+        return makeAdd(makeMul(first_is_active, d[0]), makeMul(second_is_active, d[1]));
+      }
+      return nullptr;
+  }
+  return nullptr;
+}
+
+std::string expressionToString(const mt::exprNodePtr& node)
+{
+  const std::vector<NodePtr>& ch = node->children;
+  switch (node->type)
+  {
+    case Node::CONSTANT:
+    {
+      char buffer[32];
+      snprintf(buffer, sizeof(buffer), "%.17g", node->value);
+      return (node->value < 0) ? ("(" + std::string(buffer) + ")") : std::string(buffer);
+    }
+    case Node::VARIABLE:
+      return "t";
+    case Node::ADD:
+      return "(" + expressionToString(ch[0]) + "+" + expressionToString(ch[1]) + ")";
+    case Node::SUB:
+      return "(" + expressionToString(ch[0]) + "-" + expressionToString(ch[1]) + ")";
+    case Node::MUL:
+      return "(" + expressionToString(ch[0]) + "*" + expressionToString(ch[1]) + ")";
+    case Node::DIV:
+      return "(" + expressionToString(ch[0]) + "/" + expressionToString(ch[1]) + ")";
+    case Node::POW:
+      return "(" + expressionToString(ch[0]) + "^" + expressionToString(ch[1]) + ")";
+    case Node::NEG:
+      return "(-" + expressionToString(ch[0]) + ")";
+    case Node::COMPARISON:
+      return "(" + expressionToString(ch[0]) + node->name + expressionToString(ch[1]) + ")";
+    case Node::AND:
+      return "(" + expressionToString(ch[0]) + " and " + expressionToString(ch[1]) + ")";
+    case Node::OR:
+      return "(" + expressionToString(ch[0]) + " or " + expressionToString(ch[1]) + ")";
+    case Node::FUNCTION:
+    {
+      std::string result = node->name + "(";
+      for (int i = 0; i < ch.size(); i++)
+      {
+        result += ((i > 0) ? "," : "") + expressionToString(ch[i]);
+      }
+      return result + ")";
+    }
+  }
+  return "";
+}
+
+//////////////////// Lowering to mt::nativeExpression
+
+namespace
+{
+const int MAX_DEG_NATIVE = 6;
+
+// poly(s) + sum_k amplitude[k]*sin(frequency[k]*s+phase[k]), where s=t-t_shift
+struct LinearComb
+{
+  std::vector<double> poly;  // coefficients, lowest power first
+  std::vector<double> amplitude;
+  std::vector<double> frequency;
+  std::vector<double> phase;
+
+  bool isConstant() const
+  {
+    return (poly.size() <= 1 && amplitude.empty());
+  }
+
+  double constant() const
+  {
+    return poly.empty() ? 0.0 : poly[0];
+  }
+
+  void scale(double c)
+  {
+    for (auto& p : poly)
+    {
+      p *= c;
+    }
+    for (auto& a : amplitude)
+    {
+      a *= c;
+    }
+  }
+
+  void add(const LinearComb& other, double sign)
+  {
+    poly.resize(std::max(poly.size(), other.poly.size()), 0.0);
+    for (int i = 0; i < other.poly.size(); i++)
+    {
+      poly[i] += sign * other.poly[i];
+    }
+    for (int k = 0; k < other.amplitude.size(); k++)
+    {
+      amplitude.push_back(sign * other.amplitude[k]);
+      frequency.push_back(other.frequency[k]);
+      phase.push_back(other.phase[k]);
+    }
+  }
+};
+
+LinearComb makeLinearCombConstant(double value)
+{
+  LinearComb result;
+  result.poly = { value };
+  return result;
+}
+
+bool evalConstantFunction(const std::string& name, const std::vector<double>& args, double& value)
+{
+  double a = args[0];
+  if (name == "sin")
+  {
+    value = sin(a);
+  }
+  else if (name == "cos")
+  {
+    value = cos(a);
+  }
+  else if (name == "tan")
+  {
+    value = tan(a);
+  }
+  else if (name == "exp")
+  {
+    value = exp(a);
+  }
+  else if (name == "log")
+  {
+    value = log(a);
+  }
+  else if (name == "sqrt")
+  {
+    value = sqrt(a);
+  }
+  else if (name == "abs")
+  {
+    value = fabs(a);
+  }
+  else if (name == "sgn")
+  {
+    value = (a > 0) - (a < 0);
+  }
+  else if (name == "min")
+  {
+    value = std::min(a, args[1]);
+  }
+  else if (name == "max")
+  {
+    value = std::max(a, args[1]);
+  }
+  else
+  {
+    return false;
+  }
+  return true;
+}
+
+bool lower(const NodePtr& node, double t_shift, LinearComb& result)
+{
+  std::vector<LinearComb> ch(node->children.size());
+  for (int i = 0; i < ch.size(); i++)
+  {
+    if (!lower(node->children[i], t_shift, ch[i]))
+    {
+      return false;
+    }
+  }
+
+  switch (node->type)
+  {
+    case Node::CONSTANT:
+      result = makeLinearCombConstant(node->value);
+      return true;
+    case Node::VARIABLE:
+      result.poly = { t_shift, 1.0 };  // t=s+t_shift
+      return true;
+    case Node::ADD:
+    case Node::SUB:
+      result = ch[0];
+      result.add(ch[1], (node->type == Node::ADD) ? 1.0 : -1.0);
+      return true;
+    case Node::NEG:
+      result = ch[0];
+      result.scale(-1.0);
+      return true;
+    case Node::MUL:
+      if (ch[0].isConstant() || ch[1].isConstant())
+      {
+        int i_const = ch[0].isConstant() ? 0 : 1;
+        result = ch[1 - i_const];
+        result.scale(ch[i_const].constant());
+        return true;
+      }
+      if (ch[0].amplitude.empty() && ch[1].amplitude.empty() &&
+          (ch[0].poly.size() + ch[1].poly.size() - 2) <= MAX_DEG_NATIVE)
+      {  // product of polynomials
+        result.poly.assign(ch[0].poly.size() + ch[1].poly.size() - 1, 0.0);
+        for (int i = 0; i < ch[0].poly.size(); i++)
+        {
+          for (int j = 0; j < ch[1].poly.size(); j++)
+          {
+            result.poly[i + j] += ch[0].poly[i] * ch[1].poly[j];
+          }
+        }
+        return true;
+      }
+      return false;
+    case Node::DIV:
+      if (ch[1].isConstant() && ch[1].constant() != 0.0)
+      {
+        result = ch[0];
+        result.scale(1.0 / ch[1].constant());
+        return true;
+      }
+      return false;
+    case Node::POW:
+    {
+      if (!ch[1].isConstant())
+      {
+        return false;
+      }
+      double exponent = ch[1].constant();
+      if (ch[0].isConstant())
+      {
+        result = makeLinearCombConstant(pow(ch[0].constant(), exponent));
+        return true;
+      }
+      if (!ch[0].amplitude.empty() || exponent != floor(exponent) || exponent < 0 ||
+          exponent * (ch[0].poly.size() - 1) > MAX_DEG_NATIVE)
+      {
+        return false;
+      }
+      result = makeLinearCombConstant(1.0);
+      for (int n = 0; n < (int)exponent; n++)
+      {
+        std::vector<double> tmp(result.poly.size() + ch[0].poly.size() - 1, 0.0);
+        for (int i = 0; i < result.poly.size(); i++)
+        {
+          for (int j = 0; j < ch[0].poly.size(); j++)
+          {
+            tmp[i + j] += result.poly[i] * ch[0].poly[j];
+          }
+        }
+        result.poly = tmp;
+      }
+      return true;
+    }
+    case Node::FUNCTION:
+    {
+      bool all_constant = true;
+      std::vector<double> args;
+      for (auto& c : ch)
+      {
+        all_constant = all_constant && c.isConstant();
+        args.push_back(c.constant());
+      }
+      if (all_constant)
+      {
+        double value;
+        if (!evalConstantFunction(node->name, args, value))
+        {
+          return false;
+        }
+        result = makeLinearCombConstant(value);
+        return true;
+      }
+      if ((node->name == "sin" || node->name == "cos") && ch[0].amplitude.empty() && ch[0].poly.size() == 2)
+      {  // sin(w*s+phi) or cos(w*s+phi)=sin(w*s+phi+pi/2)
+        double phase = ch[0].poly[0] + ((node->name == "cos") ? M_PI / 2.0 : 0.0);
+        result.amplitude = { 1.0 };
+        result.frequency = { ch[0].poly[1] };
+        result.phase = { fmod(phase, 2 * M_PI) };
+        return true;
+      }
+      return false;
+    }
+    default:
+      return false;
+  }
+}
+}  // namespace
+
+bool lowerExpression(const mt::exprNodePtr& node, double t_shift, mt::nativeExpression& native)
+{
+  LinearComb comb;
+  if (!lower(node, t_shift, comb))
+  {
+    return false;
+  }
+
+  native = mt::nativeExpression();
+  native.t_shift = t_shift;
+
+  // Remove the leading zeros of the polynomial, and store it with the highest power first
+  while (comb.poly.size() > 1 && comb.poly.back() == 0.0)
+  {
+    comb.poly.pop_back();
+  }
+  native.poly.assign(comb.poly.rbegin(), comb.poly.rend());
+
+  // Merge the sines with the same frequency: a1*sin(w*s+p1)+a2*sin(w*s+p2)=A*sin(w*s+P)
+  for (int k = 0; k < comb.amplitude.size(); k++)
+  {
+    auto it = std::find(native.frequency.begin(), native.frequency.end(), comb.frequency[k]);
+    if (it == native.frequency.end())
+    {
+      native.amplitude.push_back(comb.amplitude[k]);
+      native.frequency.push_back(comb.frequency[k]);
+      native.phase.push_back(comb.phase[k]);
+      continue;
+    }
+    int i = it - native.frequency.begin();
+    double re = native.amplitude[i] * cos(native.phase[i]) + comb.amplitude[k] * cos(comb.phase[k]);
+    double im = native.amplitude[i] * sin(native.phase[i]) + comb.amplitude[k] * sin(comb.phase[k]);
+    native.amplitude[i] = sqrt(re * re + im * im);
+    native.phase[i] = atan2(im, re);
+  }
+
+  return true;
+}
@@ -0,0 +1,188 @@
+/* ----------------------------------------------------------------------------
+ * Copyright 2021, Jesus Tordesillas Torres, Aerospace Controls Laboratory
+ * Massachusetts Institute of Technology
+ * All Rights Reserved
+ * Authors: Jesus Tordesillas, et al.
+ * See LICENSE file for the license information
+ * -------------------------------------------------------------------------- */
+
+#include "gated_assignment.hpp"
+
+#include <algorithm>
+#include <limits>
+#include <numeric>
+
+namespace tp
+{
+void GatedAssignment::solve(int num_rows, int num_cols, const std::vector<tp::assignmentEdge>& edges,
+                            std::vector<int>& assignment)
+{
+  assignment.assign(num_rows, -1);
+
+  // Connected components (union-find over rows [0, num_rows) and columns [num_rows, num_rows+num_cols))
+  std::vector<int> parent(num_rows + num_cols);
+  std::iota(parent.begin(), parent.end(), 0);
+  auto find = [&parent](int i) {
+    while (parent[i] != i)
+    {
+      parent[i] = parent[parent[i]];
+      i = parent[i];
+    }
+    return i;
+  };
+
+  double max_cost = 0.0;
+  for (auto& edge : edges)
+  {
+    parent[find(edge.row)] = find(num_rows + edge.col);
+    max_cost = std::max(max_cost, edge.cost);
+  }
+
+  // Cost of leaving a row unassigned: bigger than the cost of any assignment of the component, so that the number of
+  // assigned rows is maximized first
+  cost_unassigned_ = (max_cost + 1.0) * (num_rows + 1);
+
+  // Rows and columns of each component (only the components with at least one edge are solved)
+  std::vector<bool> row_has_edges(num_rows, false);
+  std::vector<bool> col_has_edges(num_cols, false);
+  for (auto& edge : edges)
+  {
+    row_has_edges[edge.row] = true;
+    col_has_edges[edge.col] = true;
+  }
+
+  std::vector<std::vector<int>> rows_of_component(num_rows + num_cols);
+  std::vector<std::vector<int>> cols_of_component(num_rows + num_cols);
+  local_col_.assign(num_cols, -1);
+  for (int row = 0; row < num_rows; row++)
+  {
+    if (row_has_edges[row])
+    {
+      rows_of_component[find(row)].push_back(row);
+    }
+  }
+  for (int col = 0; col < num_cols; col++)
+  {
+    if (col_has_edges[col])
+    {
+      std::vector<int>& cols = cols_of_component[find(num_rows + col)];
+      local_col_[col] = cols.size();
+      cols.push_back(col);
+    }
+  }
+
+  edges_of_row_.assign(num_rows, {});
+  for (auto& edge : edges)
+  {
+    edges_of_row_[edge.row].push_back(std::make_pair(local_col_[edge.col], edge.cost));
+  }
+
+  for (int component = 0; component < num_rows + num_cols; component++)
+  {
+    if (!rows_of_component[component].empty())
+    {
+      solveComponent(rows_of_component[component], cols_of_component[component], assignment);
+    }
+  }
+}
+
+// Shortest augmenting paths with potentials. Columns (1-based, 0 is the virtual start): [1, m] are the real ones, and
+// [m+1, m+n] are the "unassigned" columns (column m+i can only be used by the row i of the component). Only the
+// columns reached by the search of each row are scanned/updated, so that the cost of each augmentation depends on the
+// size of the explored region, not on the size of the component
+void GatedAssignment::solveComponent(const std::vector<int>& rows, const std::vector<int>& cols,
+                                     std::vector<int>& assignment)
+{
+  const double inf = std::numeric_limits<double>::infinity();
+  const int n = rows.size();
+  const int m = cols.size();
+  const int M = m + n;
+
+  std::vector<double> u(n + 1, 0.0), v(M + 1, 0.0), minv(M + 1, inf);
+  std::vector<int> p(M + 1, 0), way(M + 1, 0);  // p[j] is the row (1-based) assigned to column j
+  std::vector<bool> used(M + 1, false);
+  std::vector<int> reached;  // columns with minv < inf in the current search
+
+  for (int i = 1; i <= n; i++)
+  {
+    p[0] = i;
+    int j0 = 0;
+    reached.clear();
+    reached.push_back(0);
+    minv[0] = 0.0;
+    do
+    {
+      used[j0] = true;
+      int i0 = p[j0];
+
+      // Only the allowed pairs of row i0 are explored
+      auto relax = [&](int j, double cost) {
+        if (!used[j])
+        {
+          double cur = cost - u[i0] - v[j];
+          if (cur < minv[j])
+          {
+            if (minv[j] == inf)
+            {
+              reached.push_back(j);
+            }
+            minv[j] = cur;
+            way[j] = j0;
+          }
+        }
+      };
+      for (auto& edge : edges_of_row_[rows[i0 - 1]])
+      {
+        relax(edge.first + 1, edge.second);
+      }
+      relax(m + i0, cost_unassigned_);
+
+      double delta = inf;
+      int j1 = 0;
+      for (int j : reached)
+      {
+        if (!used[j] && minv[j] < delta)
+        {
+          delta = minv[j];
+          j1 = j;
+        }
+      }
+      for (int j : reached)
+      {
+        if (used[j])
+        {
+          u[p[j]] += delta;
+          v[j] -= delta;
+        }
+        else
+        {
+          minv[j] -= delta;
+        }
+      }
+      j0 = j1;
+    } while (p[j0] != 0);
+
+    do
+    {
+      int j1 = way[j0];
+      p[j0] = p[j1];
+      j0 = j1;
+    } while (j0 != 0);
+
+    for (int j : reached)
+    {
+      minv[j] = inf;
+      used[j] = false;
+    }
+  }
+
+  for (int j = 1; j <= m; j++)
+  {
+    if (p[j] != 0)
+    {
+      assignment[rows[p[j] - 1]] = cols[j - 1];
+    }
+  }
+}
+
+}  // namespace tp
@@ -0,0 +1,313 @@
+/* ----------------------------------------------------------------------------
+ * Copyright 2021, Jesus Tordesillas Torres, Aerospace Controls Laboratory
+ * Massachusetts Institute of Technology
+ * All Rights Reserved
+ * Authors: Jesus Tordesillas, et al.
+ * See LICENSE file for the license information
+ * -------------------------------------------------------------------------- */
+
+#include "grid_clustering.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <future>
+#include <limits>
+
+namespace tp
+{
+namespace
+{
+const uint64_t EMPTY_KEY = std::numeric_limits<uint64_t>::max();
+const int MIN_POINTS_PER_THREAD = 2000;  // Below this, the overhead of launching the threads is not worth it
+
+// 21 bits per axis (+-1e6 cells)
+uint64_t packKey(int64_t i, int64_t j, int64_t k)
+{
+  const int64_t offset = int64_t(1) << 20;
+  return ((uint64_t(i + offset) & 0x1FFFFF) << 42) | ((uint64_t(j + offset) & 0x1FFFFF) << 21) |
+         (uint64_t(k + offset) & 0x1FFFFF);
+}
+
+void unpackKey(uint64_t key, int64_t& i, int64_t& j, int64_t& k)
+{
+  const int64_t offset = int64_t(1) << 20;
+  i = int64_t((key >> 42) & 0x1FFFFF) - offset;
+  j = int64_t((key >> 21) & 0x1FFFFF) - offset;
+  k = int64_t(key & 0x1FFFFF) - offset;
+}
+}  // namespace
+
+GridClustering::GridClustering(int num_threads)
+{
+  num_threads_ = std::max(num_threads, 1);
+}
+
+// Lock-free find (with path halving)
+int GridClustering::find(int i)
+{
+  while (true)
+  {
+    int p = parent_[i].load(std::memory_order_relaxed);
+    if (p == i)
+    {
+      return i;
+    }
+    int gp = parent_[p].load(std::memory_order_relaxed);
+    if (p != gp)
+    {
+      parent_[i].compare_exchange_weak(p, gp, std::memory_order_relaxed);
+    }
+    i = gp;
+  }
+}
+
+// Lock-free union: the root with the larger index is linked to the other one. The link only succeeds if it's still a
+// root (if not, try again with the new roots)
+void GridClustering::unite(int a, int b)
+{
+  while (true)
+  {
+    a = find(a);
+    b = find(b);
+    if (a == b)
+    {
+      return;
+    }
+    if (a < b)
+    {
+      std::swap(a, b);
+    }
+    int expected = a;
+    if (parent_[a].compare_exchange_strong(expected, b, std::memory_order_relaxed))
+    {
+      return;
+    }
+  }
+}
+
+// Returns -1 if the cell is empty. Read-only, so it can be called from several threads
+int GridClustering::findCell(uint64_t key) const
+{
+  size_t mask = table_keys_.size() - 1;
+  size_t slot = (key * 0x9E3779B97F4A7C15ull) >> (64 - log2_table_size_);  // Fibonacci hashing
+  while (table_keys_[slot] != EMPTY_KEY)
+  {
+    if (table_keys_[slot] == key)
+    {
+      return table_values_[slot];
+    }
+    slot = (slot + 1) & mask;
+  }
+  return -1;
+}
+
+// Unites the points of cells [first_cell, last_cell) with the close points of the same cell and of the 13 "forward"
+// neighboring cells (the other 13 neighbors are checked when processing those cells)
+void GridClustering::uniteCells(const pcl::PointCloud<pcl::PointXYZ>& cloud, int first_cell, int last_cell,
+                                float tolerance)
+{
+  const float tolerance2 = tolerance * tolerance;
+
+  auto uniteIfClose = [&](int a, int b) {
+    const pcl::PointXYZ& pa = cloud.points[a];
+    const pcl::PointXYZ& pb = cloud.points[b];
+    float dx = pa.x - pb.x;
+    float dy = pa.y - pb.y;
+    float dz = pa.z - pb.z;
+    if (dx * dx + dy * dy + dz * dz <= tolerance2)
+    {
+      unite(a, b);
+    }
+  };
+
+  for (int c = first_cell; c < last_cell; c++)
+  {
+    // Same cell
+    for (int ia = cell_start_[c]; ia < cell_start_[c + 1]; ia++)
+    {
+      for (int ib = ia + 1; ib < cell_start_[c + 1]; ib++)
+      {
+        uniteIfClose(cell_points_[ia], cell_points_[ib]);
+      }
+    }
+
+    // Neighboring cells
+    int64_t i, j, k;
+    unpackKey(cell_keys_[c], i, j, k);
+    for (int di = 0; di <= 1; di++)
+    {
+      for (int dj = (di == 0) ? 0 : -1; dj <= 1; dj++)
+      {
+        for (int dk = (di == 0 && dj == 0) ? 1 : -1; dk <= 1; dk++)
+        {
+          int n = findCell(packKey(i + di, j + dj, k + dk));
+          if (n == -1)
+          {
+            continue;
+          }
+          for (int ia = cell_start_[c]; ia < cell_start_[c + 1]; ia++)
+          {
+            for (int ib = cell_start_[n]; ib < cell_start_[n + 1]; ib++)
+            {
+              uniteIfClose(cell_points_[ia], cell_points_[ib]);
+            }
+          }
+        }
+      }
+    }
+  }
+}
+
+void GridClustering::cluster(const pcl::PointCloud<pcl::PointXYZ>& cloud, double tolerance, int min_size,
+                             int max_size, std::vector<tp::clusterStats>& clusters)
+{
+  clusters.clear();
+
+  const int num_points = cloud.points.size();
+  if (num_points == 0)
+  {
+    return;
+  }
+
+  ///////////////////////// Put the points in the cells (counting sort)
+  int log2_table_size = 4;
+  while ((1 << log2_table_size) < 2 * num_points)  // The table is at most half full
+  {
+    log2_table_size++;
+  }
+  if (log2_table_size > log2_table_size_)
+  {
+    table_keys_.assign(size_t(1) << log2_table_size, EMPTY_KEY);
+    table_values_.resize(table_keys_.size());
+    log2_table_size_ = log2_table_size;
+  }
+  const size_t mask = table_keys_.size() - 1;
+
+  const float inv_tolerance = 1.0 / tolerance;
+
+  cell_keys_.clear();
+  cell_start_.clear();
+  cell_of_point_.resize(num_points);
+
+  for (int p = 0; p < num_points; p++)
+  {
+    const pcl::PointXYZ& point = cloud.points[p];
+    uint64_t key = packKey(int64_t(std::floor(point.x * inv_tolerance)), int64_t(std::floor(point.y * inv_tolerance)),
+                           int64_t(std::floor(point.z * inv_tolerance)));
+
+    size_t slot = (key * 0x9E3779B97F4A7C15ull) >> (64 - log2_table_size_);
+    while (table_keys_[slot] != key && table_keys_[slot] != EMPTY_KEY)
+    {
+      slot = (slot + 1) & mask;
+    }
+    if (table_keys_[slot] == EMPTY_KEY)
+    {
+      table_keys_[slot] = key;
+      table_values_[slot] = cell_keys_.size();
+      cell_keys_.push_back(key);
+      cell_start_.push_back(0);
+    }
+    int c = table_values_[slot];
+    cell_of_point_[p] = c;
+    cell_start_[c]++;  // For now, number of points of the cell
+  }
+
+  const int num_cells = cell_keys_.size();
+  int sum = 0;
+  for (int c = 0; c < num_cells; c++)
+  {
+    int num_points_cell = cell_start_[c];
+    cell_start_[c] = sum;
+    sum += num_points_cell;
+  }
+  cell_start_.push_back(sum);
+
+  cell_points_.resize(num_points);
+  std::vector<int> next(cell_start_.begin(), cell_start_.end() - 1);
+  for (int p = 0; p < num_points; p++)
+  {
+    cell_points_[next[cell_of_point_[p]]++] = p;
+  }
+
+  ///////////////////////// Connected components
+  if (parent_capacity_ < size_t(num_points))
+  {
+    parent_capacity_ = num_points;
+    parent_.reset(new std::atomic<int>[parent_capacity_]);
+  }
+  for (int p = 0; p < num_points; p++)
+  {
+    parent_[p].store(p, std::memory_order_relaxed);
+  }
+
+  int num_threads = std::min(num_threads_, std::max(num_points / MIN_POINTS_PER_THREAD, 1));
+  if (num_threads == 1)
+  {
+    uniteCells(cloud, 0, num_cells, tolerance);
+  }
+  else
+  {
+    std::vector<std::future<void>> futures;
+    int cells_per_thread = (num_cells + num_threads - 1) / num_threads;
+    for (int t = 0; t < num_threads; t++)
+    {
+      int first_cell = std::min(t * cells_per_thread, num_cells);
+      int last_cell = std::min(first_cell + cells_per_thread, num_cells);
+      futures.push_back(std::async(std::launch::async, &GridClustering::uniteCells, this, std::cref(cloud), first_cell,
+                                   last_cell, tolerance));
+    }
+    for (auto& future : futures)
+    {
+      future.get();
+    }
+  }
+
+  ///////////////////////// Label the points, computing the centroid and bounds of each cluster at the same time
+  std::vector<int>& cluster_of_root = cell_of_point_;  // Reused (not needed anymore)
+  std::fill(cluster_of_root.begin(), cluster_of_root.end(), -1);
+
+  std::vector<tp::clusterStats> all_clusters;
+  for (int p = 0; p < num_points; p++)
+  {
+    int root = find(p);
+    const Eigen::Vector3d point(cloud.points[p].x, cloud.points[p].y, cloud.points[p].z);
+    if (cluster_of_root[root] == -1)
+    {
+      cluster_of_root[root] = all_clusters.size();
+      all_clusters.push_back({ point, point, point, 1 });
+      continue;
+    }
+    tp::clusterStats& stats = all_clusters[cluster_of_root[root]];
+    stats.centroid += point;  // For now, sum of the points
+    stats.min = stats.min.cwiseMin(point);
+    stats.max = stats.max.cwiseMax(point);
+    stats.num_points++;
+  }
+
+  for (auto& stats : all_clusters)
+  {
+    if (stats.num_points >= min_size && stats.num_points <= max_size)
+    {
+      stats.centroid = stats.centroid / stats.num_points;
+      clusters.push_back(stats);
+    }
+  }
+
+  // Same order as pcl::EuclideanClusterExtraction
+  std::stable_sort(clusters.begin(), clusters.end(), [](const tp::clusterStats& a, const tp::clusterStats& b) {
+    return a.num_points > b.num_points;
+  });
+
+  ///////////////////////// Leave the hash table empty for the next call
+  for (auto key : cell_keys_)
+  {
+    size_t slot = (key * 0x9E3779B97F4A7C15ull) >> (64 - log2_table_size_);
+    while (table_keys_[slot] != key)
+    {
+      slot = (slot + 1) & mask;
+    }
+    table_keys_[slot] = EMPTY_KEY;
+  }
+}
+
+}  // namespace tp
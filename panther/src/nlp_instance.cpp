@@ -0,0 +1,177 @@
+/* ----------------------------------------------------------------------------
+ * Copyright 2021, Jesus Tordesillas Torres, Aerospace Controls Laboratory
+ * Massachusetts Institute of Technology
+ * All Rights Reserved
+ * Authors: Jesus Tordesillas, et al.
+ * See LICENSE file for the license information
+ * -------------------------------------------------------------------------- */
+
+#include "nlp_instance.hpp"
+#include "termcolor.hpp"
+
+#include <algorithm>
+#include <fstream>
+#include <iostream>
+#include <cstdint>
+
+using namespace termcolor;
+
+namespace
+{
+const char magic_nlp[4] = { 'P', 'N', 'L', 'P' };
+const uint32_t version_nlp = 1;
+
+template <typename T>
+void writePod(std::ofstream& out, const T& value)
+{
+  out.write(reinterpret_cast<const char*>(&value), sizeof(T));
+}
+
+template <typename T>
+bool readPod(std::ifstream& in, T& value)
+{
+  in.read(reinterpret_cast<char*>(&value), sizeof(T));
+  return bool(in);
+}
+
+void writeString(std::ofstream& out, const std::string& s)
+{
+  writePod(out, uint32_t(s.size()));
+  out.write(s.data(), s.size());
+}
+
+bool readString(std::ifstream& in, std::string& s)
+{
+  uint32_t size;
+  if (!readPod(in, size))
+  {
+    return false;
+  }
+  s.resize(size);
+  in.read(&s[0], size);
+  return bool(in);
+}
+
+void writeMap(std::ofstream& out, const std::map<std::string, casadi::DM>& map)
+{
+  writePod(out, uint32_t(map.size()));
+  for (auto& it : map)
+  {
+    casadi::DM dense = casadi::DM::densify(it.second);
+    writeString(out, it.first);
+    writePod(out, uint32_t(dense.rows()));
+    writePod(out, uint32_t(dense.columns()));
+    const std::vector<double>& data = dense.nonzeros();  // column-major
+    out.write(reinterpret_cast<const char*>(data.data()), data.size() * sizeof(double));
+  }
+}
+
+bool readMap(std::ifstream& in, std::map<std::string, casadi::DM>& map)
+{
+  map.clear();
+  uint32_t num_of_entries;
+  if (!readPod(in, num_of_entries))
+  {
+    return false;
+  }
+  for (uint32_t i = 0; i < num_of_entries; i++)
+  {
+    std::string name;
+    uint32_t rows, cols;
+    if (!readString(in, name) || !readPod(in, rows) || !readPod(in, cols))
+    {
+      return false;
+    }
+    std::vector<double> data(rows * cols);
+    in.read(reinterpret_cast<char*>(data.data()), data.size() * sizeof(double));
+    if (!in)
+    {
+      return false;
+    }
+    map[name] = casadi::DM::reshape(casadi::DM(data), rows, cols);
+  }
+  return true;
+}
+}  // namespace
+
+bool saveNlpInstance(const std::string& file, const mt::nlpInstance& instance)
+{
+  std::ofstream out(file, std::ios::out | std::ios::binary | std::ios::trunc);
+  if (!out)
+  {
+    std::cout << red << "Could not open " << file << reset << std::endl;
+    return false;
+  }
+
+  out.write(magic_nlp, 4);
+  writePod(out, version_nlp);
+  writeString(out, instance.function_name);
+  writeString(out, instance.status);
+  writePod(out, int32_t(instance.iter_count));
+  writePod(out, instance.ms_opt);
+  writePod(out, instance.ms_budget_opt);
+  writeMap(out, instance.arguments);
+  writeMap(out, instance.result);
+
+  return bool(out);
+}
+
+bool loadNlpInstance(const std::string& file, mt::nlpInstance& instance)
+{
+  std::ifstream in(file, std::ios::in | std::ios::binary);
+  if (!in)
+  {
+    std::cout << red << "Could not open " << file << reset << std::endl;
+    return false;
+  }
+
+  char magic[4];
+  uint32_t version;
+  in.read(magic, 4);
+  if (!in || !std::equal(magic, magic + 4, magic_nlp) || !readPod(in, version) || version != version_nlp)
+  {
+    std::cout << red << file << " is not a NLP instance (or has a different version)" << reset << std::endl;
+    return false;
+  }
+
+  int32_t iter_count;
+  bool success = readString(in, instance.function_name) && readString(in, instance.status) &&
+                 readPod(in, iter_count) && readPod(in, instance.ms_opt) && readPod(in, instance.ms_budget_opt) &&
+                 readMap(in, instance.arguments) && readMap(in, instance.result);
+  instance.iter_count = iter_count;
+
+  if (!success)
+  {
+    std::cout << red << file << " is truncated" << reset << std::endl;
+  }
+  return success;
+}
+
+void getStatusAndIterCount(casadi::Function& cf, int index_instruction, std::string& status, int& iter_count)
+{
+  // Very hacky solution, see discussion at https://groups.google.com/g/casadi-users/c/1061E0eVAXM/m/dFHpw1CQBgAJ
+  casadi::Dict stats = cf.instruction_MX(index_instruction).which_function().stats(1);
+  status = std::string(stats["return_status"]);
+  iter_count = stats.count("iter_count") ? int(stats["iter_count"].to_int()) : -1;
+}
+
+int getIndexInstructionSolver(casadi::Function& cf, const std::string& folder, const std::string& function_name)
+{
+  std::string suffix = (function_name.compare(0, 2, "op") == 0) ? function_name.substr(2) : ("_" + function_name);
+  std::ifstream file(folder + "index_instruction" + suffix + ".txt");
+  int index_instruction;
+  if (file >> index_instruction)
+  {
+    return index_instruction;
+  }
+
+  // Same search as get_stats() in main.m
+  for (casadi_int k = 0; k < cf.n_instructions(); k++)
+  {
+    if (cf.instruction_id(k) == casadi::OP_CALL && cf.instruction_MX(k).which_function().name() == "solver")
+    {
+      return k;
+    }
+  }
+  return -1;
+}
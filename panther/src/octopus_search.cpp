@@ -30,29 +30,19 @@ OctopusSearch::OctopusSearch(std::string basis, int num_seg, int deg_pos, double
   N_ = M_ - p_ - 1;
   num_seg_ = num_seg;
 
-  mt::basisConverter basis_converter;
-
   if (basis == "MINVO")
   {
     // std::cout << green << bold << "A* is using MINVO" << reset << std::endl;
-    M_pos_bs2basis_ = basis_converter.getMinvoDeg3Converters(num_seg);
-    M_vel_bs2basis_ = basis_converter.getBSplineDeg2Converters(num_seg);  // getMinvoDeg2Converters TODO!!
     basis_ = MINVO;
   }
   else if (basis == "BEZIER")
   {
     // std::cout << green << bold << "A* is using BEZIER" << reset << std::endl;
-    M_pos_bs2basis_ = basis_converter.getBezierDeg3Converters(num_seg);
-    M_vel_bs2basis_ = basis_converter.getBSplineDeg2Converters(num_seg);  // getBezierDeg2Converters TODO!!
     basis_ = BEZIER;
   }
   else if (basis == "B_SPLINE")
   {
     // std::cout << green << bold << "A* is using B_SPLINE" << reset << std::endl;
-
-    M_pos_bs2basis_ = basis_converter.getBSplineDeg3Converters(num_seg);
-    M_vel_bs2basis_ = basis_converter.getBSplineDeg2Converters(num_seg);
-
     basis_ = B_SPLINE;
   }
   else
@@ -61,11 +51,8 @@ OctopusSearch::OctopusSearch(std::string basis, int num_seg, int deg_pos, double
     abort();
   }
 
-  M_pos_bs2basis_inverse_.clear();
-  for (auto matrix_i : M_pos_bs2basis_)
-  {
-    M_pos_bs2basis_inverse_.push_back(matrix_i.inverse());
-  }
+  pos_basis_tables_ = mt::basisTables::get(basis);
+  vel_basis_tables_ = mt::basisTables::get("B_SPLINE");  // TODO!! Use also basis for the velocity
 
   separator_solver_ = new separator::Separator();  // 0.0, 0.0, 0.0
 
@@ -343,7 +330,7 @@ void OctopusSearch::computeLimitsVoxelSize(double& min_voxel_size, double& max_v
 bool OctopusSearch::computeAxisForNextInterval(const int i, const Eigen::Vector3d& viM1, int axis, double& constraint_L,
                                                double& constraint_U)
 {
-  Eigen::Matrix<double, 3, 3> M_interv_next = M_vel_bs2basis_[i - 1];
+  Eigen::Matrix<double, 3, 3> M_interv_next = vel_basis_tables_->getMVelBs2Basis(i - 1, num_seg_);
   constraint_L = -std::numeric_limits<double>::max();
   constraint_U = std::numeric_limits<double>::max();
 
@@ -397,7 +384,7 @@ bool OctopusSearch::computeUpperAndLowerConstraints(const int i, const Eigen::Ve
 
   ////////////////////////IMPOSE VELOCITY CONSTRAINTS
 
-  Eigen::Matrix<double, 3, 3> M_interv = M_vel_bs2basis_[interv];
+  Eigen::Matrix<double, 3, 3> M_interv = vel_basis_tables_->getMVelBs2Basis(interv, num_seg_);
 
   // std::cout << "M_interv= \n" << M_interv << std::endl;
 
@@ -419,7 +406,7 @@ bool OctopusSearch::computeUpperAndLowerConstraints(const int i, const Eigen::Ve
     ////////////////  [viM1 vi 0]
     Eigen::Matrix<double, 3, 3> tmp2 = viM1 * M_interv.row(0);
 
-    M_interv = M_vel_bs2basis_[interv + 1];
+    M_interv = vel_basis_tables_->getMVelBs2Basis(interv + 1, num_seg_);
 
     // For x
     for (int j = 0; j < 3; j++)  // For the three velocity control points
@@ -457,7 +444,7 @@ bool OctopusSearch::computeUpperAndLowerConstraints(const int i, const Eigen::Ve
       }
     }
 
-    M_interv = M_vel_bs2basis_[interv + 2];
+    M_interv = vel_basis_tables_->getMVelBs2Basis(interv + 2, num_seg_);
 
     ////////////////  [vi 0 0]
     // For x
@@ -699,13 +686,13 @@ void OctopusSearch::recoverPath(Node* result_ptr)
 Eigen::Matrix<double, 3, 4> OctopusSearch::transformBSpline2otherBasis(const Eigen::Matrix<double, 3, 4>& Qbs,
                                                                        int interval)
 {
-  return Qbs * M_pos_bs2basis_[interval];
+  return Qbs * pos_basis_tables_->getMPosBs2Basis(interval, num_seg_);
 }
 
 Eigen::Matrix<double, 3, 4> OctopusSearch::transformOtherBasis2BSpline(const Eigen::Matrix<double, 3, 4>& Qmv,
                                                                        int interval)
 {
-  return Qmv * M_pos_bs2basis_inverse_[interval];
+  return Qmv * pos_basis_tables_->getMPosBs2BasisInverse(interval, num_seg_);
 }
 
 bool OctopusSearch::checkFeasAndFillND(std::vector<Eigen::Vector3d>& q, std::vector<Eigen::Vector3d>& n,
@@ -818,7 +805,7 @@ bool OctopusSearch::checkFeasAndFillND(std::vector<Eigen::Vector3d>& q, std::vec
     Vbs.col(1) = vip1;
     Vbs.col(2) = vip2;
 
-    Eigen::Matrix<double, 3, 3> V_newbasis = Vbs * M_vel_bs2basis_[i];
+    Eigen::Matrix<double, 3, 3> V_newbasis = Vbs * vel_basis_tables_->getMVelBs2Basis(i, num_seg_);
 
     // if ((vi.array() > epsilon * v_max_.array()).any() || (vi.array() < -epsilon * v_max_.array()).any())
 
@@ -837,7 +824,7 @@ bool OctopusSearch::checkFeasAndFillND(std::vector<Eigen::Vector3d>& q, std::vec
       std::cout << "Vbs= \n" << Vbs << std::endl;
       std::cout << "V_newbasis= \n" << V_newbasis << std::endl;
       std::cout << "v_max_= \n" << v_max_ << std::endl;
-      std::cout << "Using matrix \n" << M_vel_bs2basis_[i] << std::endl;
+      std::cout << "Using matrix \n" << vel_basis_tables_->getMVelBs2Basis(i, num_seg_) << std::endl;
       isFeasible = false;
     }
 
@@ -14,6 +14,7 @@
 #include <stdlib.h>
 
 #include "panther.hpp"
+#include "expression_tree.hpp"
 #include "timer.hpp"
 #include "termcolor.hpp"
 
@@ -37,37 +38,14 @@ Panther::Panther(mt::parameters par) : par_(par)
   changeDroneStatus(DroneStatus::GOAL_REACHED);
   resetInitialization();
 
-  mt::basisConverter basis_converter;
-
-  if (par.basis == "MINVO")
-  {
-    A_basis_deg1_rest_ = basis_converter.getArestMinvoDeg1();
-    A_basis_deg2_rest_ = basis_converter.getArestMinvoDeg2();
-    A_basis_deg3_rest_ = basis_converter.getArestMinvoDeg3();
-  }
-  else if (par.basis == "BEZIER")
-  {
-    A_basis_deg1_rest_ = basis_converter.getArestBezierDeg1();
-    A_basis_deg2_rest_ = basis_converter.getArestBezierDeg2();
-    A_basis_deg3_rest_ = basis_converter.getArestBezierDeg3();
-  }
-  else if (par.basis == "B_SPLINE")
-  {
-    A_basis_deg1_rest_ = basis_converter.getArestBSplineDeg1();
-    A_basis_deg2_rest_ = basis_converter.getArestBSplineDeg2();
-    A_basis_deg3_rest_ = basis_converter.getArestBSplineDeg3();
-  }
-  else
+  basis_tables_ = mt::basisTables::get(par.basis);
+  if (basis_tables_ == nullptr)
   {
     std::cout << red << "Basis " << par.basis << " not implemented yet" << reset << std::endl;
     std::cout << red << "============================================" << reset << std::endl;
     abort();
   }
 
-  A_basis_deg1_rest_inverse_ = A_basis_deg1_rest_.inverse();
-  A_basis_deg2_rest_inverse_ = A_basis_deg2_rest_.inverse();
-  A_basis_deg3_rest_inverse_ = A_basis_deg3_rest_.inverse();
-
   log_ptr_ = std::shared_ptr<mt::log>(new mt::log);
 
   solver_ = new SolverIpopt(par_, log_ptr_);
@@ -81,43 +59,45 @@ void Panther::dynTraj2dynTrajCompiled(const mt::dynTraj& traj, mt::dynTrajCompil
   {
     traj_compiled.pwp_mean = traj.pwp_mean;
     traj_compiled.pwp_var = traj.pwp_var;
+    traj_compiled.use_pwp_fixed =
+        traj.pwp_mean.toFixed(traj_compiled.pwp_mean_fixed) && traj.pwp_var.toFixed(traj_compiled.pwp_var_fixed);
     traj_compiled.is_static =
         ((traj.pwp_mean.eval(0.0) - traj.pwp_mean.eval(1e30)).norm() < 1e-5);  // TODO: Improve this
   }
   else
   {
-    mtx_t_.lock();
+    traj_compiled.use_pwp_fixed = false;
 
-    typedef exprtk::symbol_table<double> symbol_table_t;
-    typedef exprtk::expression<double> expression_t;
-    typedef exprtk::parser<double> parser_t;
+    mtx_t_.lock();
 
-    // Compile the mean
+    // Compile the mean and its derivative (obtained symbolically)
+    bool has_derivative = true;
+    bool has_native = true;
     for (auto function_i : traj.s_mean)
     {
-      symbol_table_t symbol_table;
-      symbol_table.add_variable("t", t_);
-      symbol_table.add_constants();
-      expression_t expression;
-      expression.register_symbol_table(symbol_table);
-      parser_t parser;
-      parser.compile(function_i, expression);
-      traj_compiled.s_mean.push_back(expression);
+      cachedExpression& cached = getCachedExpression(function_i, true);
+      traj_compiled.s_mean.push_back(cached.expression);
+      traj_compiled.s_dmean.push_back(cached.derivative);
+      traj_compiled.native_mean.push_back(cached.native);
+      has_derivative = has_derivative && cached.has_derivative;
+      has_native = has_native && cached.has_native;
+    }
+    if (has_derivative == false)
+    {
+      traj_compiled.s_dmean.clear();
     }
 
     // Compile the variance
     for (auto function_i : traj.s_var)
     {
-      symbol_table_t symbol_table;
-      symbol_table.add_variable("t", t_);
-      symbol_table.add_constants();
-      expression_t expression;
-      expression.register_symbol_table(symbol_table);
-      parser_t parser;
-      parser.compile(function_i, expression);
-      traj_compiled.s_var.push_back(expression);
+      cachedExpression& cached = getCachedExpression(function_i, false);
+      traj_compiled.s_var.push_back(cached.expression);
+      traj_compiled.native_var.push_back(cached.native);
+      has_native = has_native && cached.has_native;
     }
 
+    traj_compiled.use_native = has_native;
+
     mtx_t_.unlock();
 
     traj_compiled.is_static =
@@ -133,15 +113,89 @@ void Panther::dynTraj2dynTrajCompiled(const mt::dynTraj& traj, mt::dynTrajCompil
   traj_compiled.time_received = traj.time_received;  // ros::Time::now().toSec();
 }
 
+// Returns the compiled expression s (and its derivative if need_derivative==true), compiling it only if it's not
+// already in the cache. mtx_t_ and mtx_trajs_ must be locked when calling this function
+Panther::cachedExpression& Panther::getCachedExpression(const std::string& s, bool need_derivative)
+{
+  typedef exprtk::symbol_table<double> symbol_table_t;
+  typedef exprtk::expression<double> expression_t;
+  typedef exprtk::parser<double> parser_t;
+
+  auto compile = [&](const std::string& function, expression_t& expression) {
+    symbol_table_t symbol_table;
+    symbol_table.add_variable("t", t_);
+    symbol_table.add_constants();
+    expression.register_symbol_table(symbol_table);
+    parser_t parser;
+    parser.compile(function, expression);
+  };
+
+  auto it = expression_cache_.find(s);
+  if (it != expression_cache_.end())
+  {
+    num_expression_cache_hits_++;
+  }
+  else
+  {
+    num_expression_cache_misses_++;
+
+    if (expression_cache_.size() >= 1000)
+    {  // The expressions are changing all the time (e.g., they contain the time at which they were sent). Note that
+       // the expressions already in trajs_ are still valid after this
+      expression_cache_.clear();
+    }
+
+    it = expression_cache_.emplace(s, cachedExpression()).first;
+    compile(s, it->second.expression);
+
+    // Lower it (if possible) to a native expression, that will be evaluated instead of the exprtk one
+    mt::exprNodePtr root;
+    it->second.has_native =
+        parseExpression(s, root) && lowerExpression(root, ros::Time::now().toSec(), it->second.native);
+  }
+
+  cachedExpression& cached = it->second;
+
+  if (need_derivative && cached.derivative_computed == false)
+  {
+    mt::exprNodePtr root;
+    mt::exprNodePtr derivative;
+    if (parseExpression(s, root))
+    {
+      derivative = differentiateExpression(root);
+    }
+    if (derivative == nullptr)
+    {
+      std::cout << yellow << "Could not differentiate " << s << ", using finite differences" << reset << std::endl;
+    }
+    else
+    {
+      compile(expressionToString(derivative), cached.derivative);
+    }
+    cached.has_derivative = (derivative != nullptr);
+    cached.derivative_computed = true;
+  }
+
+  return cached;
+}
+
 // Note that this function is here because I need t_ for this evaluation
 Eigen::Vector3d Panther::evalMeanDynTrajCompiled(const mt::dynTrajCompiled& traj, double t)
 {
   Eigen::Vector3d tmp;
 
-  if (traj.use_pwp_field == true)
+  if (traj.use_pwp_fixed == true)
+  {
+    tmp = traj.pwp_mean_fixed.eval(t);
+  }
+  else if (traj.use_pwp_field == true)
   {
     tmp = traj.pwp_mean.eval(t);
   }
+  else if (traj.use_native == true)
+  {
+    tmp << traj.native_mean[0].eval(t), traj.native_mean[1].eval(t), traj.native_mean[2].eval(t);
+  }
   else
   {
     mtx_t_.lock();
@@ -160,10 +214,18 @@ Eigen::Vector3d Panther::evalVarDynTrajCompiled(const mt::dynTrajCompiled& traj,
 {
   Eigen::Vector3d tmp;
 
-  if (traj.use_pwp_field == true)
+  if (traj.use_pwp_fixed == true)
+  {
+    tmp = traj.pwp_var_fixed.eval(t);
+  }
+  else if (traj.use_pwp_field == true)
   {
     tmp = traj.pwp_var.eval(t);
   }
+  else if (traj.use_native == true)
+  {
+    tmp << traj.native_var[0].eval(t), traj.native_var[1].eval(t), traj.native_var[2].eval(t);
+  }
   else
   {
     mtx_t_.lock();
@@ -177,6 +239,91 @@ Eigen::Vector3d Panther::evalVarDynTrajCompiled(const mt::dynTrajCompiled& traj,
   return tmp;
 }
 
+// Evaluates the mean and the variance (and, if compute_dmean==true, the derivative of the mean) of traj at all the
+// times. The derivative is analytic (finite differences are only used if the expression could not be differentiated)
+void Panther::evalDynTrajCompiled(const mt::dynTrajCompiled& traj, const std::vector<double>& times,
+                                  mt::dynTrajSamples& samples, bool compute_dmean)
+{
+  int num_samples = times.size();
+  double epsilon = 1e-6;
+
+  samples.times = times;
+  samples.mean.resize(3, num_samples);
+  samples.var.resize(3, num_samples);
+  samples.dmean.resize(3, compute_dmean ? num_samples : 0);
+
+  if (traj.use_pwp_fixed == true)
+  {
+    traj.pwp_mean_fixed.evalBatch(times, samples.mean);
+    traj.pwp_var_fixed.evalBatch(times, samples.var);
+    if (compute_dmean)
+    {
+      traj.pwp_mean_fixed.evalDerivativeBatch(times, samples.dmean);
+    }
+  }
+  else if (traj.use_pwp_field == true)
+  {
+    int hint_mean = -1;
+    int hint_var = -1;
+    for (int i = 0; i < num_samples; i++)
+    {
+      samples.mean.col(i) = traj.pwp_mean.eval(times[i], hint_mean);
+      samples.var.col(i) = traj.pwp_var.eval(times[i], hint_var);
+      if (compute_dmean)
+      {
+        samples.dmean.col(i) = traj.pwp_mean.evalDerivative(times[i], hint_mean);
+      }
+    }
+  }
+  else if (traj.use_native == true)
+  {
+    for (int d = 0; d < 3; d++)
+    {
+      for (int i = 0; i < num_samples; i++)
+      {
+        samples.mean(d, i) = traj.native_mean[d].eval(times[i]);
+        samples.var(d, i) = traj.native_var[d].eval(times[i]);
+      }
+      if (compute_dmean)
+      {
+        for (int i = 0; i < num_samples; i++)
+        {
+          samples.dmean(d, i) = traj.native_mean[d].evalDerivative(times[i]);
+        }
+      }
+    }
+  }
+  else
+  {
+    mtx_t_.lock();  // only once for all the samples
+    for (int i = 0; i < num_samples; i++)
+    {
+      t_ = times[i];
+      for (int d = 0; d < 3; d++)
+      {
+        samples.mean(d, i) = traj.s_mean[d].value();
+        samples.var(d, i) = traj.s_var[d].value();
+      }
+      if (compute_dmean && traj.s_dmean.size() == 3)
+      {
+        for (int d = 0; d < 3; d++)
+        {
+          samples.dmean(d, i) = traj.s_dmean[d].value();
+        }
+      }
+      else if (compute_dmean)
+      {
+        t_ = times[i] + epsilon;
+        for (int d = 0; d < 3; d++)
+        {
+          samples.dmean(d, i) = (traj.s_mean[d].value() - samples.mean(d, i)) / epsilon;
+        }
+      }
+    }
+    mtx_t_.unlock();
+  }
+}
+
 void Panther::removeOldTrajectories()
 {
   double time_now = ros::Time::now().toSec();
@@ -205,33 +352,49 @@ void Panther::removeOldTrajectories()
 
 // Note that we need to compile the trajectories inside panther.cpp because t_ is in panther.hpp
 void Panther::updateTrajObstacles(mt::dynTraj traj)
+{
+  // The compilation is done with mtx_trajs_ locked, see expression_cache_
+  mtx_trajs_.lock();
+  {
+    mt::dynTrajCompiled traj_compiled;
+    dynTraj2dynTrajCompiled(traj, traj_compiled);
+    addTrajObstacle(traj_compiled);
+  }
+  mtx_trajs_.unlock();
+}
+
+void Panther::updateTrajObstacles(mt::dynTrajCompiled traj_compiled)
+{
+  mtx_trajs_.lock();
+  addTrajObstacle(traj_compiled);
+  mtx_trajs_.unlock();
+}
+
+// mtx_trajs_ must be locked when calling this function
+void Panther::addTrajObstacle(mt::dynTrajCompiled& traj_compiled)
 {
   MyTimer tmp_t(true);
 
-  if (started_check_ == true && traj.is_agent == true)
+  if (started_check_ == true && traj_compiled.is_agent == true)
   {
     have_received_trajectories_while_checking_ = true;
   }
 
-  // std::cout << on_blue << bold << "in  updateTrajObstacles(), waiting to lock mtx_trajs_" << reset << std::endl;
-  mtx_trajs_.lock();
-
   std::vector<mt::dynTrajCompiled>::iterator obs_ptr =
       std::find_if(trajs_.begin(), trajs_.end(),
-                   [=](const mt::dynTrajCompiled& traj_compiled) { return traj_compiled.id == traj.id; });
+                   [&](const mt::dynTrajCompiled& traj) { return traj.id == traj_compiled.id; });
 
   bool exists_in_local_map = (obs_ptr != std::end(trajs_));
 
-  mt::dynTrajCompiled traj_compiled;
-  dynTraj2dynTrajCompiled(traj, traj_compiled);
+  bool is_static = traj_compiled.is_static;
 
   if (exists_in_local_map)
   {  // if that object already exists, substitute its trajectory
-    *obs_ptr = traj_compiled;
+    *obs_ptr = std::move(traj_compiled);
   }
   else
   {  // if it doesn't exist, add it to the local map
-    trajs_.push_back(traj_compiled);
+    trajs_.push_back(std::move(traj_compiled));
     // ROS_WARN_STREAM("Adding " << traj_compiled.id);
   }
 
@@ -248,8 +411,8 @@ void Panther::updateTrajObstacles(mt::dynTraj traj)
     Eigen::Vector3d center_obs = evalMeanDynTrajCompiled(trajs_[index_traj], time_now);
 
     // mtx_t_.unlock();
-    if (((traj_compiled.is_static == true) && (center_obs - state_.pos).norm() > 2 * par_.Ra) ||  ////
-        ((traj_compiled.is_static == false) && (center_obs - state_.pos).norm() > 4 * par_.Ra))
+    if (((is_static == true) && (center_obs - state_.pos).norm() > 2 * par_.Ra) ||  ////
+        ((is_static == false) && (center_obs - state_.pos).norm() > 4 * par_.Ra))
     // #### Static Obstacle: 2*Ra because: traj_{k-1} is inside a sphere of Ra.
     // Then, in iteration k the point A (which I don't
     // know yet)  is taken along that trajectory, and
@@ -278,9 +441,6 @@ void Panther::updateTrajObstacles(mt::dynTraj traj)
         trajs_.end());
   }
 
-  mtx_trajs_.unlock();
-  // std::cout << red << bold << "in updateTrajObstacles(), mtx_trajs_ unlocked" << reset << std::endl;
-
   have_received_trajectories_while_checking_ = false;
   // std::cout << bold << blue << "updateTrajObstacles took " << tmp_t << reset << std::endl;
 }
@@ -375,15 +535,15 @@ std::vector<Eigen::Vector3d> Panther::vertexesOfInterval(mt::PieceWisePol& pwp,
 
     if (deg == 3)
     {
-      V = P * A_basis_deg3_rest_inverse_;
+      V = P * basis_tables_->A_rest_deg3_inverse;
     }
     else if (deg == 2)
     {
-      V = P * A_basis_deg2_rest_inverse_;
+      V = P * basis_tables_->A_rest_deg2_inverse;
     }
     else if (deg == 1)
     {
-      V = P * A_basis_deg1_rest_inverse_;
+      V = P * basis_tables_->A_rest_deg1_inverse;
     }
     else
     {
@@ -427,14 +587,9 @@ std::vector<Eigen::Vector3d> Panther::vertexesOfInterval(mt::PieceWisePol& pwp,
 // // return a vector that contains all the vertexes of the polyhedral approx of an interval.
 std::vector<Eigen::Vector3d> Panther::vertexesOfInterval(mt::dynTrajCompiled& traj, double t_start, double t_end)
 {
-  // every side of the box will be increased by 2*delta (+delta on one end, -delta on the other)
-  // note that we use the variance at t_end (which is going to be higher that the one at t_start)
-  Eigen::Vector3d delta = traj.bbox / 2.0 + (par_.drone_radius) * Eigen::Vector3d::Ones() +  //////
-                          par_.norminv_prob * (evalVarDynTrajCompiled(traj, t_end)).cwiseSqrt();
-
   if (traj.use_pwp_field == false)
   {
-    std::vector<Eigen::Vector3d> points;
+    std::vector<double> times;
 
     // Will always have a sample at the beginning of the interval, and another at the end.
     for (double t = t_start;                           /////////////
@@ -442,8 +597,22 @@ std::vector<Eigen::Vector3d> Panther::vertexesOfInterval(mt::dynTrajCompiled& tr
          ((t > t_end) && ((t - t_end) < par_.gamma));  /////// This is to ensure we have a sample a the end
          t = t + par_.gamma)
     {
-      Eigen::Vector3d tmp =
-          evalMeanDynTrajCompiled(traj, std::min(t, t_end));  // this min only has effect on the last sample
+      times.push_back(std::min(t, t_end));  // this min only has effect on the last sample
+    }
+
+    mt::dynTrajSamples samples;
+    evalDynTrajCompiled(traj, times, samples);
+
+    // every side of the box will be increased by 2*delta (+delta on one end, -delta on the other)
+    // note that we use the variance at t_end (which is going to be higher that the one at t_start)
+    Eigen::Vector3d delta = traj.bbox / 2.0 + (par_.drone_radius) * Eigen::Vector3d::Ones() +  //////
+                            par_.norminv_prob * samples.var.col(times.size() - 1).cwiseSqrt();
+
+    std::vector<Eigen::Vector3d> points;
+
+    for (int i = 0; i < times.size(); i++)
+    {
+      Eigen::Vector3d tmp = samples.mean.col(i);
 
       //"Minkowski sum along the trajectory: box centered on the trajectory"
       points.push_back(Eigen::Vector3d(tmp.x() + delta.x(), tmp.y() + delta.y(), tmp.z() + delta.z()));
@@ -460,6 +629,11 @@ std::vector<Eigen::Vector3d> Panther::vertexesOfInterval(mt::dynTrajCompiled& tr
   }
   else
   {
+    // every side of the box will be increased by 2*delta (+delta on one end, -delta on the other)
+    // note that we use the variance at t_end (which is going to be higher that the one at t_start)
+    Eigen::Vector3d delta = traj.bbox / 2.0 + (par_.drone_radius) * Eigen::Vector3d::Ones() +  //////
+                            par_.norminv_prob * (evalVarDynTrajCompiled(traj, t_end)).cwiseSqrt();
+
     return vertexesOfInterval(traj.pwp_mean, t_start, t_end, delta);
   }
 }
@@ -548,6 +722,11 @@ bool Panther::IsTranslating()
   return (drone_status_ == DroneStatus::GOAL_SEEN || drone_status_ == DroneStatus::TRAVELING);
 }
 
+const mt::PieceWisePolDeque& Panther::getCommittedPwp() const
+{
+  return pwp_prev_;
+}
+
 ConvexHullsOfCurve Panther::convexHullsOfCurve(mt::dynTrajCompiled& traj, double t_start, double t_end)
 {
   ConvexHullsOfCurve convexHulls;
@@ -583,32 +762,25 @@ void Panther::sampleFeaturePosVel(int argmax_prob_collision, double t_start, dou
 
   double delta = (t_end - t_start) / par_.num_samples_simpson;
 
+  mt::dynTrajSamples samples;
+  if (argmax_prob_collision >= 0)
+  {
+    std::vector<double> times;
+    for (int i = 0; i < par_.num_samples_simpson; i++)
+    {
+      times.push_back(t_start + i * delta);  // which is constant along the trajectory
+    }
+    evalDynTrajCompiled(trajs_[argmax_prob_collision], times, samples, true);
+  }
+
   for (int i = 0; i < par_.num_samples_simpson; i++)
   {
     if (argmax_prob_collision >= 0)
     {
-      double ti = t_start + i * delta;  // which is constant along the trajectory
-      Eigen::Vector3d pos_i = evalMeanDynTrajCompiled(trajs_[argmax_prob_collision], ti);
-
-      pos.push_back(pos_i);
-
-      // MyTimer timer(true);
-      // This commented part always returns 0.0. TODO: find out why. For now, let's use finite differences
-      // See also
-      // https://github.com/ArashPartow/exprtk/blob/66bed77369557fe1872df4c999c9d9ccb3adc3f6/readme.txt#LC4010:~:text=This%20free%20function%20will%20attempt%20to%20perform%20a%20numerical%20differentiation
-      // Eigen::Vector3d vel_i = Eigen::Vector3d(exprtk::derivative(trajs_[wt].function[0], "t"),  ////////////
-      //                                         exprtk::derivative(trajs_[wt].function[1], "t"),  ////////////
-      //                                         exprtk::derivative(trajs_[wt].function[2], t_));
-      // std::cout << "time to take derivatives= " << timer << std::endl;
-      // std::cout << on_green << bold << "vel= " << vel_i.transpose() << reset << std::endl;
-      // std::cout << on_green << bold << "pos= " << pos[i].transpose() << reset << std::endl;
+      pos.push_back(samples.mean.col(i));
 
-      // Use finite differences to obtain the derivative
-      double epsilon = 1e-6;
-
-      Eigen::Vector3d pos_i_epsilon = evalMeanDynTrajCompiled(trajs_[argmax_prob_collision], ti + epsilon);
-
-      vel.push_back((pos_i_epsilon - pos_i) / epsilon);
+      // Analytic derivative (see evalDynTrajCompiled and expression_tree.hpp)
+      vel.push_back(samples.dmean.col(i));
 
       // std::cout << bold << "Velocity= " << vel[i].transpose() << reset << std::endl;
       //////////////////////////////
@@ -699,9 +871,9 @@ void Panther::doStuffTermGoal()
   if (drone_status_ == DroneStatus::GOAL_REACHED)
   {
     /////////////////////////////////
-    mtx_plan_.lock();  // must be before changeDroneStatus
+    mtx_plan_.lock();
 
-    changeDroneStatus(DroneStatus::YAWING);
+    id_last_solution_committed_++;  // the yaw of plan_ cannot be changed by solveAndSpliceYaw anymore
     mt::state last_state = plan_.back();
 
     double desired_yaw = atan2(G_term_.pos[1] - last_state.pos[1], G_term_.pos[0] - last_state.pos[0]);
@@ -718,9 +890,10 @@ void Panther::doStuffTermGoal()
 
     verify((plan_.size() >= 1), "plan_.size() must be >=1");
 
+    std::vector<mt::state> states_yawing;
+    mt::state state_i = last_state;
     for (int i = 1; i < (num_of_el + 1); i++)
     {
-      mt::state state_i = plan_.get(i - 1);
       state_i.yaw = state_i.yaw + dyaw * par_.dc;
       if (i == num_of_el)
       {
@@ -730,7 +903,17 @@ void Panther::doStuffTermGoal()
       {
         state_i.dyaw = dyaw;
       }
-      plan_.push_back(state_i);
+      states_yawing.push_back(state_i);
+    }
+    // The status is changed only once the yawing states are in plan_: getNextGoal() (that doesn't lock mtx_plan_)
+    // changes YAWING to TRAVELING as soon as the plan has only one state
+    if (plan_.splice(plan_.tailIndex(), states_yawing))
+    {
+      changeDroneStatusIf(DroneStatus::GOAL_REACHED, DroneStatus::YAWING);
+    }
+    else
+    {
+      std::cout << red << "Could not add the yawing states to the plan, staying in GOAL_REACHED" << reset << std::endl;
     }
     mtx_plan_.unlock();
     /////////////////////////////////
@@ -896,8 +1079,7 @@ bool Panther::isReplanningNeeded()
 }
 
 bool Panther::replan(mt::Edges& edges_obstacles_out, std::vector<mt::state>& X_safe_out,
-                     std::vector<Hyperplane3D>& planes, int& num_of_LPs_run, int& num_of_QCQPs_run,
-                     mt::PieceWisePol& pwp_out, mt::log& log)
+                     std::vector<Hyperplane3D>& planes, int& num_of_LPs_run, int& num_of_QCQPs_run, mt::log& log)
 {
   (*log_ptr_) = {};  // Reset the struct with the default values
 
@@ -907,6 +1089,11 @@ bool Panther::replan(mt::Edges& edges_obstacles_out, std::vector<mt::state>& X_s
 
   log_ptr_->pos = state_.pos;
   log_ptr_->G_term_pos = G_term.pos;
+
+  mtx_t_.lock();
+  log_ptr_->num_expression_cache_hits = num_expression_cache_hits_;
+  log_ptr_->num_expression_cache_misses = num_expression_cache_misses_;
+  mtx_t_.unlock();
   log_ptr_->drone_status = drone_status_;
 
   if (isReplanningNeeded() == false)
@@ -938,15 +1125,18 @@ bool Panther::replan(mt::Edges& edges_obstacles_out, std::vector<mt::state>& X_s
 
   saturate(deltaT_, par_.lower_bound_runtime_snlopt / par_.dc, par_.upper_bound_runtime_snlopt / par_.dc);
 
-  k_index_end = std::max((int)(plan_.size() - deltaT_), 0);
+  long int tail = plan_.tailIndex();  // plan_.size() may decrease (but not the tail) while this is running
+  int plan_size = tail - plan_.headIndex();
 
-  if (plan_.size() < 5)
+  k_index_end = std::max((int)(plan_size - deltaT_), 0);
+
+  if (plan_size < 5)
   {
     k_index_end = 0;
   }
 
-  k_index = plan_.size() - 1 - k_index_end;
-  A = plan_.get(k_index);
+  k_index = plan_size - 1 - k_index_end;
+  A = plan_.getAbs(tail - 1 - k_index_end);
 
   mtx_plan_.unlock();
 
@@ -1031,16 +1221,24 @@ bool Panther::replan(mt::Edges& edges_obstacles_out, std::vector<mt::state>& X_s
 
   mtx_trajs_.lock();
   std::cout << green << bold << "trajs_.size()= " << trajs_.size() << reset << std::endl;
+
+  std::vector<double> times_prob;
+  for (int j = 0; j <= num_samplesp1; j++)
+  {
+    times_prob.push_back(t_start + j * delta * (t_final - t_start));
+  }
+  mt::dynTrajSamples samples;
+
   for (int i = 0; i < trajs_.size(); i++)
   {
+    evalDynTrajCompiled(trajs_[i], times_prob, samples);
+
     double prob_i = 0.0;
     for (int j = 0; j <= num_samplesp1; j++)
     {
-      double t = t_start + j * delta * (t_final - t_start);
-
       Eigen::Vector3d pos_drone = A.pos + j * delta * (G_term_.pos - A.pos);  // not a random variable
-      Eigen::Vector3d pos_obs_mean = evalMeanDynTrajCompiled(trajs_[i], t);
-      Eigen::Vector3d pos_obs_std = (evalVarDynTrajCompiled(trajs_[i], t)).cwiseSqrt();
+      Eigen::Vector3d pos_obs_mean = samples.mean.col(j);
+      Eigen::Vector3d pos_obs_std = samples.var.col(j).cwiseSqrt();
       // std::cout << "pos_obs_std= " << pos_obs_std << std::endl;
       prob_i += probMultivariateNormalDist(-R, R, pos_obs_mean - pos_drone, pos_obs_std);
     }
@@ -1195,51 +1393,71 @@ bool Panther::replan(mt::Edges& edges_obstacles_out, std::vector<mt::state>& X_s
   //////////////////////////////////////////////////////////////////////////
   mtx_plan_.lock();
 
-  int plan_size = plan_.size();
+  long int abs_index_start = plan_.tailIndex() - k_index_end - 1;  // absolute index of A (i.e., traj_solution_[0])
+  int id_solution;
+
+  if ((abs_index_start + (long int)solver_->traj_solution_.size() - plan_.headIndex()) > plan_.capacity())
+  {
+    mtx_plan_.unlock();
+    logAndTimeReplan("Committed plan is full", false, log);
+    return false;
+  }
 
-  if ((plan_size - 1 - k_index_end) < 0)
+  // this replaces also the initial condition, which is included in traj_solution_[0]
+  if (plan_.splice(abs_index_start, solver_->traj_solution_) == false)
   {
-    // std::cout << "plan_size= " << plan_size << std::endl;
     // std::cout << "k_index_end= " << k_index_end << std::endl;
     mtx_plan_.unlock();
     logAndTimeReplan("Point A already published", false, log);
     return false;
   }
-  else
+  id_last_solution_committed_++;
+  id_solution = id_last_solution_committed_;
+
+  // Copied while mtx_plan_ is held: once it's released, solveAndSpliceYaw() may splice plan_ at any moment
+  X_safe_out = plan_.toStdVector();
+  mt::state final_state_plan = plan_.back();
+
+  mtx_plan_.unlock();
+
+  ////////////////////
+  //////////////////// Solve for yaw in another thread (only if pipelined_py)
+  SolverIpopt::yawJob yaw_job;
+  if (solver_->getPendingYawJob(yaw_job))
   {
-    plan_.erase(plan_.end() - k_index_end - 1, plan_.end());    // this deletes also the initial condition...
-    for (int i = 0; i < (solver_->traj_solution_).size(); i++)  //... which is included in traj_solution_[0]
+    if (yaw_future_.valid() &&
+        yaw_future_.wait_for(std::chrono::seconds(0)) != std::future_status::ready)
     {
-      plan_.push_back(solver_->traj_solution_[i]);
+      std::cout << yellow << "Previous yaw solve still running, keeping the yaw that goes to the final yaw" << reset
+                << std::endl;
+    }
+    else
+    {
+      yaw_future_ =
+          std::async(std::launch::async, &Panther::solveAndSpliceYaw, this, yaw_job, id_solution, abs_index_start);
     }
   }
 
-  mtx_plan_.unlock();
-
   ////////////////////
   ////////////////////
 
   if (exists_previous_pwp_ == true)
   {
-    pwp_out = composePieceWisePol(time_now, par_.dc, pwp_prev_, pwp_now);
-    pwp_prev_ = pwp_out;
+    composePieceWisePol(time_now, par_.dc, pwp_prev_, pwp_now);  // in place, only the intervals that change
   }
   else
   {  //
-    pwp_out = pwp_now;
-    pwp_prev_ = pwp_now;
+    pwp_prev_.fromPieceWisePol(pwp_now);
     exists_previous_pwp_ = true;
   }
 
-  X_safe_out = plan_.toStdVector();
-
   ///////////////////////////////////////////////////////////
   ///////////////       OTHER STUFF    //////////////////////
   //////////////////////////////////////////////////////////
 
   // Check if we have planned until G_term
-  // mt::state F = plan_.back();  // Final point of the safe path (\equiv final point of the comitted path)
-  double dist = (G_term_.pos - plan_.back().pos).norm();
+  // final_state_plan is the final point of the safe path (\equiv final point of the comitted path)
+  double dist = (G_term_.pos - final_state_plan.pos).norm();
 
   if (dist < par_.goal_radius)
   {
@@ -1252,6 +1470,83 @@ bool Panther::replan(mt::Edges& edges_obstacles_out, std::vector<mt::state>& X_s
   return true;
 }
 
+// Runs in another thread. The yaw is spliced only if plan_ has not been replaced since the position was committed
+// and if, at the first state that has not been published yet, the jump in yaw can be done in one step of par_.dc
+void Panther::solveAndSpliceYaw(SolverIpopt::yawJob job, int id_solution, long int abs_index_start)
+{
+  // It runs in a std::async whose future is never read, so any exception would be lost silently
+  try
+  {
+    MyTimer timer(true);
+    mt::trajectory traj_yaw;
+    bool success = solver_->solveYawJob(job, traj_yaw);
+    double ms = timer.elapsedSoFarMs();
+
+    if (success == false)
+    {
+      return;
+    }
+
+    std::lock_guard<std::mutex> lock(mtx_plan_);
+
+    if (id_solution != id_last_solution_committed_)
+    {
+      std::cout << yellow << "Yaw solved in " << ms << " ms, but the plan has already changed. Discarding it" << reset
+                << std::endl;
+      return;
+    }
+
+    // Note that the state plan_.headIndex() may be being published right now
+    long int from = std::max(abs_index_start, plan_.headIndex() + 1);  // first state not published yet
+    long int tail = plan_.tailIndex();
+    long int end_yaw = std::min(abs_index_start + (long int)traj_yaw.size(), tail);
+
+    if (from >= end_yaw)
+    {
+      return;
+    }
+
+    long int k0 = from - abs_index_start;  // first element of traj_yaw not published yet
+
+    double diff = traj_yaw[k0].yaw - plan_.getAbs(from).yaw;
+    angle_wrap(diff);
+
+    if (fabs(diff) > par_.ydot_max * par_.dc)
+    {
+      std::cout << yellow << "Yaw solved in " << ms << " ms, but it's too late to splice it (diff= " << diff
+                << "). Keeping the previous one" << reset << std::endl;
+      return;
+    }
+
+    // The states of plan_ are never modified in place (the publisher may be reading them): [from, tail) is replaced
+    std::vector<mt::state> states;
+    for (long int i = from; i < tail; i++)
+    {
+      mt::state state_i = plan_.getAbs(i);
+      if (i < end_yaw)
+      {
+        long int k = i - abs_index_start;
+        state_i.yaw = traj_yaw[k].yaw;
+        state_i.dyaw = traj_yaw[k].dyaw;
+        state_i.ddyaw = traj_yaw[k].ddyaw;
+      }
+      states.push_back(state_i);
+    }
+
+    if (plan_.splice(from, states) == false)
+    {
+      std::cout << yellow << "Yaw solved in " << ms << " ms, but it's too late to splice it" << reset << std::endl;
+      return;
+    }
+
+    std::cout << green << "Yaw solved in " << ms << " ms and spliced (from element " << k0 << ")" << reset << std::endl;
+  }
+  catch (std::exception& e)
+  {
+    std::cout << red << "Could not solve or splice the yaw: " << e.what() << reset << std::endl;
+  }
+}
+
 void Panther::logAndTimeReplan(const std::string& info, const bool& success, mt::log& log)
 {
   log_ptr_->info_replan = info;
@@ -1288,7 +1583,10 @@ void Panther::resetInitialization()
   state_initialized_ = false;
 
   terminal_goal_initialized_ = false;
+  mtx_plan_.lock();
   plan_.clear();
+  id_last_solution_committed_++;  // so that a yaw being solved in another thread is not spliced
+  mtx_plan_.unlock();
 }
 
 bool Panther::getNextGoal(mt::state& next_goal)
@@ -1305,19 +1603,18 @@ bool Panther::getNextGoal(mt::state& next_goal)
   }
 
   mtx_goals.lock();
-  mtx_plan_.lock();
 
+  // plan_ is read without locking mtx_plan_, so that this never waits for replan()
   next_goal.setZero();
-  next_goal = plan_.front();
-
-  if (plan_.size() > 1)
+  if (plan_.popFront(next_goal) == false)
   {
-    plan_.pop_front();
+    mtx_goals.unlock();
+    return false;  // The plan is being replaced right now
   }
 
-  if (plan_.size() == 1 && drone_status_ == DroneStatus::YAWING)
+  if (plan_.size() == 1)
   {
-    changeDroneStatus(DroneStatus::TRAVELING);
+    changeDroneStatusIf(DroneStatus::YAWING, DroneStatus::TRAVELING);
   }
 
   if (par_.mode == "ysweep")
@@ -1341,20 +1638,39 @@ bool Panther::getNextGoal(mt::state& next_goal)
   // verify(fabs(next_goal.dyaw) <= par_.ydot_max, "par_.ydot_max not satisfied!!");
 
   mtx_goals.unlock();
-  mtx_plan_.unlock();
   return true;
 }
 
 // Debugging functions
 void Panther::changeDroneStatus(int new_status)
 {
-  if (new_status == drone_status_)
+  int old_status = drone_status_.exchange(new_status);
+  if (new_status != old_status)
   {
-    return;
+    printDroneStatusChange(old_status, new_status);
   }
+}
 
+// Changes the status only if it's still expected_status (it may be changed by another thread at the same time).
+// Returns false if it has not been changed
+bool Panther::changeDroneStatusIf(int expected_status, int new_status)
+{
+  int old_status = expected_status;
+  if (drone_status_.compare_exchange_strong(old_status, new_status) == false)
+  {
+    return false;
+  }
+  if (new_status != old_status)
+  {
+    printDroneStatusChange(old_status, new_status);
+  }
+  return true;
+}
+
+void Panther::printDroneStatusChange(int old_status, int new_status)
+{
   std::cout << "Changing DroneStatus from ";
-  switch (drone_status_)
+  switch (old_status)
   {
     case DroneStatus::YAWING:
       std::cout << bold << "YAWING" << reset;
@@ -1388,8 +1704,6 @@ void Panther::changeDroneStatus(int new_status)
   }
 
   std::cout << std::endl;
-
-  drone_status_ = new_status;
 }
 
 void Panther::printDroneStatus()
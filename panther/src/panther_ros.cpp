@@ -75,6 +75,8 @@ PantherRos::PantherRos(ros::NodeHandle nh1, ros::NodeHandle nh2, ros::NodeHandle
 
   safeGetParam(nh1_, "Ra", par_.Ra);
   safeGetParam(nh1_, "impose_FOV_in_trajCB", par_.impose_FOV_in_trajCB);
+  safeGetParam(nh1_, "use_compact_traj_broadcast", par_.use_compact_traj_broadcast);
+  safeGetParam(nh1_, "compact_traj_keyframe_period", par_.compact_traj_keyframe_period);
 
   safeGetParam(nh1_, "ydot_max", par_.ydot_max);
 
@@ -113,6 +115,13 @@ PantherRos::PantherRos(ros::NodeHandle nh1, ros::NodeHandle nh2, ros::NodeHandle
   safeGetParam(nh1_, "lower_bound_runtime_snlopt", par_.lower_bound_runtime_snlopt);
   safeGetParam(nh1_, "kappa", par_.kappa);
   safeGetParam(nh1_, "mu", par_.mu);
+  safeGetParam(nh1_, "max_cpu_time_ipopt", par_.max_cpu_time_ipopt);
+  safeGetParam(nh1_, "linear_solver_ipopt", par_.linear_solver_ipopt);
+  safeGetParam(nh1_, "print_level_ipopt", par_.print_level_ipopt);
+  safeGetParam(nh1_, "max_inf_pr_truncated_opt", par_.max_inf_pr_truncated_opt);
+  safeGetParam(nh1_, "record_nlp_instances", par_.record_nlp_instances);
+  safeGetParam(nh1_, "folder_nlp_instances", par_.folder_nlp_instances);
+  safeGetParam(nh1_, "pipelined_py", par_.pipelined_py);
 
   safeGetParam(nh1_, "max_seconds_keeping_traj", par_.max_seconds_keeping_traj);
 
@@ -143,6 +152,8 @@ PantherRos::PantherRos(ros::NodeHandle nh1, ros::NodeHandle nh2, ros::NodeHandle
 
   safeGetParam(nh1_, "c_smooth_yaw_search", par_.c_smooth_yaw_search);
   safeGetParam(nh1_, "c_visibility_yaw_search", par_.c_visibility_yaw_search);
+  safeGetParam(nh1_, "use_boost_yaw_search", par_.use_boost_yaw_search);
+  safeGetParam(nh1_, "use_casadi_visibility", par_.use_casadi_visibility);
   // safeGetParam(nh1_, "num_of_layers", par_.num_of_layers); //This one is the same as num_samples_simpson
   safeGetParam(nh1_, "num_of_yaw_per_layer", par_.num_of_yaw_per_layer);
 
@@ -174,6 +185,7 @@ PantherRos::PantherRos(ros::NodeHandle nh1, ros::NodeHandle nh2, ros::NodeHandle
   std::cout << bold << "Parameters obtained, checking them..." << reset << std::endl;
 
   verify((par_.c_smooth_yaw_search >= 0), "par_.c_smooth_yaw_search>=0 must hold");
+  verify((par_.compact_traj_keyframe_period >= 1), "par_.compact_traj_keyframe_period>=1 must hold");
   verify((par_.c_visibility_yaw_search >= 0), "par_.c_visibility_yaw_search>=0 must hold");
   verify((par_.num_of_yaw_per_layer >= 1), "par_.num_of_yaw_per_layer>=1 must hold");
 
@@ -190,6 +202,8 @@ PantherRos::PantherRos(ros::NodeHandle nh1, ros::NodeHandle nh2, ros::NodeHandle
   verify((par_.factor_alloc >= 1.0), "Needed: factor_alloc>=1");
   verify((par_.kappa >= 0 && par_.mu >= 0), "Needed: kappa and mu >= 0");
   verify(((par_.kappa + par_.mu) <= 1), "Needed: (par_.kappa + par_.mu) <= 1");
+  verify((par_.max_cpu_time_ipopt > 0), "max_cpu_time_ipopt>0 must hold");
+  verify((par_.max_inf_pr_truncated_opt >= 0), "max_inf_pr_truncated_opt>=0 must hold");
   verify((par_.a_star_fraction_voxel_size >= 0.0 && par_.a_star_fraction_voxel_size <= 1.0), "a_star_fraction_voxel_"
                                                                                              "size is not in [0,1] ");
   verify((par_.deg_pos == 3), "PANTHER needs deg_pos==3");
@@ -215,6 +229,13 @@ PantherRos::PantherRos(ros::NodeHandle nh1, ros::NodeHandle nh2, ros::NodeHandle
 
   panther_ptr_ = std::unique_ptr<Panther>(new Panther(par_));
 
+  compact_traj_encoder_ =
+      std::unique_ptr<CompactTrajEncoder>(new CompactTrajEncoder(par_.compact_traj_keyframe_period));
+
+  mt::state zero;
+  zero.setZero();
+  pwp_zero_var_ = createPwpFromStaticPosition(zero);
+
   // Publishers
   pub_goal_ = nh1_.advertise<snapstack_msgs::Goal>("goal", 1);
   pub_setpoint_ = nh1_.advertise<visualization_msgs::Marker>("setpoint", 1);
@@ -225,9 +246,11 @@ PantherRos::PantherRos(ros::NodeHandle nh1, ros::NodeHandle nh2, ros::NodeHandle
   poly_safe_pub_ = nh1_.advertise<decomp_ros_msgs::PolyhedronArray>("polys", 1, true);
   pub_traj_safe_colored_ = nh1_.advertise<visualization_msgs::MarkerArray>("traj_obtained", 1);
   pub_traj_ = nh1_.advertise<panther_msgs::DynTraj>("/trajs", 1, true);  // The last boolean is latched or not
+  pub_traj_compact_ = nh1_.advertise<std_msgs::UInt8MultiArray>("/trajs_compact", 1, true);
   pub_fov_ = nh1_.advertise<visualization_msgs::Marker>("fov", 1);
   pub_obstacles_ = nh1_.advertise<visualization_msgs::Marker>("obstacles", 1);
   pub_log_ = nh1_.advertise<panther_msgs::Log>("log", 1);
+  pub_opt_budget_ = nh1_.advertise<std_msgs::Float32MultiArray>("opt_budget", 1);
 
   // Subscribers
   sub_term_goal_ = nh1_.subscribe("term_goal", 1, &PantherRos::terminalGoalCB, this);
@@ -239,6 +262,7 @@ PantherRos::PantherRos(ros::NodeHandle nh1, ros::NodeHandle nh2, ros::NodeHandle
   {
     ROS_INFO("NOT using ground truth trajectories (subscribed to trajs_predicted)");
     sub_traj_ = nh1_.subscribe("trajs_predicted", 20, &PantherRos::trajCB, this);  // number is queue size
+    sub_traj_batch_ = nh1_.subscribe("trajs_predicted_batch", 5, &PantherRos::trajBatchCB, this);
 
     // obstacles --> topic trajs_predicted
     // agents -->  //Not implemented yet  (solve the common frame problem)
@@ -248,6 +272,7 @@ PantherRos::PantherRos(ros::NodeHandle nh1, ros::NodeHandle nh2, ros::NodeHandle
     ROS_INFO("Using ground truth trajectories (subscribed to /trajs)");
 
     sub_traj_ = nh1_.subscribe("/trajs", 20, &PantherRos::trajCB, this);
+    sub_traj_compact_ = nh1_.subscribe("/trajs_compact", 20, &PantherRos::trajCompactCB, this);
     // sub_traj_ = nh1_.subscribe("trajs_zhejiang", 20, &PantherRos::trajCB,
     //                            this);  // Uncomment ONLY FOR THE BENCHMARK WITH zhejiang CODE
     // obstacles --> topic /trajs
@@ -318,6 +343,23 @@ void PantherRos::pubObstacles(mt::Edges edges_obstacles)
   return;
 }
 
+bool PantherRos::isInFOV(const Eigen::Vector3d& w_pos)
+{
+  Eigen::Vector3d c_pos = (par_.c_T_b) * (w_T_b_.inverse()) * w_pos;  // position of the obstacle in the camera frame
+                                                                      // (i.e., depth optical frame)
+  bool inFOV =                                                        // check if it's inside the field of view.
+      c_pos.z() < par_.fov_depth &&                                   //////////////////////
+      fabs(atan2(c_pos.x(), c_pos.z())) <
+          ((par_.fov_x_deg * M_PI / 180.0) / 2.0) &&  ///// Note that fov_x_deg means x camera_depth_optical_frame
+      fabs(atan2(c_pos.y(), c_pos.z())) <
+          ((par_.fov_y_deg * M_PI / 180.0) / 2.0);  ///// Note that fov_y_deg means x camera_depth_optical_frame
+
+  // inFOV_old_ = inFOV;
+  // inFOV_time_old_ = ros::Time::now().toSec();
+
+  return inFOV;
+}
+
 void PantherRos::trajCB(const panther_msgs::DynTraj& msg)
 {
   if (msg.id == id_)
@@ -332,31 +374,9 @@ void PantherRos::trajCB(const panther_msgs::DynTraj& msg)
 
   //////
 
-  if (par_.impose_FOV_in_trajCB)
+  if (par_.impose_FOV_in_trajCB && !isInFOV(w_pos))
   {
-    Eigen::Vector3d c_pos = (par_.c_T_b) * (w_T_b_.inverse()) * w_pos;  // position of the obstacle in the camera frame
-                                                                        // (i.e., depth optical frame)
-    bool inFOV =                                                        // check if it's inside the field of view.
-        c_pos.z() < par_.fov_depth &&                                   //////////////////////
-        fabs(atan2(c_pos.x(), c_pos.z())) <
-            ((par_.fov_x_deg * M_PI / 180.0) / 2.0) &&  ///// Note that fov_x_deg means x camera_depth_optical_frame
-        fabs(atan2(c_pos.y(), c_pos.z())) <
-            ((par_.fov_y_deg * M_PI / 180.0) / 2.0);  ///// Note that fov_y_deg means x camera_depth_optical_frame
-
-    // inFOV_old_ = inFOV;
-    // inFOV_time_old_ = ros::Time::now().toSec();
-
-    if (inFOV == false)
-    {
-      // std::cout << "B_pos= " << B_pos.transpose() << " is NOT inFOV" << std::endl;
-      // std::cout << "w_pos= " << w_pos.transpose() << " is NOT inFOV" << std::endl;
-      // std::cout << "[inFOV] w_T_b_= " << w_T_b_.matrix() << std::endl;
-      return;
-    }
-    // else
-    // {
-    //   std::cout << "B_pos= " << B_pos.transpose() << " is inFOV!!!" << std::endl;
-    // }
+    return;
   }
   /////
 
@@ -392,17 +412,84 @@ void PantherRos::trajCB(const panther_msgs::DynTraj& msg)
   panther_ptr_->updateTrajObstacles(tmp);
 }
 
+// Trajectories broadcast by other agents with the compact encoding (see compact_traj.hpp)
+void PantherRos::trajCompactCB(const std_msgs::UInt8MultiArray& msg)
+{
+  mt::compactTrajInfo info;
+  if (CompactTrajDecoder::decodeInfo(msg.data.data(), msg.data.size(), info) == false || info.id == id_)
+  {  // Not valid, or this is my own trajectory
+    return;
+  }
+
+  // Note that all the messages need to be decoded (even the ones that are not going to be used), so that the next
+  // deltas can be applied
+  mt::dynTrajCompiled traj_compiled;
+  if (compact_traj_decoder_.decode(msg.data.data(), msg.data.size(), traj_compiled) == false)
+  {
+    ROS_WARN_THROTTLE(1.0, "Could not decode the compact trajectory of agent %d, waiting for the next keyframe",
+                      info.id);
+    return;
+  }
+
+  if (par_.impose_FOV_in_trajCB && !isInFOV(info.pos))
+  {
+    return;
+  }
+
+  traj_compiled.time_received = ros::Time::now().toSec();
+
+  panther_ptr_->updateTrajObstacles(std::move(traj_compiled));
+}
+
+// Predictions of all the tracks of a frame of the tracker (see traj_batch.hpp)
+void PantherRos::trajBatchCB(const std_msgs::UInt8MultiArray& msg)
+{
+  std::vector<mt::compactTrajInfo> infos;
+  std::vector<mt::dynTraj> trajs;
+  if (TrajBatchDecoder::decode(msg.data.data(), msg.data.size(), infos, trajs) == false)
+  {
+    ROS_WARN_THROTTLE(1.0, "Could not decode the batch of predicted trajectories");
+    return;
+  }
+
+  double time_received = ros::Time::now().toSec();
+  for (size_t i = 0; i < trajs.size(); i++)
+  {
+    if (infos[i].id == id_ || (par_.impose_FOV_in_trajCB && !isInFOV(infos[i].pos)))
+    {
+      continue;
+    }
+    trajs[i].time_received = time_received;
+    panther_ptr_->updateTrajObstacles(std::move(trajs[i]));
+  }
+}
+
 // This trajectory contains all the future trajectory (current_pos --> A --> final_point_of_traj), because it's the
 // composition of pwp
-void PantherRos::publishOwnTraj(const mt::PieceWisePol& pwp)
+void PantherRos::publishOwnTraj(const mt::PieceWisePolDeque& pwp)
 {
+  if (par_.use_compact_traj_broadcast)
+  {
+    mt::compactTrajInfo info;
+    info.id = id_;
+    info.is_agent = true;
+    info.bbox = 2 * par_.drone_radius * Eigen::Vector3d::Ones();
+    info.pos = state_.pos;
+
+    if (compact_traj_encoder_->encode(pwp, pwp_zero_var_, info, compact_traj_buffer_))
+    {
+      std_msgs::UInt8MultiArray msg;
+      msg.data = compact_traj_buffer_;
+      pub_traj_compact_.publish(msg);
+      return;
+    }
+    ROS_WARN_THROTTLE(1.0, "Could not use the compact encoding for the trajectory, using DynTraj");
+  }
+
   panther_msgs::DynTraj msg;
   msg.use_pwp_field = true;
   msg.pwp_mean = pwp2PwpMsg(pwp);
-
-  mt::state tmp;
-  tmp.setZero();
-  msg.pwp_var = pwp2PwpMsg(createPwpFromStaticPosition(tmp));  // zero variance
+  msg.pwp_var = pwp2PwpMsg(pwp_zero_var_);
 
   // msg.function = s;
   msg.bbox.push_back(2 * par_.drone_radius);
@@ -425,17 +512,30 @@ void PantherRos::replanCB(const ros::TimerEvent& e)
     std::vector<mt::state> X_safe;
 
     std::vector<Hyperplane3D> planes;
-    mt::PieceWisePol pwp;
     mt::log log;
 
-    bool replanned =
-        panther_ptr_->replan(edges_obstacles, X_safe, planes, num_of_LPs_run_, num_of_QCQPs_run_, pwp, log);
+    bool replanned = panther_ptr_->replan(edges_obstacles, X_safe, planes, num_of_LPs_run_, num_of_QCQPs_run_, log);
 
     if (log.drone_status != DroneStatus::GOAL_REACHED)  // log.replanning_was_needed
     {
       pub_log_.publish(log2LogMsg(log));
     }
 
+    if (log.ms_budget_opt > 0.0)  // IPOPT was called in this replan
+    {
+      // Not in panther_msgs::Log, as in the pipeline_latency of the tracker
+      std_msgs::Float32MultiArray budget_msg;
+      budget_msg.layout.dim.resize(1);
+      budget_msg.layout.dim[0].label = "ms_budget_opt,ms_opt,opt_truncated_by_deadline,opt_exceeded_budget";
+      budget_msg.layout.dim[0].size = 4;
+      budget_msg.layout.dim[0].stride = 4;
+      budget_msg.data.push_back(log.ms_budget_opt);
+      budget_msg.data.push_back(log.tim_opt.getMsSaved());
+      budget_msg.data.push_back(log.opt_truncated_by_deadline);
+      budget_msg.data.push_back(log.opt_exceeded_budget);
+      pub_opt_budget_.publish(budget_msg);
+    }
+
     if (par_.visual)
     {
       // Delete markers to publish stuff
@@ -449,8 +549,8 @@ void PantherRos::replanCB(const ros::TimerEvent& e)
 
     if (replanned)
     {
-      publishOwnTraj(pwp);
-      pwp_last_ = pwp;
+      pwp_last_ = &panther_ptr_->getCommittedPwp();  // Not copied: it's only modified by replan()
+      publishOwnTraj(*pwp_last_);
     }
     else
     {
@@ -458,7 +558,7 @@ void PantherRos::replanCB(const ros::TimerEvent& e)
 
       if (timer_stop_.elapsedSoFarMs() > 500.0)  // publish every half a second. TODO set as param
       {
-        publishOwnTraj(pwp_last_);  // This is needed because is drone DRONE1 stops, it needs to keep publishing his
+        publishOwnTraj(*pwp_last_);  // This is needed because is drone DRONE1 stops, it needs to keep publishing his
                                     // last planned trajectory, so that other drones can avoid it (even if DRONE1 was
                                     // very far from the other drones with it last successfully planned a trajectory).
                                     // Note that these trajectories are time-indexed, and the last position is taken if
@@ -535,8 +635,8 @@ void PantherRos::stateCB(const snapstack_msgs::State& msg)
 
   if (published_initial_position_ == false)
   {
-    pwp_last_ = createPwpFromStaticPosition(state_);
-    publishOwnTraj(pwp_last_);
+    pwp_initial_.fromPieceWisePol(createPwpFromStaticPosition(state_));
+    publishOwnTraj(pwp_initial_);
     published_initial_position_ = true;
   }
   if (panther_ptr_->IsTranslating() == true && par_.visual)
@@ -0,0 +1,158 @@
+/* ----------------------------------------------------------------------------
+ * Copyright 2021, Jesus Tordesillas Torres, Aerospace Controls Laboratory
+ * Massachusetts Institute of Technology
+ * All Rights Reserved
+ * Authors: Jesus Tordesillas, et al.
+ * See LICENSE file for the license information
+ * -------------------------------------------------------------------------- */
+
+// Solves again the NLPs saved by SolverIpopt (record_nlp_instances: true in panther.yaml) with different linear
+// solvers, to compare them with real data (see also other/bechmark_linear_solvers).
+// Usage:
+//    rosrun panther replay_nlp_instances mumps,ma27,ma57,ma97 /tmp/nlp_instance_*.bin
+// For each linear solver XX, the files op_XX.casadi and op_fixed_pos_XX.casadi are needed in
+// matlab/casadi_generated_files/ (run main.m with linear_solver_name='XX' and save_copy_for_replay=true). The
+// linear solver "default" uses op.casadi and op_fixed_pos.casadi
+
+#include <casadi/casadi.hpp>
+#include <ros/package.h>
+
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+
+#include "nlp_instance.hpp"
+#include "termcolor.hpp"
+#include "timer.hpp"
+
+typedef PANTHER_timers::Timer MyTimer;
+
+using namespace termcolor;
+
+struct statsLinearSolver
+{
+  double total_ms = 0.0;
+  int total_iter = 0;
+  int num_with_iter = 0;  // instances whose iteration count is available
+  int num_solved = 0;
+  int num_instances = 0;
+};
+
+int main(int argc, char** argv)
+{
+  if (argc < 3)
+  {
+    std::cout << "Usage: replay_nlp_instances solver1,solver2,... file1.bin file2.bin ..." << std::endl;
+    std::cout << "Example: replay_nlp_instances mumps,ma27,ma57,ma97 /tmp/nlp_instance_*.bin" << std::endl;
+    return 1;
+  }
+
+  std::vector<std::string> linear_solvers;
+  std::stringstream ss(argv[1]);
+  std::string tmp;
+  while (std::getline(ss, tmp, ','))
+  {
+    linear_solvers.push_back(tmp);
+  }
+
+  std::string folder = ros::package::getPath("panther") + "/matlab/casadi_generated_files/";
+
+  // casadi functions (and the index of the instruction that calls IPOPT in each one), loaded only when needed. Key is
+  // function_name + "_" + linear solver
+  std::map<std::string, casadi::Function> all_cf;
+  std::map<std::string, int> all_index_instruction;
+  std::map<std::string, statsLinearSolver> all_stats;
+
+  std::cout << std::left << std::setw(30) << "instance" << std::setw(14) << "function" << std::setw(10) << "solver"
+            << std::setw(30) << "status" << std::setw(8) << "iter" << std::setw(12) << "ms" << std::endl;
+
+  for (int i = 2; i < argc; i++)
+  {
+    std::string file = argv[i];
+    mt::nlpInstance instance;
+    if (loadNlpInstance(file, instance) == false)
+    {
+      continue;
+    }
+
+    std::string name_instance = file.substr(file.find_last_of('/') + 1);
+
+    std::cout << std::setw(30) << name_instance << std::setw(14) << instance.function_name << std::setw(10)
+              << "recorded" << std::setw(30) << instance.status << std::setw(8) << instance.iter_count << std::setw(12)
+              << instance.ms_opt << std::endl;
+
+    for (auto& linear_solver : linear_solvers)
+    {
+      std::string key = instance.function_name + "_" + linear_solver;
+      if (all_cf.count(key) == 0)
+      {
+        std::string name_file =
+            (linear_solver == "default") ? (instance.function_name + ".casadi") : (key + ".casadi");
+        try
+        {
+          all_cf[key] = casadi::Function::load(folder + name_file);
+          all_index_instruction[key] = getIndexInstructionSolver(all_cf[key], folder, instance.function_name);
+        }
+        catch (std::exception& e)
+        {
+          std::cout << red << "Could not load " << folder + name_file << ": " << e.what() << reset << std::endl;
+          return 1;
+        }
+        if (all_index_instruction[key] < 0)
+        {
+          std::cout << red << "The call to IPOPT was not found in " << folder + name_file << reset << std::endl;
+          return 1;
+        }
+      }
+
+      casadi::Function& cf = all_cf[key];
+
+      std::map<std::string, casadi::DM> arguments = instance.arguments;
+      MyTimer timer(true);
+      std::map<std::string, casadi::DM> result = cf(arguments);
+      double ms = timer.elapsedSoFarMs();
+
+      std::string status;
+      int iter_count;
+      getStatusAndIterCount(cf, all_index_instruction[key], status, iter_count);
+
+      bool success = (status == "Solve_Succeeded" || status == "Solved_To_Acceptable_Level");
+
+      std::cout << std::setw(30) << name_instance << std::setw(14) << instance.function_name << std::setw(10)
+                << linear_solver << (success ? green : red) << std::setw(30) << status << reset << std::setw(8)
+                << iter_count << std::setw(12) << ms << std::endl;
+
+      statsLinearSolver& stats = all_stats[linear_solver];
+      stats.total_ms += ms;
+      if (iter_count >= 0)  // -1 if it's not available
+      {
+        stats.total_iter += iter_count;
+        stats.num_with_iter++;
+      }
+      stats.num_solved += success;
+      stats.num_instances++;
+    }
+  }
+
+  std::cout << bold << "\nSummary:" << reset << std::endl;
+  std::cout << std::setw(10) << "solver" << std::setw(14) << "solved" << std::setw(14) << "mean iter" << std::setw(14)
+            << "no iter" << std::setw(14) << "mean ms" << std::endl;
+  for (auto& linear_solver : linear_solvers)
+  {
+    statsLinearSolver& stats = all_stats[linear_solver];
+    if (stats.num_instances == 0)
+    {
+      continue;
+    }
+    // The mean of the iterations only uses the instances that have it ("no iter" is the number of the other ones)
+    std::string mean_iter = (stats.num_with_iter > 0) ? std::to_string(stats.total_iter / double(stats.num_with_iter)) :
+                                                        "-";
+    std::cout << std::setw(10) << linear_solver << std::setw(14)
+              << (std::to_string(stats.num_solved) + "/" + std::to_string(stats.num_instances)) << std::setw(14)
+              << mean_iter << std::setw(14) << (stats.num_instances - stats.num_with_iter) << std::setw(14)
+              << stats.total_ms / stats.num_instances << std::endl;
+  }
+
+  return 0;
+}
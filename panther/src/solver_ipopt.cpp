@@ -20,6 +20,9 @@
 #include <iostream>
 #include <vector>
 #include <fstream>
+#include <limits>
+#include <ctime>
+#include <unistd.h>
 
 #include <ros/package.h>
 
@@ -44,25 +47,18 @@ SolverIpopt::SolverIpopt(mt::parameters &par, std::shared_ptr<mt::log> log_ptr)
   Ny_ = (par_.num_seg + par_.deg_yaw - 1);
   ///////////////////////////////////////
 
-  mt::basisConverter basis_converter;
   // basis used for collision
   if (par_.basis == "MINVO")
   {
     basis_ = MINVO;
-    M_pos_bs2basis_ = basis_converter.getMinvoDeg3Converters(par_.num_seg);
-    M_vel_bs2basis_ = basis_converter.getMinvoDeg2Converters(par_.num_seg);
   }
   else if (par_.basis == "BEZIER")
   {
     basis_ = BEZIER;
-    M_pos_bs2basis_ = basis_converter.getBezierDeg3Converters(par_.num_seg);
-    M_vel_bs2basis_ = basis_converter.getBezierDeg2Converters(par_.num_seg);
   }
   else if (par_.basis == "B_SPLINE")
   {
     basis_ = B_SPLINE;
-    M_pos_bs2basis_ = basis_converter.getBSplineDeg3Converters(par_.num_seg);
-    M_vel_bs2basis_ = basis_converter.getBSplineDeg2Converters(par_.num_seg);
   }
   else
   {
@@ -71,6 +67,8 @@ SolverIpopt::SolverIpopt(mt::parameters &par, std::shared_ptr<mt::log> log_ptr)
     abort();
   }
 
+  basis_tables_ = mt::basisTables::get(par_.basis);  // Also used to evaluate the position spline
+
   ///////////////////////////////////////
   ///////////////////////////////////////
 
@@ -80,11 +78,30 @@ SolverIpopt::SolverIpopt(mt::parameters &par, std::shared_ptr<mt::log> log_ptr)
       std::unique_ptr<OctopusSearch>(new OctopusSearch(par_.basis, par_.num_seg, par_.deg_pos, par_.alpha_shrink));
 
   std::string folder = ros::package::getPath("panther") + "/matlab/casadi_generated_files/";
-  std::fstream myfile(folder + "index_instruction.txt", std::ios_base::in);
-  myfile >> index_instruction_;
-  cf_op_ = casadi::Function::load(folder + "op.casadi");
+  // Same options as in main.m. The time budget of each solve is enforced by CasadiOp, below max_cpu_time
+  casadi::Dict opts_ipopt;
+  opts_ipopt["print_level"] = par_.print_level_ipopt;
+  opts_ipopt["print_frequency_iter"] = std::numeric_limits<int>::max();
+  opts_ipopt["linear_solver"] = par_.linear_solver_ipopt;
+  opts_ipopt["max_cpu_time"] = par_.max_cpu_time_ipopt;
+  casadi::Dict opts_solver;
+  opts_solver["expand"] = true;
+  opts_solver["print_time"] = true;
+  opts_solver["ipopt"] = opts_ipopt;
+
+  if (op_.load(folder, "op", opts_solver) == false || op_fixed_pos_.load(folder, "op_fixed_pos", opts_solver) == false)
+  {
+    std::cout << red << "Run main.m to generate the casadi files. Aborting" << reset << std::endl;
+    abort();
+  }
   // cf_op_force_final_pos_ = casadi::Function::load(folder + "op_force_final_pos.casadi");
-  cf_fixed_pos_op_ = casadi::Function::load(folder + "op_fixed_pos.casadi");
+
+  // The NLP instances of different runs (and of different agents) are saved with different names
+  char date_time[32];
+  std::time_t now = std::time(nullptr);
+  std::strftime(date_time, sizeof(date_time), "%Y%m%d_%H%M%S", std::localtime(&now));
+  prefix_nlp_instances_ = par_.folder_nlp_instances + "nlp_instance_" + std::string(date_time) + "_" +
+                          std::to_string(getpid()) + "_";
   cf_fit_yaw_ = casadi::Function::load(folder + "fit_yaw.casadi");
   cf_visibility_ = casadi::Function::load(folder + "visibility.casadi");
 
@@ -107,7 +124,7 @@ SolverIpopt::SolverIpopt(mt::parameters &par, std::shared_ptr<mt::log> log_ptr)
     }
   }
 
-  //////////////////////////////////////// CONSTRUCT THE GRAPH FOR THE YAW SEARCH
+  //////////////////////////////////////// DATA FOR THE YAW SEARCH
   ////////////////////////////////////////////////////////////////////////////////
 
   num_of_yaw_per_layer_ = par_.num_of_yaw_per_layer;
@@ -119,55 +136,30 @@ SolverIpopt::SolverIpopt(mt::parameters &par, std::shared_ptr<mt::log> log_ptr)
     vector_yaw_samples_(j) = -M_PI + j * 2 * M_PI / num_of_yaw_per_layer_;  // \in [-pi, pi]
   }
 
-  // mygraph_t mygraph_(0);  // start a graph with 0 vertices
-  mygraph_.clear();
-
-  // create all the vertexes and add them to the graph
-  std::vector<std::vector<vd>> all_vertexes_tmp(num_of_layers_ - 1, std::vector<vd>(num_of_yaw_per_layer_));  // TODO
-  all_vertexes_ = all_vertexes_tmp;
-  std::vector<vd> tmp(1);  // first layer only one element
-  all_vertexes_.insert(all_vertexes_.begin(), tmp);
-
-  // https://stackoverflow.com/questions/47904550/should-i-keep-track-of-vertex-descriptors-in-boost-graph-library
-
-  double y0_tmp = 0.0;  // this value will be updated at the start of each iteration
+  yaw_samples_ = static_cast<std::vector<double>>(vector_yaw_samples_);
+  for (auto yaw : yaw_samples_)
+  {
+    cos_yaw_samples_.push_back(cos(yaw));
+    sin_yaw_samples_.push_back(sin(yaw));
+  }
 
-  // add rest of the vertexes
-  for (size_t i = 0; i < num_of_layers_; i++)  // i is the index of each layer
+  // Distances between the yaw samples (they don't change between iterations)
+  dist_yaw_samples_.resize(num_of_yaw_per_layer_ * num_of_yaw_per_layer_);
+  for (int j = 0; j < num_of_yaw_per_layer_; j++)
   {
-    size_t num_of_circles_layer_i = (i == 0) ? 1 : num_of_yaw_per_layer_;
-    for (size_t j = 0; j < num_of_circles_layer_i; j++)  // j is the index of each  circle in the layer i
+    for (int k = 0; k < num_of_yaw_per_layer_; k++)
     {
-      vd vertex1 = boost::add_vertex(mygraph_);
-      all_vertexes_[i][j] = vertex1;
-      mygraph_[vertex1].yaw = (i == 0) ? y0_tmp : double(vector_yaw_samples_(j));
-      mygraph_[vertex1].layer = i;
-      mygraph_[vertex1].circle = j;
-      // mygraph_[vertex1].print();
-      // std::cout << "So far, the graph has " << num_vertices(mygraph_) << "vertices" << std::endl;
+      dist_yaw_samples_[j * num_of_yaw_per_layer_ + k] = fabs(wrapFromMPitoPi(yaw_samples_[j] - yaw_samples_[k]));
     }
   }
+  vis_matrix_.resize(num_of_layers_ * num_of_yaw_per_layer_);
+  dp_transition_.resize(num_of_yaw_per_layer_ * num_of_yaw_per_layer_);
+  dp_cost_.resize(2 * num_of_yaw_per_layer_);
+  dp_predecessor_.resize(num_of_layers_ * num_of_yaw_per_layer_);
 
-  for (size_t i = 0; i < (num_of_layers_ - 1); i++)  // i is the number of layers
+  if (par_.use_boost_yaw_search == true)
   {
-    size_t num_of_circles_layer_i = (i == 0) ? 1 : num_of_yaw_per_layer_;
-
-    for (size_t j = 0; j < num_of_circles_layer_i; j++)  // j is the circle index of layer i
-    {
-      for (size_t j_next = 0; j_next < num_of_yaw_per_layer_; j_next++)
-      {
-        vd index_vertex1 = all_vertexes_[i][j];
-        vd index_vertex2 = all_vertexes_[i + 1][j_next];
-
-        // std::cout <<  mygraph_[index_vertex2].layer << ", " << mygraph_[index_vertex2].circle
-        //           << std::endl;
-        // std::cout <<  i + 1 << ", " << j_next << std::endl;
-
-        edge_descriptor e;
-        bool inserted;
-        boost::tie(e, inserted) = add_edge(index_vertex1, index_vertex2, mygraph_);
-      }
-    }
+    createBoostYawGraph();
   }
 
   ////////////////////////////////////////
@@ -413,8 +405,11 @@ bool SolverIpopt::optimize()
 {
   std::cout << "in SolverIpopt::optimize" << std::endl;
 
+  opt_timer_.tic();
+
   // reset some stuff
   traj_solution_.clear();
+  yaw_job_pending_ = false;
   bool guess_found = generateAStarGuess();  // I obtain q_quess_, n_guess_, d_guess_
   if (guess_found == false)
   {
@@ -532,6 +527,13 @@ bool SolverIpopt::optimize()
   // }
   ////////////////////////// CALL THE SOLVER
   std::map<std::string, casadi::DM> result;
+
+  // Time left for IPOPT (what the guesses haven't used of max_runtime_). IPOPT is stopped when it's over (see
+  // CasadiOp), and anyway by its max_cpu_time, so the budget can't be larger than that
+  double ms_budget_opt = 1000 * max_runtime_ - opt_timer_.elapsedSoFarMs();
+  saturate(ms_budget_opt, 1000 * par_.lower_bound_runtime_snlopt, 1000 * par_.max_cpu_time_ipopt);
+  log_ptr_->ms_budget_opt = ms_budget_opt;
+
   log_ptr_->tim_opt.tic();
   // if (par_.force_final_pos == true)
   // {
@@ -544,6 +546,8 @@ bool SolverIpopt::optimize()
 
   /////////////////////////////////
 
+  bool yaw_rejected = false;  // Only in py mode (without pipelining): the yaw solve failed or was skipped
+
   if (par_.mode == "panther" && focus_on_obstacle_ == true)
   {
     map_arguments["c_yaw_smooth"] = par_.c_yaw_smooth;
@@ -554,7 +558,7 @@ bool SolverIpopt::optimize()
     // std::cout << "c_pos_smooth= " << map_arguments["c_pos_smooth"] << std::endl;
     // std::cout << "c_final_pos= " << map_arguments["c_final_pos"] << std::endl;
     // std::cout << "c_final_yaw= " << map_arguments["c_final_yaw"] << std::endl;
-    result = cf_op_(map_arguments);
+    result = callOptimizer(op_, map_arguments, ms_budget_opt);
   }
   else if (par_.mode == "py" && focus_on_obstacle_ == true)
   {
@@ -562,28 +566,62 @@ bool SolverIpopt::optimize()
     map_arguments["c_yaw_smooth"] = 0.0;
     map_arguments["c_fov"] = 0.0;
     std::cout << bold << green << "Optimizing first for POSITION!" << reset << std::endl;
-    result = cf_op_(map_arguments);
+    result = callOptimizer(op_, map_arguments, ms_budget_opt);
 
     // Use the position control points obtained for solve for yaw. Note that here the pos spline is FIXED
     map_arguments["c_yaw_smooth"] = par_.c_yaw_smooth;
     map_arguments["c_fov"] = par_.c_fov;
     map_arguments["pCPs"] = result["pCPs"];
 
-    std::cout << bold << green << "and then for YAW!" << reset << std::endl;
-
-    std::map<std::string, casadi::DM> result_for_yaw = cf_fixed_pos_op_(map_arguments);
-
-    //////////// Debugging
-    if (result["yCPs"].columns() != result_for_yaw["yCPs"].columns())
+    if (par_.pipelined_py == true)
     {
-      std::cout << "Sizes do not match. This is likely because you did not run main.m with both pos_is_fixed=true and "
-                   "pos_is_fixed=false"
-                << std::endl;
-      abort();
+      // The yaw will be solved later (see solveYawJob), once the position has been committed. Meanwhile, the plan
+      // will use the yaw that goes to final_state_.yaw as fast as possible
+      std::cout << bold << green << "and YAW will be solved later!" << reset << std::endl;
+      yaw_job_.arguments = map_arguments;
     }
-    ///////////////////
+    else
+    {
+      std::cout << bold << green << "and then for YAW!" << reset << std::endl;
+
+      // Both solves share the budget. If the position solve used all of it, the yaw is not solved (and the one that
+      // goes to final_state_.yaw is used instead)
+      double ms_budget_yaw = ms_budget_opt - log_ptr_->tim_opt.elapsedSoFarMs();
+      if (ms_budget_yaw <= 0.0)
+      {
+        std::cout << yellow << "No budget left for the yaw, using the one that goes to the final yaw" << reset
+                  << std::endl;
+        yaw_rejected = true;
+      }
+      else
+      {
+        std::map<std::string, casadi::DM> result_for_yaw =
+            callOptimizer(op_fixed_pos_, map_arguments, ms_budget_yaw);
 
-    result["yCPs"] = result_for_yaw["yCPs"];
+        //////////// Debugging
+        if (result["yCPs"].columns() != result_for_yaw["yCPs"].columns())
+        {
+          std::cout << "Sizes do not match. This is likely because you did not run main.m with both "
+                       "pos_is_fixed=true and pos_is_fixed=false"
+                    << std::endl;
+          abort();
+        }
+        ///////////////////
+
+        std::string status_yaw;
+        bool truncated_yaw;
+        if (isSolutionUsable(op_fixed_pos_, status_yaw, truncated_yaw))
+        {
+          result["yCPs"] = result_for_yaw["yCPs"];
+        }
+        else
+        {
+          std::cout << yellow << "Yaw rejected (" << status_yaw << "), using the one that goes to the final yaw"
+                    << reset << std::endl;
+          yaw_rejected = true;
+        }
+      }
+    }
 
     // The costs logged will not be the right ones, so don't use them in this mode
   }
@@ -592,7 +630,7 @@ bool SolverIpopt::optimize()
     map_arguments["c_yaw_smooth"] = 0.0;
     map_arguments["c_fov"] = 0.0;
     std::cout << bold << green << "Optimizing for POSITION!" << reset << std::endl;
-    result = cf_op_(map_arguments);
+    result = callOptimizer(op_, map_arguments, ms_budget_opt);
   }
   else
   {
@@ -609,15 +647,16 @@ bool SolverIpopt::optimize()
   // auto optimstatus = cf_op_.instruction_MX(index_instruction_).which_function().stats(1)["return_status"];
 
   std::string optimstatus;
-  // if (par_.force_final_pos == true)
-  // {
-  //   optimstatus = std::string(
-  //       cf_op_force_final_pos_.instruction_MX(index_instruction_).which_function().stats(1)["return_status"]);
-  // }
-  // else
-  // {
-  optimstatus = std::string(cf_op_.instruction_MX(index_instruction_).which_function().stats(1)["return_status"]);
-  // }
+  bool solution_usable = isSolutionUsable(op_, optimstatus, log_ptr_->opt_truncated_by_deadline);
+
+  ///////////////// CHECK THE DEADLINE
+  log_ptr_->opt_exceeded_budget = (log_ptr_->tim_opt.getMsSaved() > ms_budget_opt);
+
+  std::cout << (log_ptr_->opt_exceeded_budget ? red : reset) << "IPOPT: budget= " << ms_budget_opt
+            << " ms, actual= " << log_ptr_->tim_opt.getMsSaved()
+            << " ms, truncated= " << log_ptr_->opt_truncated_by_deadline
+            << (op_.hasDeadline() ? "" : " (budget not enforced: run main.m to generate op_pre/_nlp/_post.casadi)")
+            << reset << std::endl;
 
   ////// Example of how to obtain inf_pr and inf_du
   // std::vector<double> inf_pr_all = std::map<std::string, casadi::GenericType>(
@@ -642,7 +681,7 @@ bool SolverIpopt::optimize()
   std::cout << "optimstatus= " << optimstatus << std::endl;
   // See names here:
   // https://github.com/casadi/casadi/blob/fadc86444f3c7ab824dc3f2d91d4c0cfe7f9dad5/casadi/interfaces/ipopt/ipopt_interface.cpp
-  if (optimstatus == "Solve_Succeeded" || optimstatus == "Solved_To_Acceptable_Level")
+  if (solution_usable)
   {
     std::cout << green << "IPOPT found a solution" << reset << std::endl;
     log_ptr_->success_opt = true;
@@ -658,9 +697,11 @@ bool SolverIpopt::optimize()
     // std::cout << "all_w_velfewrtworld=" << map_arguments["all_w_velfewrtworld"] << std::endl;
 
     ///////////////////////////////////
+    bool yaw_solved_later = (par_.mode == "py" && par_.pipelined_py == true && focus_on_obstacle_ == true);
+
     if (par_.mode == "panther" || par_.mode == "py")
     {
-      if (focus_on_obstacle_ == true)
+      if (focus_on_obstacle_ == true && yaw_solved_later == false && yaw_rejected == false)
       {
         qy = static_cast<std::vector<double>>(result["yCPs"]);
         std::cout << "qy.size()= " << qy.size() << std::endl;
@@ -753,12 +794,106 @@ bool SolverIpopt::optimize()
   traj_solution_.back().jerk = Eigen::Vector3d::Zero();
   traj_solution_.back().ddyaw = final_state_.ddyaw;
 
+  if (yaw_solved_later)
+  {
+    yaw_job_.qp = qp;
+    yaw_job_.knots = knots_;
+    yaw_job_pending_ = true;
+  }
+
   // Uncomment the following line if you wanna visualize the planes
   // fillPlanesFromNDQ(n_, d_, qp);
 
   return true;
 }
 
+bool SolverIpopt::getPendingYawJob(yawJob &job)
+{
+  if (yaw_job_pending_ == false)
+  {
+    return false;
+  }
+  job = yaw_job_;
+  yaw_job_pending_ = false;
+  return true;
+}
+
+// Returns in traj_yaw the trajectory (sampled every par_.dc) whose yaw fields are the solution of the yaw problem
+bool SolverIpopt::solveYawJob(const yawJob &job, mt::trajectory &traj_yaw)
+{
+  std::map<std::string, casadi::DM> arguments = job.arguments;
+  std::map<std::string, casadi::DM> result_for_yaw = op_fixed_pos_.solve(arguments, 1000 * par_.max_cpu_time_ipopt);
+
+  std::string optimstatus;
+  bool truncated;
+  if (!isSolutionUsable(op_fixed_pos_, optimstatus, truncated))
+  {
+    std::cout << red << "IPOPT failed to find a solution for yaw (" << optimstatus << ")" << reset << std::endl;
+    return false;
+  }
+
+  std::vector<Eigen::Vector3d> qp = job.qp;
+  std::vector<double> qy = static_cast<std::vector<double>>(result_for_yaw["yCPs"]);
+  Eigen::RowVectorXd knots = job.knots;
+  mt::PieceWisePol pwp_unused;
+
+  CPs2TrajAndPwp(qp, qy, traj_yaw, pwp_unused, 3, 2, knots, par_.dc);
+
+  return true;
+}
+
+// Returns true if the last solution of op can be used: IPOPT converged, or it was stopped by the deadline (or by its
+// max_cpu_time) at an iterate that is (almost) feasible, see max_inf_pr_truncated_opt
+bool SolverIpopt::isSolutionUsable(CasadiOp &op, std::string &status, bool &truncated)
+{
+  int iter_count;
+  op.getStatusAndIterCount(status, iter_count);
+
+  truncated = (status == "User_Requested_Stop" || status == "Maximum_CpuTime_Exceeded" ||
+               status == "Maximum_WallTime_Exceeded");
+  if (!truncated)
+  {
+    return (status == "Solve_Succeeded" || status == "Solved_To_Acceptable_Level");
+  }
+
+  double inf_pr = op.getInfPrLastIterate();
+  bool accept_truncated = (inf_pr <= par_.max_inf_pr_truncated_opt);
+  std::cout << yellow << op.getName() << " truncated by the deadline, inf_pr= " << inf_pr
+            << (accept_truncated ? " (accepting last iterate)" : " (rejecting last iterate)") << reset << std::endl;
+  return accept_truncated;
+}
+
+// Solves op (stopping IPOPT after ms_budget milliseconds), and saves the problem solved (if
+// par_.record_nlp_instances==true) so that it can be solved again offline with replay_nlp_instances
+std::map<std::string, casadi::DM> SolverIpopt::callOptimizer(CasadiOp &op, std::map<std::string, casadi::DM> &arguments,
+                                                            double ms_budget)
+{
+  MyTimer timer(true);
+  std::map<std::string, casadi::DM> result = op.solve(arguments, ms_budget);
+  double ms_opt = timer.elapsedSoFarMs();
+
+  if (par_.record_nlp_instances == false)
+  {
+    return result;
+  }
+
+  mt::nlpInstance instance;
+  instance.function_name = op.getName();
+  instance.ms_opt = ms_opt;
+  instance.ms_budget_opt = ms_budget;
+  instance.arguments = arguments;
+  instance.result = result;
+  op.getStatusAndIterCount(instance.status, instance.iter_count);
+
+  std::string file = prefix_nlp_instances_ + std::to_string(num_of_nlp_instances_recorded_) + ".bin";
+  if (saveNlpInstance(file, instance))
+  {
+    num_of_nlp_instances_recorded_++;
+  }
+
+  return result;
+}
+
 void SolverIpopt::getSolution(mt::PieceWisePol &solution)
 {
   solution = pwp_solution_;
@@ -45,13 +45,13 @@ void SolverIpopt::printQND(std::vector<Eigen::Vector3d> &q, std::vector<Eigen::V
 void SolverIpopt::transformPosBSpline2otherBasis(const Eigen::Matrix<double, 3, 4> &Qbs,
                                                  Eigen::Matrix<double, 3, 4> &Qmv, int interval)
 {
-  Qmv = Qbs * M_pos_bs2basis_[interval];
+  Qmv = Qbs * basis_tables_->getMPosBs2Basis(interval, par_.num_seg);
 }
 
 void SolverIpopt::transformVelBSpline2otherBasis(const Eigen::Matrix<double, 3, 3> &Qbs,
                                                  Eigen::Matrix<double, 3, 3> &Qmv, int interval)
 {
-  Qmv = Qbs * M_vel_bs2basis_[interval];
+  Qmv = Qbs * basis_tables_->getMVelBs2Basis(interval, par_.num_seg);
 }
 
 void SolverIpopt::saturateQ(std::vector<Eigen::Vector3d> &q)
@@ -20,6 +20,7 @@
 // #include <geometry_msgs/Point.h>
 #include <std_msgs/Float32MultiArray.h>
 #include <std_msgs/Int32MultiArray.h>
+#include <std_msgs/UInt8MultiArray.h>
 
 #include <pcl_conversions/pcl_conversions.h>
 #include <pcl/point_cloud.h>
@@ -37,7 +38,9 @@
 
 #include <visualization_msgs/MarkerArray.h>
 #include <visualization_msgs/Marker.h>
+#include <future>
 #include <limits>
+#include <thread>
 #include <utility>
 
 #include <pcl/point_types.h>
@@ -45,7 +48,6 @@
 
 #include "panther_types.hpp"
 
-#include "Hungarian.h"
 #include "tracker_predictor.hpp"
 
 #include <ros/package.h>  //TODO: remove this ros dependency
@@ -58,20 +60,24 @@
 
 #include <panther_msgs/DynTraj.h>
 
-#include <pcl/filters/voxel_grid.h>
-#include <pcl/filters/approximate_voxel_grid.h>
-
 #include <tf2_ros/transform_listener.h>
 // #include <tf2_geometry_msgs/tf2_geometry_msgs.h>
 #include <tf2_sensor_msgs/tf2_sensor_msgs.h>
-#include <pcl/filters/passthrough.h>
-#include <pcl/filters/crop_box.h>
-#include <pcl/common/transforms.h>
 
 using namespace termcolor;
 
-TrackerPredictor::TrackerPredictor(ros::NodeHandle nh) : nh_(nh)
+const int FIRST_TRACK_ID = 1000;  // The ids of the agents (see PantherRos) are smaller than this
+
+TrackerPredictor::TrackerPredictor(ros::NodeHandle nh)
+  : nh_(nh)
+  , grid_clustering_(std::thread::hardware_concurrency())
+  , queue_preprocessing_(1)
+  , queue_clustering_(2)
+  , queue_association_(2)
+  , queue_publishing_(2)
 {
+  timer_startup_.tic();
+
   // safeGetParam(nh_, "z_ground", z_ground_);
   safeGetParam(nh_, "x_min", x_min_);
   safeGetParam(nh_, "x_max", x_max_);
@@ -91,13 +97,35 @@ TrackerPredictor::TrackerPredictor(ros::NodeHandle nh) : nh_(nh)
   safeGetParam(nh_, "max_cluster_size", max_cluster_size_);
   safeGetParam(nh_, "min_dim_cluster_size", min_dim_cluster_size_);
   safeGetParam(nh_, "leaf_size_filter", leaf_size_filter_);
-
-  for (int i = min_size_sliding_window_; i <= max_size_sliding_window_; i++)
+  safeGetParam(nh_, "use_grid_clustering", use_grid_clustering_);
+  safeGetParam(nh_, "deg_pos_prediction", deg_pos_prediction_);
+  safeGetParam(nh_, "secs_prediction", secs_prediction_);
+  safeGetParam(nh_, "use_native_prediction", use_native_prediction_);
+  safeGetParam(nh_, "validate_native_prediction", validate_native_prediction_);
+  safeGetParam(nh_, "use_kalman_prediction", use_kalman_prediction_);
+  safeGetParam(nh_, "kalman_process_noise", kalman_process_noise_);
+  safeGetParam(nh_, "kalman_measurement_noise", kalman_measurement_noise_);
+  safeGetParam(nh_, "use_async_logging", use_async_logging_);
+  safeGetParam(nh_, "publish_traj_batch", publish_traj_batch_);
+  safeGetParam(nh_, "publish_traj_strings", publish_traj_strings_);
+  safeGetParam(nh_, "visualization_rate", visualization_rate_);
+  safeGetParam(nh_, "preload_prediction_functions", preload_prediction_functions_);
+  safeGetParam(nh_, "load_prediction_functions_in_background", load_prediction_functions_in_background_);
+
+  next_track_id_ = FIRST_TRACK_ID;
+
+  // The CasADi functions get_mean_variance_pred_N are loaded when they are first needed (see
+  // getMeanVariancePredFunction()), except the ones in preload_prediction_functions
+  casadi_folder_ = ros::package::getPath("panther") + "/matlab/casadi_generated_files/";
+  for (int window_size : preload_prediction_functions_)
   {
-    std::string folder = ros::package::getPath("panther") + "/matlab/casadi_generated_files/";
-
-    cf_get_mean_variance_pred_[i] =
-        casadi::Function::load(folder + "get_mean_variance_pred_" + std::to_string(i) + ".casadi");
+    if (window_size < min_size_sliding_window_ || window_size > max_size_sliding_window_)
+    {
+      std::cout << yellow << "preload_prediction_functions: ignoring " << window_size << " (not in ["
+                << min_size_sliding_window_ << ", " << max_size_sliding_window_ << "])" << reset << std::endl;
+      continue;
+    }
+    getMeanVariancePredFunction(window_size);
   }
 
   tf_listener_ptr_ = std::unique_ptr<tf2_ros::TransformListener>(
@@ -106,9 +134,11 @@ TrackerPredictor::TrackerPredictor(ros::NodeHandle nh) : nh_(nh)
   pub_marker_predicted_traj_ = nh_.advertise<visualization_msgs::MarkerArray>("marker_predicted_traj", 1);
   pub_marker_bbox_obstacles_ = nh_.advertise<visualization_msgs::MarkerArray>("marker_bbox_obstacles", 1);
   pub_traj_ = nh_.advertise<panther_msgs::DynTraj>("trajs_predicted", 1, true);  // The last boolean is latched or not
+  pub_traj_batch_ = nh_.advertise<std_msgs::UInt8MultiArray>("trajs_predicted_batch", 1, true);
   // pub_pcloud_filtered_ = nh_.advertise<sensor_msgs::PointCloud2>("pcloud_filtered", 1);
   pub_pcloud_filtered_ = nh_.advertise<pcl::PointCloud<pcl::PointXYZ>>("pcloud_filtered", 1);
   pub_log_ = nh_.advertise<panther_msgs::Logtp>("logtp", 1);
+  pub_latency_ = nh_.advertise<std_msgs::Float32MultiArray>("pipeline_latency", 1);
 
   int i;
 
@@ -118,11 +148,6 @@ TrackerPredictor::TrackerPredictor(ros::NodeHandle nh) : nh_(nh)
 
   tree_ = pcl::search::KdTree<pcl::PointXYZ>::Ptr(new pcl::search::KdTree<pcl::PointXYZ>);
 
-  input_cloud2_ = pcl::PointCloud<pcl::PointXYZ>::Ptr(new pcl::PointCloud<pcl::PointXYZ>);
-  input_cloud3_ = pcl::PointCloud<pcl::PointXYZ>::Ptr(new pcl::PointCloud<pcl::PointXYZ>);
-  input_cloud4_ = pcl::PointCloud<pcl::PointXYZ>::Ptr(new pcl::PointCloud<pcl::PointXYZ>);
-  input_cloud_ = pcl::PointCloud<pcl::PointXYZ>::Ptr(new pcl::PointCloud<pcl::PointXYZ>);
-  input_cloud1 = pcl::PointCloud<pcl::PointXYZ>::Ptr(new pcl::PointCloud<pcl::PointXYZ>);
   // ////////
   std::string param_name = "/SQ01s/panther/mode";
   std::string mode;
@@ -135,26 +160,107 @@ TrackerPredictor::TrackerPredictor(ros::NodeHandle nh) : nh_(nh)
 
   std::string folder = "/home/jtorde/Dropbox (MIT)/Research/Planning_project/PANTHER/bags_simulation/data/";
 
-  name_file_ = folder + mode + "_successive_detections.txt";
+  if (use_async_logging_)
+  {
+    // Successive detections and times of each frame, written by a background thread (see tp::AsyncLogger)
+    name_file_ = folder + mode + "_tracker_log.bin";
+    async_logger_ = std::unique_ptr<tp::AsyncLogger>(new tp::AsyncLogger(name_file_, 4096));
+  }
+  else
+  {
+    name_file_ = folder + mode + "_successive_detections.txt";
 
-  // // Delete content of the files
-  // // https://stackoverflow.com/questions/17032970/clear-data-inside-text-file-in-c
-  std::ofstream ofs;
-  ofs.open(name_file_, std::ofstream::out | std::ofstream::trunc);
-  ofs.close();
+    // // Delete content of the files
+    // // https://stackoverflow.com/questions/17032970/clear-data-inside-text-file-in-c
+    std::ofstream ofs;
+    ofs.open(name_file_, std::ofstream::out | std::ofstream::trunc);
+    ofs.close();
+  }
   // ///////
+
+  int num_preloaded = cf_get_mean_variance_pred_.size();  // Before starting loader_thread_
+  if (load_prediction_functions_in_background_)
+  {
+    loader_thread_ = std::thread([this]() {
+      for (int i = min_size_sliding_window_; i <= max_size_sliding_window_ && !stop_loader_thread_; i++)
+      {
+        getMeanVariancePredFunction(i);
+      }
+    });
+  }
+
+  stage_threads_.push_back(std::thread(&TrackerPredictor::preprocessingStage, this));
+  stage_threads_.push_back(std::thread(&TrackerPredictor::clusteringStage, this));
+  stage_threads_.push_back(std::thread(&TrackerPredictor::associationStage, this));
+  stage_threads_.push_back(std::thread(&TrackerPredictor::publishingStage, this));
+
+  std::cout << green << "TrackerPredictor: ready in " << timer_startup_.elapsedSoFarMs() << " ms ("
+            << num_preloaded << " prediction functions preloaded)" << reset << std::endl;
 }
 
-double TrackerPredictor::getCostRowColum(tp::cluster& a, tp::track& b, double time)
+TrackerPredictor::~TrackerPredictor()
 {
-  double result = (a.centroid - b.pwp_mean.eval(time)).norm();
-  // std::cout << "getCostRowColum= " << result << std::endl;
-  return result;
+  queue_preprocessing_.close();
+  queue_clustering_.close();
+  queue_association_.close();
+  queue_publishing_.close();
+  for (auto& thread : stage_threads_)
+  {
+    thread.join();
+  }
+
+  stop_loader_thread_ = true;
+  if (loader_thread_.joinable())
+  {
+    loader_thread_.join();
+  }
+}
+
+// Loads get_mean_variance_pred_<window_size>.casadi if it hasn't been loaded yet. It can be called from several threads
+casadi::Function& TrackerPredictor::getMeanVariancePredFunction(int window_size)
+{
+  {
+    std::lock_guard<std::mutex> lock(mtx_cf_get_mean_variance_pred_);
+    auto it = cf_get_mean_variance_pred_.find(window_size);
+    if (it != cf_get_mean_variance_pred_.end())
+    {
+      return it->second;  // The elements of a std::map are not moved when other ones are inserted
+    }
+  }
+
+  // Loaded without holding the mutex, so that the lookups of the window sizes already loaded are not blocked. If
+  // several threads load the same window size at the same time, the first one inserted is kept
+  PANTHER_timers::Timer timer(true);
+  casadi::Function f =
+      casadi::Function::load(casadi_folder_ + "get_mean_variance_pred_" + std::to_string(window_size) + ".casadi");
+  double ms_load = timer.elapsedSoFarMs();
+
+  std::lock_guard<std::mutex> lock(mtx_cf_get_mean_variance_pred_);
+  auto result = cf_get_mean_variance_pred_.insert(std::make_pair(window_size, f));
+  if (result.second)
+  {
+    ROS_INFO("[tracker_predictor] Loaded get_mean_variance_pred_%d in %.1f ms", window_size, ms_load);
+  }
+  return result.first->second;
 }
 
 void TrackerPredictor::addNewTrack(const tp::cluster& c)
 {
-  tp::track tmp(c, min_size_sliding_window_, max_size_sliding_window_);
+  // Reuse the memory of a removed track if possible
+  if (free_tracks_.empty())
+  {
+    all_tracks_.push_back(tp::track(c, min_size_sliding_window_, max_size_sliding_window_, next_track_id_));
+  }
+  else
+  {
+    all_tracks_.push_back(std::move(free_tracks_.back()));
+    free_tracks_.pop_back();
+    all_tracks_.back().reset(c, next_track_id_);
+  }
+  next_track_id_++;
+
+  tp::track& tmp = all_tracks_.back();
+  tmp.filter.init(c, kalman_measurement_noise_);
   // mt::PieceWisePol pwp;  // will have only one interval
   // pwp.times.push_back(time);
   // pwp.times.push_back(std::numeric_limits<double>::max());  // infty
@@ -172,8 +278,6 @@ void TrackerPredictor::addNewTrack(const tp::cluster& c)
 
   generatePredictedPwpForTrack(tmp);
 
-  all_tracks_.push_back(tmp);
-
   // std::cout << red << "End of addNewTrack" << reset << std::endl;
 
   // all_tracks_[last_id] = tmp;
@@ -182,515 +286,771 @@ void TrackerPredictor::addNewTrack(const tp::cluster& c)
 void TrackerPredictor::cloud_cb(const sensor_msgs::PointCloud2ConstPtr& pcl2ptr_msg)
 // void TrackerPredictor::cloud_cb(const pcl::PointCloud<pcl::PointXYZ>::ConstPtr& input_cloud1)
 {
-  log_.tim_total_tp.tic();
-  ///////////////////////////
-  ///////////////////////////
-  ///////////////////////////I need to do it here because if input_cloud is empty (after filtering), I return
-
-  // Increase by one the frames skipped on all the tracks
-  std::for_each(all_tracks_.begin(), all_tracks_.end(), [](tp::track& x) { x.num_frames_skipped++; });
-
-  // Erase the tracks that haven't been detected in many frames
-  int tracks_removed = 0;
-
-  std::fstream myfile;
-  myfile.open(name_file_, std::ios_base::app);
-
-  all_tracks_.erase(std::remove_if(all_tracks_.begin(), all_tracks_.end(),
-                                   [this, &tracks_removed, &myfile](const tp::track& x) mutable {
-                                     tracks_removed++;
-                                     bool should_be_removed = (x.num_frames_skipped > max_frames_skipped_);
-                                     if (should_be_removed)
-                                     {
-                                       myfile << x.getNumDiffSamples() << "\n";
-                                     }
-                                     return should_be_removed;
-                                   }),
-                    all_tracks_.end());
-  myfile.close();
-  // std::cout << "Removed " << tracks_removed << " tracks because too many frames skipped" << std::endl;
-
-  ///////////////////////////
-  ///////////////////////////
-  ///////////////////////////
-
-  // Convert to PCL
-  log_.tim_conversion_pcl.tic();
-  pcl::fromROSMsg(*pcl2ptr_msg, *input_cloud1);
-  log_.tim_conversion_pcl.toc();
-
-  // std::cout << "Input point cloud has " << input_cloud1->points.size() << " points" << std::endl;
-
-  std_msgs::Header header_pcloud;
-  pcl_conversions::fromPCL(input_cloud1->header, header_pcloud);
-
-  log_.tim_tf_transform.tic();
-  // Transform w_T_b
-  Eigen::Affine3d w_T_b;
-  geometry_msgs::TransformStamped transform_stamped;
-
-  try
+  std::shared_ptr<tp::frame> frame = getFreeFrame();
+  frame->log.tim_total_tp.tic();
+  frame->msg = pcl2ptr_msg;
+  frame->header = pcl2ptr_msg->header;
+
+  // Only the latest point cloud waits for the preprocessing stage (the older ones are discarded)
+  std::shared_ptr<tp::frame> discarded;
+  if (queue_preprocessing_.pushDiscardingOldest(frame, discarded))
   {
-    transform_stamped = tf_buffer_.lookupTransform("world", header_pcloud.frame_id, header_pcloud.stamp,
-                                                   ros::Duration(0.02));  // TODO: change this duration time?
-
-    // transform_stamped = tf_buffer_.lookupTransform("world", header_pcloud.frame_id,
-    // header_pcloud.stamp,ros::Duration(0.02));
-
-    w_T_b = tf2::transformToEigen(transform_stamped);
+    ROS_DEBUG("[tracker_predictor] Preprocessing stage busy, the oldest point cloud has been discarded");
+    releaseFrame(discarded);
   }
-  catch (tf2::TransformException& ex)
+}
+
+std::shared_ptr<tp::frame> TrackerPredictor::getFreeFrame()
+{
+  std::lock_guard<std::mutex> lock(mtx_free_frames_);
+  if (free_frames_.empty())
   {
-    ROS_DEBUG("[world_database_master_ros] OnGetTransform failed with %s", ex.what());
-    return;
+    return std::make_shared<tp::frame>();
   }
-  pcl::transformPointCloud(*input_cloud1, *input_cloud2_, w_T_b);
-  log_.tim_tf_transform.toc();
-
-  // Remove nans
-  log_.tim_remove_nans.tic();
-  std::vector<int> indices;
-  pcl::removeNaNFromPointCloud(*input_cloud2_, *input_cloud3_, indices);
-  log_.tim_remove_nans.toc();
-
-  log_.tim_passthrough.tic();
-
-  // // PassThrough Filter (remove the ground)
-  // pcl::PassThrough<pcl::PointXYZ> pass;
-  // pass.setInputCloud(input_cloud3_);
-  // pass.setFilterFieldName("z");
-  // pass.setFilterLimits(z_ground_, 1e6);
-  // // pass.filter(*input_cloud4_);
-  // pass.filter(*input_cloud_);
-
-  // Box filter https://stackoverflow.com/questions/45790828/remove-points-outside-defined-3d-box-inside-pcl-visualizer
-  pcl::CropBox<pcl::PointXYZ> boxFilter;
-  boxFilter.setMin(Eigen::Vector4f(x_min_, y_min_, z_min_, 1.0));
-  boxFilter.setMax(Eigen::Vector4f(x_max_, y_max_, z_max_, 1.0));
-  boxFilter.setInputCloud(input_cloud3_);
-  boxFilter.filter(*input_cloud4_);
-
-  log_.tim_passthrough.toc();
-
-  // Voxel grid filter
-  log_.tim_voxel_grid.tic();
-  // // pcl::ApproximateVoxelGrid<pcl::PointXYZ> sor; //this one crashes randomly on the NUC and Jetson
-  pcl::VoxelGrid<pcl::PointXYZ> sor;
-  sor.setInputCloud(input_cloud4_);
-  sor.setLeafSize(leaf_size_filter_, leaf_size_filter_, leaf_size_filter_);
-  sor.filter(*input_cloud_);
-  log_.tim_voxel_grid.toc();
-
-  log_.tim_pub_filtered.tic();
+  std::shared_ptr<tp::frame> frame = std::move(free_frames_.back());
+  free_frames_.pop_back();
+  return frame;
+}
 
-  // Publish filtered point cloud
+void TrackerPredictor::releaseFrame(std::shared_ptr<tp::frame>& frame)
+{
+  frame->reset();
+  std::lock_guard<std::mutex> lock(mtx_free_frames_);
+  free_frames_.push_back(std::move(frame));
+}
 
-  // Option 1
-  sensor_msgs::PointCloud2 filtered_pcl2_msg;
-  pcl::toROSMsg(*input_cloud_, filtered_pcl2_msg);
-  filtered_pcl2_msg.header.frame_id = "world";
-  filtered_pcl2_msg.header.stamp = ros::Time::now();
-  pub_pcloud_filtered_.publish(filtered_pcl2_msg);
+void TrackerPredictor::preprocessingStage()
+{
+  std::shared_ptr<tp::frame> frame;
+  while (queue_preprocessing_.pop(frame))
+  {
+    frame->log.tim_stage_preprocessing.tic();
 
-  // Option 2, crashes randomly on the NUC and Jetson
-  // input_cloud_->header.frame_id = "world";
-  ////
-  /// https://github.com/ros-perception/perception_pcl/blob/melodic-devel/pcl_conversions/include/pcl_conversions/pcl_conversions.h#L88
-  // input_cloud_->header.stamp = ros::Time::now().toNSec() / 1000ull;
-  // pub_pcloud_filtered_.publish(*input_cloud_);
+    frame->log.tim_tf_transform.tic();
+    // Transform w_T_b
+    Eigen::Affine3d w_T_b;
+    geometry_msgs::TransformStamped transform_stamped;
 
-  log_.tim_pub_filtered.toc();
+    try
+    {
+      transform_stamped = tf_buffer_.lookupTransform("world", frame->header.frame_id, frame->header.stamp,
+                                                     ros::Duration(0.02));  // TODO: change this duration time?
 
-  /////Listen to the transform
+      // transform_stamped = tf_buffer_.lookupTransform("world", frame->header.frame_id,
+      // frame->header.stamp,ros::Duration(0.02));
 
-  // Eigen::Vector3d transform;
+      w_T_b = tf2::transformToEigen(transform_stamped);
+    }
+    catch (tf2::TransformException& ex)
+    {
+      ROS_DEBUG("[world_database_master_ros] OnGetTransform failed with %s", ex.what());
+      frame->valid = false;
+    }
+    frame->log.tim_tf_transform.toc();
 
-  // Eigen::Affine3d w_T_b;
+    if (frame->valid)
+    {
+      // Transform, remove nans, box filter and voxel grid filter
+      frame->log.tim_preprocessing.tic();
+      if (!frame->cloud)  // The frames are reused (and so is their point cloud)
+      {
+        frame->cloud = pcl::PointCloud<pcl::PointXYZ>::Ptr(new pcl::PointCloud<pcl::PointXYZ>);
+      }
+      frame->valid = preprocessCloud(*frame->msg, w_T_b, *frame->cloud);
+      frame->log.tim_preprocessing.toc();
+    }
+    frame->msg.reset();  // Not needed anymore
 
-  // sensor_msgs::PointCloud2Ptr pcl2ptr_msg_transformed(new sensor_msgs::PointCloud2());
+    if (frame->valid)
+    {
+      frame->log.tim_pub_filtered.tic();
 
-  // tf2::doTransform(*pcl2ptr_msg, *pcl2ptr_msg_transformed, transform_stamped);
+      // Publish filtered point cloud
 
-  // pcl::PointCloud<pcl::PointXYZ>::Ptr input_cloud_with_nans(new pcl::PointCloud<pcl::PointXYZ>);
-  // pcl::PointCloud<pcl::PointXYZ>::Ptr input_cloud(new pcl::PointCloud<pcl::PointXYZ>);
-  // // pcl::search::KdTree<pcl::PointXYZ>::Ptr tree(new pcl::search::KdTree<pcl::PointXYZ>);
+      // Option 1
+      sensor_msgs::PointCloud2 filtered_pcl2_msg;
+      pcl::toROSMsg(*frame->cloud, filtered_pcl2_msg);
+      filtered_pcl2_msg.header.frame_id = "world";
+      filtered_pcl2_msg.header.stamp = ros::Time::now();
+      pub_pcloud_filtered_.publish(filtered_pcl2_msg);
 
-  // pcl::fromROSMsg(*pcl2ptr_msg_transformed, *input_cloud_with_nans);
+      // Option 2, crashes randomly on the NUC and Jetson
+      // frame->cloud->header.frame_id = "world";
+      ////
+      /// https://github.com/ros-perception/perception_pcl/blob/melodic-devel/pcl_conversions/include/pcl_conversions/pcl_conversions.h#L88
+      // frame->cloud->header.stamp = ros::Time::now().toNSec() / 1000ull;
+      // pub_pcloud_filtered_.publish(*frame->cloud);
 
-  // std::vector<int> indices;
-  // pcl::removeNaNFromPointCloud(*input_cloud_with_nans, *input_cloud, indices);
+      frame->log.tim_pub_filtered.toc();
 
-  // // Difference VoxelGrid vs UniformSampling:
-  // //
-  // http://www.pcl-users.org/Voxelgrid-without-the-weighted-centroid-td3551390.html#message3564880:~:text=One%20is%20part%20of%20the%20filtering,be%20used%20with%20the%20features%20library.
+      if (frame->cloud->points.size() == 0)
+      {
+        // std::cout << "Point cloud is empty, doing nothing" << std::endl;
+        frame->valid = false;
+      }
+    }
 
-  // // Voxel grid filter
-  // pcl::VoxelGrid<pcl::PointXYZ> sor;
-  // sor.setInputCloud(input_cloud);
-  // sor.setLeafSize(0.1f, 0.1f, 0.1f);
-  // sor.filter(*input_cloud);
+    frame->log.tim_stage_preprocessing.toc();
 
-  if (input_cloud_->points.size() == 0)
-  {
-    // std::cout << "Point cloud is empty, doing nothing" << std::endl;
-    return;
+    if (!queue_clustering_.push(frame))
+    {
+      return;
+    }
   }
+}
 
-  // std::cout << "Filtering:" << input_cloud1->points.size() << " -->" << input_cloud_->points.size() << " points";
-
-  log_.tim_tree.tic();
-  tree_->setInputCloud(input_cloud_);
-  log_.tim_tree.toc();
+void TrackerPredictor::clusteringStage()
+{
+  std::shared_ptr<tp::frame> frame;
+  while (queue_clustering_.pop(frame))
+  {
+    frame->log.tim_stage_clustering.tic();
 
-  std::vector<pcl::PointIndices> cluster_indices;
-  pcl::EuclideanClusterExtraction<pcl::PointXYZ> ec;
-  ec.setClusterTolerance(cluster_tolerance_);
-  ec.setMinClusterSize(min_cluster_size_);
-  ec.setMaxClusterSize(max_cluster_size_);
-  ec.setSearchMethod(tree_);
-  ec.setInputCloud(input_cloud_);
+    if (frame->valid)
+    {
+      std::vector<tp::cluster>& clusters = frame->clusters;
+      double time_pcloud = frame->header.stamp.toSec();
 
-  /* Extract the clusters out of pc and save indices in cluster_indices.*/
+      if (use_grid_clustering_)
+      {
+        // Clustering, centroids and bounding boxes at the same time
+        frame->log.tim_clustering.tic();
+        grid_clustering_.cluster(*frame->cloud, cluster_tolerance_, min_cluster_size_, max_cluster_size_,
+                                 clusters_stats_);
+        frame->log.tim_clustering.toc();
 
-  // std::cout << "Doing the clustering..." << std::endl;
-  log_.tim_clustering.tic();
-  ec.extract(cluster_indices);
-  log_.tim_clustering.toc();
-  // std::cout << "Clustering done!" << std::endl;
+        for (auto& stats : clusters_stats_)
+        {
+          tp::cluster tmp;
+          tmp.centroid = stats.centroid;
+          tmp.bbox = 2 * (stats.max - stats.centroid).cwiseAbs().cwiseMax((stats.min - stats.centroid).cwiseAbs());
+          tmp.time = time_pcloud;
+          clusters.push_back(tmp);
+        }
+      }
+      else
+      {
+        frame->log.tim_tree.tic();
+        tree_->setInputCloud(frame->cloud);
+        frame->log.tim_tree.toc();
+
+        std::vector<pcl::PointIndices> cluster_indices;
+        pcl::EuclideanClusterExtraction<pcl::PointXYZ> ec;
+        ec.setClusterTolerance(cluster_tolerance_);
+        ec.setMinClusterSize(min_cluster_size_);
+        ec.setMaxClusterSize(max_cluster_size_);
+        ec.setSearchMethod(tree_);
+        ec.setInputCloud(frame->cloud);
+
+        /* Extract the clusters out of pc and save indices in cluster_indices.*/
+
+        // std::cout << "Doing the clustering..." << std::endl;
+        frame->log.tim_clustering.tic();
+        ec.extract(cluster_indices);
+        frame->log.tim_clustering.toc();
+        // std::cout << "Clustering done!" << std::endl;
+
+        frame->log.tim_bbox.tic();
+        for (std::vector<pcl::PointIndices>::const_iterator it = cluster_indices.begin(); it != cluster_indices.end();
+             ++it)
+        {
+          // std::cout << "--- New cluster" << std::endl;
+          // std::cout << " " << std::endl;
+
+          ///////////////////////
+          // Compute bounding box
+          ///////////////////////
+
+          // First option (slow):
+
+          // pcl::PointCloud<pcl::PointXYZ>::Ptr cloud_cluster(new pcl::PointCloud<pcl::PointXYZ>);
+          // for (std::vector<int>::const_iterator pit = it->indices.begin(); pit != it->indices.end(); pit++)
+          // {
+          //   cloud_cluster->points.push_back(input_cloud->points[*pit]);  // TODO: I think I can avoid doing this
+          // }
+
+          // cloud_cluster->width = cloud_cluster->points.size();
+          // cloud_cluster->height = 1;
+          // cloud_cluster->is_dense = true;
+
+          // pcl::PointXYZ minPt, maxPt;
+
+          // pcl::getMinMax3D(*cloud_cluster, minPt, maxPt);
+
+          ////////////////////////
+          ////////////////////////
+
+          // Second option (see
+          // https://stackoverflow.com/questions/35669182/this-predefined-function-slowing-down-my-programs-performance)
+          double min_x = std::numeric_limits<double>::max();
+          double max_x = -std::numeric_limits<double>::max();
+          double min_y = std::numeric_limits<double>::max();
+          double max_y = -std::numeric_limits<double>::max();
+          double min_z = std::numeric_limits<double>::max();
+          double max_z = -std::numeric_limits<double>::max();
+
+          for (std::vector<int>::const_iterator pit = it->indices.begin(); pit != it->indices.end(); pit++)
+          {
+            // std::cout << "input_cloud->points[*pit]= " << input_cloud->points[*pit] << std::endl;
+            if (frame->cloud->points[*pit].x <= min_x)
+            {
+              min_x = frame->cloud->points[*pit].x;
+            }
+            if (frame->cloud->points[*pit].y <= min_y)
+            {
+              min_y = frame->cloud->points[*pit].y;
+            }
+            if (frame->cloud->points[*pit].z <= min_z)
+            {
+              min_z = frame->cloud->points[*pit].z;
+            }
+            if (frame->cloud->points[*pit].x >= max_x)
+            {
+              max_x = frame->cloud->points[*pit].x;
+            }
+            if (frame->cloud->points[*pit].y >= max_y)
+            {
+              max_y = frame->cloud->points[*pit].y;
+            }
+            if (frame->cloud->points[*pit].z >= max_z)
+            {
+              max_z = frame->cloud->points[*pit].z;
+            }
+          }
+
+          // std::cout << "min_x= " << min_x << std::endl;
+          // std::cout << "min_y= " << min_y << std::endl;
+          // std::cout << "min_z= " << min_z << std::endl;
+          // std::cout << "max_x= " << max_x << std::endl;
+          // std::cout << "max_y= " << max_y << std::endl;
+          // std::cout << "max_z= " << max_z << std::endl;
+
+          double sum_x = 0.0;
+          double sum_y = 0.0;
+          double sum_z = 0.0;
+
+          for (std::vector<int>::const_iterator pit = it->indices.begin(); pit != it->indices.end(); pit++)
+          {
+            sum_x += frame->cloud->points[*pit].x;
+            sum_y += frame->cloud->points[*pit].y;
+            sum_z += frame->cloud->points[*pit].z;
+          }
+
+          double mean_x = sum_x / (it->indices).size();
+          double mean_y = sum_y / (it->indices).size();
+          double mean_z = sum_z / (it->indices).size();
+
+          tp::cluster tmp;
+          tmp.centroid = Eigen::Vector3d(mean_x, mean_y, mean_z);
+
+          tmp.bbox = Eigen::Vector3d(2 * (std::max(fabs(max_x - mean_x), fabs(min_x - mean_x))),
+                                     2 * (std::max(fabs(max_y - mean_y), fabs(min_y - mean_y))),
+                                     2 * (std::max(fabs(max_z - mean_z), fabs(min_z - mean_z))));
+
+          tmp.time = time_pcloud;
+          clusters.push_back(tmp);
+        }
+        frame->log.tim_bbox.toc();
+      }
+    }
 
-  std::vector<tp::cluster> clusters;
+    frame->log.tim_stage_clustering.toc();
 
-  double time_pcloud = header_pcloud.stamp.toSec();
+    if (!queue_association_.push(frame))
+    {
+      return;
+    }
+  }
+}
 
-  log_.tim_bbox.tic();
-  for (std::vector<pcl::PointIndices>::const_iterator it = cluster_indices.begin(); it != cluster_indices.end(); ++it)
+// This is the only stage that accesses all_tracks_
+void TrackerPredictor::associationStage()
+{
+  std::shared_ptr<tp::frame> frame;
+  while (queue_association_.pop(frame))
   {
-    // std::cout << "--- New cluster" << std::endl;
-    // std::cout << " " << std::endl;
+    frame->log.tim_stage_association.tic();
 
-    ///////////////////////
-    // Compute bounding box
-    ///////////////////////
+    // Done for all the frames (also for the ones without a valid point cloud)
+    // Increase by one the frames skipped on all the tracks
+    std::for_each(all_tracks_.begin(), all_tracks_.end(), [](tp::track& x) { x.num_frames_skipped++; });
 
-    // First option (slow):
+    // Erase the tracks that haven't been detected in many frames
+    int tracks_removed = 0;
 
-    // pcl::PointCloud<pcl::PointXYZ>::Ptr cloud_cluster(new pcl::PointCloud<pcl::PointXYZ>);
-    // for (std::vector<int>::const_iterator pit = it->indices.begin(); pit != it->indices.end(); pit++)
-    // {
-    //   cloud_cluster->points.push_back(input_cloud->points[*pit]);  // TODO: I think I can avoid doing this
-    // }
-
-    // cloud_cluster->width = cloud_cluster->points.size();
-    // cloud_cluster->height = 1;
-    // cloud_cluster->is_dense = true;
+    std::fstream myfile;
+    if (!use_async_logging_)
+    {
+      myfile.open(name_file_, std::ios_base::app);
+    }
 
-    // pcl::PointXYZ minPt, maxPt;
+    // Swap-remove (the last track takes the place of the removed one), keeping the removed track for later reuse
+    for (unsigned int j = 0; j < all_tracks_.size();)
+    {
+      if (all_tracks_[j].num_frames_skipped <= max_frames_skipped_)
+      {
+        j++;
+        continue;
+      }
+      tracks_removed++;
+      if (use_async_logging_)
+      {
+        float num_diff_samples = all_tracks_[j].getNumDiffSamples();
+        async_logger_->log(tp::LOG_SUCCESSIVE_DETECTIONS, frame->header.stamp.toSec(), &num_diff_samples, 1);
+      }
+      else
+      {
+        myfile << all_tracks_[j].getNumDiffSamples() << "\n";
+      }
+      free_tracks_.push_back(std::move(all_tracks_[j]));
+      if (j != all_tracks_.size() - 1)
+      {
+        all_tracks_[j] = std::move(all_tracks_.back());
+      }
+      all_tracks_.pop_back();
+    }
+    myfile.close();
+    // std::cout << "Removed " << tracks_removed << " tracks because too many frames skipped" << std::endl;
 
-    // pcl::getMinMax3D(*cloud_cluster, minPt, maxPt);
+    if (frame->valid)
+    {
+      std::vector<tp::cluster>& clusters = frame->clusters;
+      double time_pcloud = frame->header.stamp.toSec();
 
-    ////////////////////////
-    ////////////////////////
+      // rows = clusters
+      // colums = tracks
 
-    // Second option (see
-    // https://stackoverflow.com/questions/35669182/this-predefined-function-slowing-down-my-programs-performance   )
-    double min_x = std::numeric_limits<double>::max();
-    double max_x = -std::numeric_limits<double>::max();
-    double min_y = std::numeric_limits<double>::max();
-    double max_y = -std::numeric_limits<double>::max();
-    double min_z = std::numeric_limits<double>::max();
-    double max_z = -std::numeric_limits<double>::max();
+      //////////////////////////
+      // Data association
+      //////////////////////////
 
-    for (std::vector<int>::const_iterator pit = it->indices.begin(); pit != it->indices.end(); pit++)
-    {
-      // std::cout << "input_cloud->points[*pit]= " << input_cloud->points[*pit] << std::endl;
-      if (input_cloud_->points[*pit].x <= min_x)
+      // Predicted position of each track at the time of the point cloud (evaluated only once per track)
+      std::vector<Eigen::Vector3d>& predicted_pos = predicted_pos_;
+      predicted_pos.resize(all_tracks_.size());
+      for (unsigned int j = 0; j < all_tracks_.size(); j++)
       {
-        min_x = input_cloud_->points[*pit].x;
+        predicted_pos[j] = all_tracks_[j].pwp_mean.eval(time_pcloud);
       }
-      if (input_cloud_->points[*pit].y <= min_y)
+
+      // Gating: only the pairs (cluster, track) that are closer than meters_to_create_new_track_ can be associated
+      std::vector<tp::assignmentEdge>& edges = edges_;
+      std::vector<bool>& cluster_is_gated = cluster_is_gated_;
+      edges.clear();
+      cluster_is_gated.assign(clusters.size(), false);
+      for (unsigned int i = 0; i < clusters.size(); i++)
       {
-        min_y = input_cloud_->points[*pit].y;
+        for (unsigned int j = 0; j < all_tracks_.size(); j++)
+        {
+          double cost = (clusters[i].centroid - predicted_pos[j]).norm();
+          if (cost <= meters_to_create_new_track_)
+          {
+            edges.push_back({ int(i), int(j), cost });
+            cluster_is_gated[i] = true;
+          }
+        }
       }
-      if (input_cloud_->points[*pit].z <= min_z)
+
+      std::vector<int>& track_assigned_to_cluster = track_assigned_to_cluster_;
+      frame->log.tim_hungarian.tic();
+      gated_assignment_.solve(clusters.size(), all_tracks_.size(), edges, track_assigned_to_cluster);
+      frame->log.tim_hungarian.toc();
+
+      for (unsigned int i = 0; i < clusters.size(); i++)
       {
-        min_z = input_cloud_->points[*pit].z;
+        if (!cluster_is_gated[i])
+        {
+          // Too far from all the tracks --> create new track. It's treated as if it had been associated with this
+          // cluster (which is already in its history)
+          addNewTrack(clusters[i]);
+          all_tracks_.back().num_frames_skipped--;
+          all_tracks_.back().is_new = false;
+        }
+        else if (track_assigned_to_cluster[i] == -1)
+        {
+          // Unassigned (can happen if there are more clusters than tracks close to them) --> create new track
+          addNewTrack(clusters[i]);
+        }
+        else
+        {  // add an element to the history of the track
+          tp::track& track = all_tracks_[track_assigned_to_cluster[i]];
+          track.num_frames_skipped--;
+          if (track.is_new == true)
+          {
+            track.is_new = false;
+          }
+          else
+          {
+            track.addToHistory(clusters[i]);
+            track.filter.update(clusters[i], kalman_process_noise_, kalman_measurement_noise_);
+          }
+        }
       }
-      if (input_cloud_->points[*pit].x >= max_x)
+      // printAllTracks();
+
+      ////////////////////////////////////
+      // Now fit a spline to past history
+      ////////////////////////////////////
+
+      frame->log.tim_fitting.tic();
+      int num_threads = std::min(int(std::thread::hardware_concurrency()), int(all_tracks_.size()) / 32);
+      bool uses_casadi = !use_kalman_prediction_ && (!use_native_prediction_ || validate_native_prediction_);
+      if (!uses_casadi && num_threads > 1)
       {
-        max_x = input_cloud_->points[*pit].x;
+        // The predictions of the tracks are independent (and don't use CasADi), so they can be computed in parallel
+        std::vector<std::future<void>> futures;
+        int tracks_per_thread = (all_tracks_.size() + num_threads - 1) / num_threads;
+        for (int t = 0; t < num_threads; t++)
+        {
+          futures.push_back(std::async(std::launch::async, [this, t, tracks_per_thread]() {
+            int last = std::min(int(all_tracks_.size()), (t + 1) * tracks_per_thread);
+            for (int i = t * tracks_per_thread; i < last; i++)
+            {
+              generatePredictedPwpForTrack(all_tracks_[i]);
+            }
+          }));
+        }
+        for (auto& future : futures)
+        {
+          future.get();
+        }
       }
-      if (input_cloud_->points[*pit].y >= max_y)
+      else
       {
-        max_y = input_cloud_->points[*pit].y;
+        for (auto& track_j : all_tracks_)
+        {
+          generatePredictedPwpForTrack(track_j);
+        }
       }
-      if (input_cloud_->points[*pit].z >= max_z)
+      frame->log.tim_fitting.toc();
+
+      // Copy what the publishing stage needs, so that this stage can continue with the next frame
+      for (auto& track_j : all_tracks_)
       {
-        max_z = input_cloud_->points[*pit].z;
+        if (track_j.shouldPublish())
+        {
+          if (frame->num_tracks == int(frame->tracks.size()))
+          {
+            frame->tracks.emplace_back();
+          }
+          frame->tracks[frame->num_tracks].copyFrom(track_j);
+          frame->num_tracks++;
+        }
       }
     }
 
-    // std::cout << "min_x= " << min_x << std::endl;
-    // std::cout << "min_y= " << min_y << std::endl;
-    // std::cout << "min_z= " << min_z << std::endl;
-    // std::cout << "max_x= " << max_x << std::endl;
-    // std::cout << "max_y= " << max_y << std::endl;
-    // std::cout << "max_z= " << max_z << std::endl;
+    frame->log.tim_stage_association.toc();
 
-    double sum_x = 0.0;
-    double sum_y = 0.0;
-    double sum_z = 0.0;
-
-    for (std::vector<int>::const_iterator pit = it->indices.begin(); pit != it->indices.end(); pit++)
+    if (!queue_publishing_.push(frame))
     {
-      sum_x += input_cloud_->points[*pit].x;
-      sum_y += input_cloud_->points[*pit].y;
-      sum_z += input_cloud_->points[*pit].z;
+      return;
     }
+  }
+}
 
-    double mean_x = sum_x / (it->indices).size();
-    double mean_y = sum_y / (it->indices).size();
-    double mean_z = sum_z / (it->indices).size();
+void TrackerPredictor::publishingStage()
+{
+  std::shared_ptr<tp::frame> frame;
+  while (queue_publishing_.pop(frame))
+  {
+    // Frames dropped by an earlier stage (e.g., no transform available) have nothing to publish, and their log and
+    // latency would only have the timers of the stages they went through
+    if (!frame->valid)
+    {
+      releaseFrame(frame);
+      continue;
+    }
 
-    tp::cluster tmp;
-    tmp.centroid = Eigen::Vector3d(mean_x, mean_y, mean_z);
+    frame->log.tim_stage_publishing.tic();
 
-    tmp.bbox = Eigen::Vector3d(2 * (std::max(fabs(max_x - mean_x), fabs(min_x - mean_x))),
-                               2 * (std::max(fabs(max_y - mean_y), fabs(min_y - mean_y))),
-                               2 * (std::max(fabs(max_z - mean_z), fabs(min_z - mean_z))));
+    double time_pcloud = frame->header.stamp.toSec();
 
-    tmp.time = time_pcloud;
-    clusters.push_back(tmp);
-  }
-  log_.tim_bbox.toc();
+    frame->log.tim_pub.tic();
+    double t_now = ros::Time::now().toSec();
 
-  // rows = clusters
-  // colums = tracks
+    if (publish_traj_batch_)
+    {
+      // All the tracks in a single message (see traj_batch.hpp), with the max degree of all of them
+      int deg_mean = 0;
+      int deg_var = 0;
+      for (int k = 0; k < frame->num_tracks; k++)
+      {
+        tp::trackSnapshot& track_j = frame->tracks[k];
+        for (int i = 0; i < track_j.pwp_mean.getNumOfIntervals(); i++)
+        {
+          deg_mean = std::max(deg_mean, int(track_j.pwp_mean.all_coeff_x[i].size()) - 1);
+          deg_var = std::max(deg_var, int(track_j.pwp_var.all_coeff_x[i].size()) - 1);
+        }
+      }
 
-  std::vector<unsigned int> indexes_costs_too_big;
+      traj_batch_encoder_.start(deg_mean, deg_var);
+      for (int k = 0; k < frame->num_tracks; k++)
+      {
+        tp::trackSnapshot& track_j = frame->tracks[k];
+        mt::compactTrajInfo info;
+        info.id = track_j.id_int;
+        info.is_agent = false;
+        info.bbox = track_j.latest_bbox;
+        info.pos = track_j.pwp_mean.eval(t_now);
+        if (!traj_batch_encoder_.add(track_j.pwp_mean, track_j.pwp_var, info))
+        {
+          ROS_WARN_THROTTLE(1.0, "[tracker_predictor] Could not add track %d to the batch, using DynTraj",
+                            track_j.id_int);
+          pub_traj_.publish(getDynTrajMsg(track_j, t_now));
+        }
+      }
 
-  // Compute costs for each of the clusters detected
-  // std::cout << "Computing costs for each of the clusters detected" << std::endl;
-  // std::cout << "Num of clusters detected= " << clusters.size() << std::endl;
-  // std::cout << "Num of current tracks   = " << all_tracks_.size() << std::endl;
-  for (unsigned int i = 0; i < clusters.size(); i++)
-  {
-    double min_cost = std::numeric_limits<double>::max();
-    for (auto& track_j : all_tracks_)
+      std_msgs::UInt8MultiArray batch_msg;
+      batch_msg.data = traj_batch_encoder_.getBuffer();
+      pub_traj_batch_.publish(batch_msg);
+    }
+    else
     {
-      min_cost = std::min(min_cost, getCostRowColum(clusters[i], track_j, time_pcloud));
+      for (int k = 0; k < frame->num_tracks; k++)
+      {
+        tp::trackSnapshot& track_j = frame->tracks[k];
+        pub_traj_.publish(getDynTrajMsg(track_j, t_now));
+      }
     }
 
-    // std::cout << "min_cost= " << min_cost << std::endl;
-
-    if (min_cost > meters_to_create_new_track_)
+    // Visualization in RViz, only at visualization_rate_ (all the tracks in one MarkerArray)
+    if (visualization_rate_ > 0.0 && (t_now - last_time_visualization_) >= (1.0 / visualization_rate_))
     {
-      indexes_costs_too_big.push_back(i);
-    }
-  }
+      last_time_visualization_ = t_now;
 
-  // std::cout << "Creating= " << indexes_costs_too_big.size() << " new clusters because cost row is too big" <<
-  // std::endl;
+      int samples = 20;
+      visualization_msgs::MarkerArray marker_array_predicted_traj;
+      int j = 0;
+      for (int k = 0; k < frame->num_tracks; k++)
+      {
+        tp::trackSnapshot& track_j = frame->tracks[k];
+        std::string ns = "predicted_traj_" + std::to_string(j);
+        visualization_msgs::MarkerArray tmp =
+            pwp2ColoredMarkerArray(track_j.pwp_mean, time_pcloud, time_pcloud + 2.0, samples, ns, track_j.color);
+        marker_array_predicted_traj.markers.insert(marker_array_predicted_traj.markers.end(), tmp.markers.begin(),
+                                                   tmp.markers.end());
+        j++;
+      }
+      pub_marker_predicted_traj_.publish(marker_array_predicted_traj);
 
-  // If the minimum of each of the rows is too large --> create new track
-  for (auto i : indexes_costs_too_big)
-  {
-    // clusters[i].print();
-    addNewTrack(clusters[i]);
-  }
+      deleteMarkers();
+      pub_marker_bbox_obstacles_.publish(getBBoxesAsMarkerArray(*frame));
+    }
 
-  //////////////////////////
-  ///////////////////////////
+    frame->log.tim_pub.toc();
 
-  //////////////////////////
-  // Run Hungarian Algorithm
-  //////////////////////////
+    if (!first_prediction_published_ && frame->num_tracks > 0)
+    {
+      first_prediction_published_ = true;
+      std::cout << green << "TrackerPredictor: first prediction published " << timer_startup_.elapsedSoFarMs()
+                << " ms after the start of the node" << reset << std::endl;
+    }
 
-  if (clusters.size() > 0)
-  {
-    // std::cout << "Running Hungarian Algorithm" << std::endl;
+    frame->log.tim_stage_publishing.toc();
+    frame->log.tim_total_tp.toc();
 
-    // std::cout << "Creating the cost matrix!" << std::endl;
-    // Create the cost matrix
-    std::vector<std::vector<double>> costMatrix;
+    pub_log_.publish(logtp2LogtpMsg(frame->log));
 
-    for (auto cluster_i : clusters)  // for each of the rows
+    if (use_async_logging_)
     {
-      std::vector<double> costs_cluster_i;
-      for (auto& track_j : all_tracks_)  // for each of the columns
-      {
-        costs_cluster_i.push_back(getCostRowColum(cluster_i, track_j, time_pcloud));
-      }
-
-      costMatrix.push_back(costs_cluster_i);  // Add row to the matrix
+      const tp::logtp& log = frame->log;
+      // Same order as the timers in tp::logtp
+      float times[] = { float(log.tim_total_tp.getMsSaved()),
+                        float(log.tim_tf_transform.getMsSaved()),
+                        float(log.tim_preprocessing.getMsSaved()),
+                        float(log.tim_pub_filtered.getMsSaved()),
+                        float(log.tim_tree.getMsSaved()),
+                        float(log.tim_clustering.getMsSaved()),
+                        float(log.tim_bbox.getMsSaved()),
+                        float(log.tim_hungarian.getMsSaved()),
+                        float(log.tim_fitting.getMsSaved()),
+                        float(log.tim_pub.getMsSaved()),
+                        float(log.tim_stage_preprocessing.getMsSaved()),
+                        float(log.tim_stage_clustering.getMsSaved()),
+                        float(log.tim_stage_association.getMsSaved()),
+                        float(log.tim_stage_publishing.getMsSaved()) };
+      async_logger_->log(tp::LOG_TIMES, frame->header.stamp.toSec(), times, sizeof(times) / sizeof(float));
     }
 
-    // Run the Hungarian Algorithm;
-    HungarianAlgorithm HungAlgo;
-    std::vector<int> track_assigned_to_cluster;
-    // std::cout << "Calling Hungarian Algorithm now!!" << std::endl;
-    log_.tim_hungarian.tic();
-    double cost = HungAlgo.Solve(costMatrix, track_assigned_to_cluster);
-    log_.tim_hungarian.toc();
-    // std::cout << "Called  Hungarian Algorithm!" << std::endl;
+    // Time spent by each stage, and end-to-end latency (from the stamp of the point cloud to now)
+    std_msgs::Float32MultiArray latency_msg;
+    latency_msg.layout.dim.resize(1);
+    latency_msg.layout.dim[0].label = "ms_stage_preprocessing,ms_stage_clustering,ms_stage_association,"
+                                      "ms_stage_publishing,ms_end_to_end";
+    latency_msg.layout.dim[0].size = 5;
+    latency_msg.layout.dim[0].stride = 5;
+    latency_msg.data.push_back(frame->log.tim_stage_preprocessing.getMsSaved());
+    latency_msg.data.push_back(frame->log.tim_stage_clustering.getMsSaved());
+    latency_msg.data.push_back(frame->log.tim_stage_association.getMsSaved());
+    latency_msg.data.push_back(frame->log.tim_stage_publishing.getMsSaved());
+    latency_msg.data.push_back((ros::Time::now() - frame->header.stamp).toSec() * 1000.0);
+    pub_latency_.publish(latency_msg);
+
+    releaseFrame(frame);
+  }
+}
 
-    for (unsigned int i = 0; i < costMatrix.size(); i++)  // for each of the rows
+bool TrackerPredictor::preprocessCloud(const sensor_msgs::PointCloud2& msg, const Eigen::Affine3d& w_T_b,
+                                       pcl::PointCloud<pcl::PointXYZ>& cloud)
+{
+  // Find the offsets of the x, y, z fields
+  int offset_xyz[3] = { -1, -1, -1 };
+  const std::string names_xyz[3] = { "x", "y", "z" };
+  for (const auto& field : msg.fields)
+  {
+    for (int i = 0; i < 3; i++)
     {
-      // std::cout << i << "," << track_assigned_to_cluster[i] << "\t";
-
-      all_tracks_[track_assigned_to_cluster[i]].num_frames_skipped--;
-
-      // If a cluster has been unassigned (can happen if rows>columns), then create a new track for it
-      if (track_assigned_to_cluster[i] == -1)
+      if (field.name == names_xyz[i] && field.datatype == sensor_msgs::PointField::FLOAT32)
       {
-        // std::cout << "cluster " << i << " unassigned, creating new track for it" << std::endl;
-        // std::cout << clusters[i].centroid.transpose() << std::endl;
-        addNewTrack(clusters[i]);
-      }
-      else
-      {  // add an element to the history of the track
-        if (all_tracks_[track_assigned_to_cluster[i]].is_new == true)
-        {
-          all_tracks_[track_assigned_to_cluster[i]].is_new = false;
-        }
-        else
-        {
-          all_tracks_[track_assigned_to_cluster[i]].addToHistory(clusters[i]);
-        }
+        offset_xyz[i] = field.offset;
       }
     }
-    // std::cout << "\n";
   }
-  else
+
+  if (offset_xyz[0] < 0 || offset_xyz[1] < 0 || offset_xyz[2] < 0)
   {
-    // std::cout << "No clusters detected" << std::endl;
+    std::cout << red << "The point cloud doesn't have float32 x, y, z fields, ignoring it" << reset << std::endl;
+    return false;
   }
-  // printAllTracks();
 
-  ////////////////////////////////////
-  // Now fit a spline to past history
-  ////////////////////////////////////
+  size_t num_points = size_t(msg.width) * msg.height;
 
-  log_.tim_fitting.tic();
-  for (auto& track_j : all_tracks_)
+  // The table is at most half full (there cannot be more voxels than points)
+  int log2_table_size = 4;
+  while ((size_t(1) << log2_table_size) < 2 * num_points)
   {
-    generatePredictedPwpForTrack(track_j);
+    log2_table_size++;
   }
-  log_.tim_fitting.toc();
+  if (voxel_table_keys_.size() < (size_t(1) << log2_table_size))
+  {
+    voxel_table_keys_.assign(size_t(1) << log2_table_size, std::numeric_limits<uint64_t>::max());  // max() --> empty
+    voxel_table_values_.resize(voxel_table_keys_.size());
+  }
+  while ((size_t(1) << log2_table_size) < voxel_table_keys_.size())  // It may be bigger (from a previous bigger cloud)
+  {
+    log2_table_size++;
+  }
+  const size_t mask = voxel_table_keys_.size() - 1;
 
-  ////////////////////////////////////
-  // publish the stuff
-  ////////////////////////////////////
+  voxels_.clear();
 
-  int samples = 20;
+  const Eigen::Matrix3f R = w_T_b.rotation().cast<float>();
+  const Eigen::Vector3f t = w_T_b.translation().cast<float>();
+  const float inv_leaf = 1.0 / leaf_size_filter_;
+  const Eigen::Vector3f box_min(x_min_, y_min_, z_min_);
+  const Eigen::Vector3f box_max(x_max_, y_max_, z_max_);
 
-  log_.tim_pub.tic();
-  int j = 0;
-  for (auto& track_j : all_tracks_)
+  for (uint32_t row = 0; row < msg.height; row++)
   {
-    // std::cout << "----" << std::endl;
-    // std::cout<<"==================TIME PCLOUD: "<<std::endl;
-    // std::streamsize ss = std::cout.precision();  // original precision
-    // std::cout << " time_pcloud= " << std::setprecision(20) << time_pcloud  << std::setprecision(ss) << std::endl;
-    // std::cout<<"==================HISTORY: "<<std::endl;
-    // track_j.printHistory();
-    // std::cout<<"==================PREDICTION: "<<std::endl;
-    // track_j.printPrediction(3.0, 5);
-
-    if (track_j.shouldPublish() == false)
+    const uint8_t* ptr = &msg.data[size_t(row) * msg.row_step];
+    for (uint32_t col = 0; col < msg.width; col++, ptr += msg.point_step)
     {
-      continue;
-    }
+      Eigen::Vector3f p;
+      memcpy(&p.x(), ptr + offset_xyz[0], sizeof(float));
+      memcpy(&p.y(), ptr + offset_xyz[1], sizeof(float));
+      memcpy(&p.z(), ptr + offset_xyz[2], sizeof(float));
 
-    // track_j.pwp.print();
+      if (!std::isfinite(p.x()) || !std::isfinite(p.y()) || !std::isfinite(p.z()))
+      {
+        continue;
+      }
 
-    std::string ns = "predicted_traj_" + std::to_string(j);
-    pub_marker_predicted_traj_.publish(
-        pwp2ColoredMarkerArray(track_j.pwp_mean, time_pcloud, time_pcloud + 2.0, samples, ns, track_j.color));
+      p = R * p + t;  // Now in world frame
 
-    /////////////////// construct a DynTraj msg. //TODO: use the pwp instead (this will require modifications in the
-    /// panther code, for when it's not an agent)
+      if ((p.array() < box_min.array()).any() || (p.array() > box_max.array()).any())
+      {
+        continue;
+      }
 
-    panther_msgs::DynTraj dynTraj_msg;
-    dynTraj_msg.header.frame_id = "world";
-    dynTraj_msg.header.stamp = ros::Time::now();
-    dynTraj_msg.use_pwp_field = true;
-    dynTraj_msg.pwp_mean = pwp2PwpMsg(track_j.pwp_mean);
-    dynTraj_msg.pwp_var = pwp2PwpMsg(track_j.pwp_var);
-    dynTraj_msg.s_mean = pieceWisePol2String(track_j.pwp_mean);  // uncommented for the simulation (to use it in Matlab)
-    // dynTraj_msg.s_var = pieceWisePol2String(track_j.pwp_var);
+      // Same voxel indexes as pcl::VoxelGrid. 21 bits per axis (+-1e6 voxels)
+      uint64_t key = 0;
+      for (int i = 0; i < 3; i++)
+      {
+        int64_t index = int64_t(std::floor(p(i) * inv_leaf)) + (int64_t(1) << 20);
+        key = (key << 21) | (uint64_t(index) & 0x1FFFFF);
+      }
 
-    std::vector<double> tmp = eigen2std(track_j.getLatestBbox());
-    // std::vector<double> tmp = eigen2std(track_j.getMaxBbox());
+      size_t slot = (key * 0x9E3779B97F4A7C15ull) >> (64 - log2_table_size);  // Fibonacci hashing
+      while (voxel_table_keys_[slot] != key && voxel_table_keys_[slot] != std::numeric_limits<uint64_t>::max())
+      {
+        slot = (slot + 1) & mask;
+      }
 
-    dynTraj_msg.bbox = std::vector<float>(tmp.begin(), tmp.end());  // TODO: Here I'm using the latest Bbox. Should I
-                                                                    // use the biggest one of the whole history?
-    double t_now = ros::Time::now().toSec();
-    dynTraj_msg.pos = eigen2rosvector(track_j.pwp_mean.eval(t_now));
-    dynTraj_msg.id = track_j.id_int;
-    dynTraj_msg.is_agent = false;
-
-    pub_traj_.publish(dynTraj_msg);
-
-    // //////////////////
-    // double freq_logging = 5.0;
-    // int num_samples = 10;
-    // double pred_horizon = 2.0;
-    // double delta = pred_horizon / (1.0 * num_samples);
-    // if (t_now - last_time_done_logging_ > 1 / freq_logging)
-    // {
-    //   std::fstream myfile;
-    //   myfile.open(name_file_, std::ios_base::app);
-    //   // myfile << j << " ";
-    //   // for (double t = t_now; t < t_now + 2.0; t = t + delta)
-    //   // {
-    //   //   Eigen::Vector3d pred_pos = track_j.pwp_mean.eval(t);
-
-    //   //   myfile << t << " " << pred_pos.x() << " " << pred_pos.y() << " " << pred_pos.z() << " ";
-    //   // }
-    //   // myfile << "\n";
-    //   // myfile.close();
-
-    //   // last_time_done_logging_ = t_now;
-
-    //   std::vector<std::string> tm = pieceWisePol2String(track_j.pwp_mean);
-    //   tm[0].erase(std::remove(tm[0].begin(), tm[0].end(), ' '), tm[0].end());
-    //   tm[1].erase(std::remove(tm[1].begin(), tm[1].end(), ' '), tm[1].end());
-    //   tm[2].erase(std::remove(tm[2].begin(), tm[2].end(), ' '), tm[2].end());
-
-    //   myfile << j << " " << t_now << " " << tm[0] << " " << tm[1] << " " << tm[2] << "\n";
-    // }
-    // //////////////////
+      if (voxel_table_keys_[slot] == key)
+      {
+        tp::voxelSum& voxel = voxels_[voxel_table_values_[slot]];
+        voxel.sum_x += p.x();
+        voxel.sum_y += p.y();
+        voxel.sum_z += p.z();
+        voxel.num_points++;
+      }
+      else
+      {
+        voxel_table_keys_[slot] = key;
+        voxel_table_values_[slot] = voxels_.size();
+        voxels_.push_back({ p.x(), p.y(), p.z(), 1, slot });
+      }
+    }
+  }
 
-    j++;
+  // Write the centroids of the voxels, and leave the hash table empty for the next call
+  cloud.points.resize(voxels_.size());
+  for (size_t i = 0; i < voxels_.size(); i++)
+  {
+    const tp::voxelSum& voxel = voxels_[i];
+    float inv_num = 1.0f / voxel.num_points;
+    cloud.points[i] = pcl::PointXYZ(voxel.sum_x * inv_num, voxel.sum_y * inv_num, voxel.sum_z * inv_num);
+    voxel_table_keys_[voxel.slot] = std::numeric_limits<uint64_t>::max();
   }
-  deleteMarkers();
-  pub_marker_bbox_obstacles_.publish(getBBoxesAsMarkerArray());
+  cloud.width = voxels_.size();
+  cloud.height = 1;
+  cloud.is_dense = true;
 
-  log_.tim_pub.toc();
+  return true;
+}
 
-  // std::cout << "End of cloud_cb" << std::endl;
-  log_.tim_total_tp.toc();
+panther_msgs::DynTraj TrackerPredictor::getDynTrajMsg(const tp::trackSnapshot& track_j, double t_now)
+{
+  panther_msgs::DynTraj dynTraj_msg;
+  dynTraj_msg.header.frame_id = "world";
+  dynTraj_msg.header.stamp = ros::Time::now();
+  dynTraj_msg.use_pwp_field = true;
+  dynTraj_msg.pwp_mean = pwp2PwpMsg(track_j.pwp_mean);
+  dynTraj_msg.pwp_var = pwp2PwpMsg(track_j.pwp_var);
+  if (publish_traj_strings_)  // Needed for the simulation (to use it in Matlab)
+  {
+    dynTraj_msg.s_mean = pieceWisePol2String(track_j.pwp_mean);
+    // dynTraj_msg.s_var = pieceWisePol2String(track_j.pwp_var);
+  }
+
+  std::vector<double> tmp = eigen2std(track_j.latest_bbox);
+  // std::vector<double> tmp = eigen2std(track_j.max_bbox);
 
-  pub_log_.publish(logtp2LogtpMsg(log_));
+  // TODO: Here I'm using the latest Bbox. Should I use the biggest one of the whole history?
+  dynTraj_msg.bbox = std::vector<float>(tmp.begin(), tmp.end());
+  dynTraj_msg.pos = eigen2rosvector(track_j.pwp_mean.eval(t_now));
+  dynTraj_msg.id = track_j.id_int;
+  dynTraj_msg.is_agent = false;
+
+  return dynTraj_msg;
 }
 
 panther_msgs::Logtp TrackerPredictor::logtp2LogtpMsg(tp::logtp log)
 {
   panther_msgs::Logtp log_msg;
 
-  log_msg.ms_total_tp = log_.tim_total_tp.getMsSaved();
-  log_msg.ms_conversion_pcl = log_.tim_conversion_pcl.getMsSaved();
-  log_msg.ms_tf_transform = log_.tim_tf_transform.getMsSaved();
-  log_msg.ms_remove_nans = log_.tim_remove_nans.getMsSaved();
-  log_msg.ms_passthrough = log_.tim_passthrough.getMsSaved();
-  log_msg.ms_voxel_grid = log_.tim_voxel_grid.getMsSaved();
-  log_msg.ms_pub_filtered = log_.tim_pub_filtered.getMsSaved();
-  log_msg.ms_tree = log_.tim_tree.getMsSaved();
-  log_msg.ms_clustering = log_.tim_clustering.getMsSaved();
-  log_msg.ms_bbox = log_.tim_bbox.getMsSaved();
-  log_msg.ms_hungarian = log_.tim_hungarian.getMsSaved();
-  log_msg.ms_fitting = log_.tim_fitting.getMsSaved();
-  log_msg.ms_pub = log_.tim_pub.getMsSaved();
+  log_msg.ms_total_tp = log.tim_total_tp.getMsSaved();
+  log_msg.ms_conversion_pcl = log.tim_preprocessing.getMsSaved();  // Whole preprocessing (done in a single pass)
+  log_msg.ms_tf_transform = log.tim_tf_transform.getMsSaved();
+  log_msg.ms_remove_nans = 0.0;  // Included in ms_conversion_pcl
+  log_msg.ms_passthrough = 0.0;  // Included in ms_conversion_pcl
+  log_msg.ms_voxel_grid = 0.0;   // Included in ms_conversion_pcl
+  log_msg.ms_pub_filtered = log.tim_pub_filtered.getMsSaved();
+  log_msg.ms_tree = log.tim_tree.getMsSaved();
+  log_msg.ms_clustering = log.tim_clustering.getMsSaved();
+  log_msg.ms_bbox = log.tim_bbox.getMsSaved();
+  log_msg.ms_hungarian = log.tim_hungarian.getMsSaved();
+  log_msg.ms_fitting = log.tim_fitting.getMsSaved();
+  log_msg.ms_pub = log.tim_pub.getMsSaved();
 
   log_msg.header.stamp = ros::Time::now();
 
@@ -708,6 +1068,146 @@ void TrackerPredictor::printAllTracks()
 }
 
 void TrackerPredictor::generatePredictedPwpForTrack(tp::track& track_j)
+{
+  if (use_kalman_prediction_)
+  {
+    generatePredictedPwpForTrackKalman(track_j);
+    return;
+  }
+
+  if (!use_native_prediction_)
+  {
+    generatePredictedPwpForTrackCasadi(track_j);
+    return;
+  }
+
+  generatePredictedPwpForTrackNative(track_j);
+
+  if (validate_native_prediction_)
+  {
+    tp::track track_casadi = track_j;
+    generatePredictedPwpForTrackCasadi(track_casadi);
+
+    double max_diff = 0.0;
+    for (int i = 0; i < track_j.pwp_mean.all_coeff_x.size(); i++)
+    {
+      max_diff = std::max(max_diff, (track_j.pwp_mean.all_coeff_x[i] - track_casadi.pwp_mean.all_coeff_x[i]).norm());
+      max_diff = std::max(max_diff, (track_j.pwp_mean.all_coeff_y[i] - track_casadi.pwp_mean.all_coeff_y[i]).norm());
+      max_diff = std::max(max_diff, (track_j.pwp_mean.all_coeff_z[i] - track_casadi.pwp_mean.all_coeff_z[i]).norm());
+      max_diff = std::max(max_diff, (track_j.pwp_var.all_coeff_x[i] - track_casadi.pwp_var.all_coeff_x[i]).norm());
+      max_diff = std::max(max_diff, (track_j.pwp_var.all_coeff_y[i] - track_casadi.pwp_var.all_coeff_y[i]).norm());
+      max_diff = std::max(max_diff, (track_j.pwp_var.all_coeff_z[i] - track_casadi.pwp_var.all_coeff_z[i]).norm());
+    }
+    max_diff = std::max(max_diff, fabs(track_j.pwp_mean.times.back() - track_casadi.pwp_mean.times.back()));
+
+    if (max_diff > 1e-6)
+    {
+      std::cout << yellow << "Native prediction differs from the CasADi one, max_diff= " << max_diff
+                << ", window size= " << track_j.getSizeSW() << reset << std::endl;
+    }
+  }
+}
+
+// Leaves pwp with only the interval [t_start, t_end], reusing its memory (nothing is allocated if it already had one
+// interval of the same degree, which is the case for the predictions of a track from one frame to the next)
+template <typename Tx, typename Ty, typename Tz>
+void setOneInterval(mt::PieceWisePol& pwp, double t_start, double t_end, const Eigen::MatrixBase<Tx>& coeff_x,
+                    const Eigen::MatrixBase<Ty>& coeff_y, const Eigen::MatrixBase<Tz>& coeff_z)
+{
+  pwp.times.resize(2);
+  pwp.times[0] = t_start;
+  pwp.times[1] = t_end;
+  pwp.all_coeff_x.resize(1);
+  pwp.all_coeff_y.resize(1);
+  pwp.all_coeff_z.resize(1);
+  pwp.all_coeff_x[0] = coeff_x;
+  pwp.all_coeff_y[0] = coeff_y;
+  pwp.all_coeff_z[0] = coeff_z;
+}
+
+// Same fit as get_mean_variance_pred_N (see matlab/prediction.m), computed in closed form: polynomial least-squares
+// fit (using the normalized time (t-t_latest)/secs_prediction) for the mean, and prediction interval of the
+// regression for the variance
+void TrackerPredictor::generatePredictedPwpForTrackNative(tp::track& track_j) const
+{
+  const int N = track_j.getSizeSW();
+  const int d = deg_pos_prediction_;
+
+  double t_latest = -std::numeric_limits<double>::max();
+  for (int i = 0; i < N; i++)
+  {
+    t_latest = std::max(t_latest, track_j.getTimeHistory(i));
+  }
+
+  // Regression matrix (columns are t^0, t^1,...) and observations
+  Eigen::MatrixXd X(N, d + 1);
+  Eigen::MatrixXd Y(N, 3);
+  for (int i = 0; i < N; i++)
+  {
+    double t = (track_j.getTimeHistory(i) - t_latest) / secs_prediction_;
+    double t_power = 1.0;
+    for (int j = 0; j <= d; j++)
+    {
+      X(i, j) = t_power;
+      t_power *= t;
+    }
+    Y.row(i) = track_j.getCentroidHistory(i).transpose();
+  }
+
+  const Eigen::MatrixXd invXtX = (X.transpose() * X).inverse();
+  const Eigen::MatrixXd beta = invXtX * (X.transpose() * Y);  // Column k has the coefficients (lowest first) of axis k
+
+  // Squared standard error of each axis
+  const Eigen::RowVectorXd sigma2 = (Y - X * beta).colwise().squaredNorm() / (N - d - 1);
+
+  // variance(t) = sigma2 * (1 + T' * invXtX * T), where T=[1 t t^2 ...]'. poly_var has its coefficients (lowest first)
+  Eigen::VectorXd poly_var = Eigen::VectorXd::Zero(2 * d + 1);
+  poly_var(0) = 1.0;
+  for (int i = 0; i <= d; i++)
+  {
+    for (int j = 0; j <= d; j++)
+    {
+      poly_var(i + j) += invXtX(i, j);
+    }
+  }
+
+  // PieceWisePol uses the highest power first
+  double t_start = track_j.getLatestTimeSW();
+  double t_end = t_start + secs_prediction_;
+  setOneInterval(track_j.pwp_mean, t_start, t_end, beta.col(0).reverse(), beta.col(1).reverse(),
+                 beta.col(2).reverse());
+  setOneInterval(track_j.pwp_var, t_start, t_end, sigma2(0) * poly_var.reverse(), sigma2(1) * poly_var.reverse(),
+                 sigma2(2) * poly_var.reverse());
+}
+
+// Same format as the fit of the sliding window: one interval of duration secs_prediction_ that starts at the latest
+// observation. The mean is the constant-acceleration extrapolation of the state of the filter, and the variance is the
+// one of that extrapolation plus the measurement noise (the counterpart of the "1 +" of the prediction interval of the
+// regression), a polynomial of degree 4 as well
+void TrackerPredictor::generatePredictedPwpForTrackKalman(tp::track& track_j) const
+{
+  const tp::trackFilter& filter = track_j.filter;
+  const double T = secs_prediction_;  // The polynomials use u=tau/T, where tau is the time since the last observation
+  const Eigen::Matrix3d& P = filter.P;
+
+  // pos(tau) = p + v*tau + a*tau^2/2
+  Eigen::Vector3d scaling(T * T / 2.0, T, 1.0);
+  setOneInterval(track_j.pwp_mean, filter.time, filter.time + secs_prediction_,
+                 scaling.cwiseProduct(filter.x.col(0).reverse()), scaling.cwiseProduct(filter.x.col(1).reverse()),
+                 scaling.cwiseProduct(filter.x.col(2).reverse()));
+
+  // var(tau) = [1 tau tau^2/2] * P * [1 tau tau^2/2]' + measurement_noise
+  Eigen::Matrix<double, 5, 1> coeff_var;
+  coeff_var << P(2, 2) / 4.0 * pow(T, 4),  //////
+      P(1, 2) * pow(T, 3),                 //////
+      (P(1, 1) + P(0, 2)) * T * T,         //////
+      2.0 * P(0, 1) * T,                   //////
+      P(0, 0) + kalman_measurement_noise_;
+
+  setOneInterval(track_j.pwp_var, filter.time, filter.time + secs_prediction_, coeff_var, coeff_var, coeff_var);
+}
+
+void TrackerPredictor::generatePredictedPwpForTrackCasadi(tp::track& track_j)
 {
   // std::cout << "Creating the matrices" << std::endl;
   casadi::DM all_pos = casadi::DM::zeros(3, track_j.getSizeSW());  //(casadi::Sparsity::dense(3, track_j.getSizeSW()));
@@ -762,7 +1262,7 @@ void TrackerPredictor::generatePredictedPwpForTrack(tp::track& track_j)
   // std::cout << "Calling casadi!" << std::endl;
   // Note that Casadi may crash (with the error "Evaluation failed") if secs_prediction (in prediction_one_segment.m) is
   // very big (like 100)
-  std::map<std::string, casadi::DM> result = cf_get_mean_variance_pred_[current_ssw](map_arguments);
+  std::map<std::string, casadi::DM> result = getMeanVariancePredFunction(current_ssw)(map_arguments);
   // std::cout << "Called casadi " << std::endl;
 
   // std::cout << "RESULT Before: " << std::endl;
@@ -798,22 +1298,15 @@ void TrackerPredictor::generatePredictedPwpForTrack(tp::track& track_j)
     mean_coeff_z(i) = double(coeffs_mean(2, i));
   }
 
-  mt::PieceWisePol pwp_mean;  // will have only one interval
-  pwp_mean.times.push_back(track_j.getLatestTimeSW());
-  pwp_mean.times.push_back(track_j.getLatestTimeSW() + secs_prediction);
-
-  pwp_mean.all_coeff_x.push_back(mean_coeff_x);
-  pwp_mean.all_coeff_y.push_back(mean_coeff_y);
-  pwp_mean.all_coeff_z.push_back(mean_coeff_z);
-
-  track_j.pwp_mean = pwp_mean;
+  setOneInterval(track_j.pwp_mean, track_j.getLatestTimeSW(), track_j.getLatestTimeSW() + secs_prediction,
+                 mean_coeff_x, mean_coeff_y, mean_coeff_z);
 
   // std::cout << "mean_coeff_x= " << mean_coeff_x.transpose() << std::endl;
 
   // std::cout << " -------- PWP " << std::endl;
-  // pwp_mean.print();
+  // track_j.pwp_mean.print();
   // std::cout << "Evaluation at t=" << track_j.getLatestTimeSW() << " = "
-  //           << pwp_mean.eval(track_j.getLatestTimeSW()).transpose() << std::endl;
+  //           << track_j.pwp_mean.eval(track_j.getLatestTimeSW()).transpose() << std::endl;
   // std::cout << magenta << "real= " << track_j.getLatestCentroid().transpose() << reset << std::endl;
 
   ///////////////////////////////////////////////////// Fill the variance
@@ -828,14 +1321,8 @@ void TrackerPredictor::generatePredictedPwpForTrack(tp::track& track_j)
     var_coeff_z(i) = double(coeffs_var(2, i));
   }
 
-  mt::PieceWisePol pwp_var;  // will have only one interval
-  pwp_var.times = pwp_mean.times;
-
-  pwp_var.all_coeff_x.push_back(var_coeff_x);
-  pwp_var.all_coeff_y.push_back(var_coeff_y);
-  pwp_var.all_coeff_z.push_back(var_coeff_z);
-
-  track_j.pwp_var = pwp_var;
+  setOneInterval(track_j.pwp_var, track_j.pwp_mean.times[0], track_j.pwp_mean.times[1], var_coeff_x, var_coeff_y,
+                 var_coeff_z);
 
   // double time_pcloud = track_j.getLatestTimeSW() - track_j.getOldestTimeSW();
   // Eigen::Vector4d T =
@@ -869,17 +1356,14 @@ void TrackerPredictor::deleteMarkers()
   ids_markers_published_.clear();
 }
 
-visualization_msgs::MarkerArray TrackerPredictor::getBBoxesAsMarkerArray()
+visualization_msgs::MarkerArray TrackerPredictor::getBBoxesAsMarkerArray(const tp::frame& frame)
 {
   visualization_msgs::MarkerArray marker_array;
 
   int j = 0;
-  for (auto& track_j : all_tracks_)
+  for (int k = 0; k < frame.num_tracks; k++)
   {
-    if (track_j.shouldPublish() == false)
-    {
-      continue;
-    }
+    const tp::trackSnapshot& track_j = frame.tracks[k];
     visualization_msgs::Marker m;
     m.type = visualization_msgs::Marker::CUBE;
     m.header.frame_id = "world";
@@ -899,14 +1383,14 @@ visualization_msgs::MarkerArray TrackerPredictor::getBBoxesAsMarkerArray()
 
     m.color = color;  // color(BLUE_TRANS_TRANS);
 
-    Eigen::Vector3d centroid = track_j.getLatestCentroid();
+    Eigen::Vector3d centroid = track_j.latest_centroid;
 
     m.pose.position.x = centroid.x();
     m.pose.position.y = centroid.y();
     m.pose.position.z = centroid.z();
 
-    // Eigen::Vector3d bbox = track_j.getLatestBbox();
-    Eigen::Vector3d bbox = track_j.getMaxBbox();
+    // Eigen::Vector3d bbox = track_j.latest_bbox;
+    Eigen::Vector3d bbox = track_j.max_bbox;
 
     m.scale.x = bbox.x();
     m.scale.y = bbox.y();
@@ -0,0 +1,220 @@
+/* ----------------------------------------------------------------------------
+ * Copyright 2021, Jesus Tordesillas Torres, Aerospace Controls Laboratory
+ * Massachusetts Institute of Technology
+ * All Rights Reserved
+ * Authors: Jesus Tordesillas, et al.
+ * See LICENSE file for the license information
+ * -------------------------------------------------------------------------- */
+
+#include "traj_batch.hpp"
+
+#include <cstring>
+#include <limits>
+
+#include "byte_buffer.hpp"
+
+// Layout of the buffer:
+//  header:     uint8 version | uint8 deg_mean | uint8 deg_var | uint16 num_trajs
+//  trajectory: uint8 flags | int32 id | float bbox[3] | float pos[3] | double t0 | uint16 num_intervals |
+//              num_intervals x interval
+// where interval = float t_end-t0 | float coeff_mean[3*(deg_mean+1)] | float coeff_var[3*(deg_var+1)], and each
+// coeff_ is [x coefficients, y coefficients, z coefficients], highest power first (as in mt::PieceWisePol)
+
+namespace
+{
+const uint8_t VERSION = 1;
+
+const uint8_t FLAG_IS_AGENT = 1 << 0;
+
+const size_t POS_NUM_TRAJS = 3 * sizeof(uint8_t);
+const int MAX_DEGREE = 20;
+
+// Writes the coefficients with deg+1 elements (padding with zeros the highest powers)
+void writeCoeff(std::vector<uint8_t>& buffer, const Eigen::VectorXd& coeff, int deg)
+{
+  for (int i = 0; i < deg + 1 - coeff.size(); i++)
+  {
+    mt::writeBytes<float>(buffer, 0.0f);
+  }
+  for (int i = 0; i < coeff.size(); i++)
+  {
+    mt::writeBytes<float>(buffer, coeff(i));
+  }
+}
+
+bool canBeEncoded(const mt::PieceWisePol& pwp, int deg)
+{
+  int num_intervals = pwp.getNumOfIntervals();
+  if (pwp.times.size() < 2 || num_intervals > std::numeric_limits<uint16_t>::max() ||
+      pwp.all_coeff_x.size() != num_intervals || pwp.all_coeff_y.size() != num_intervals ||
+      pwp.all_coeff_z.size() != num_intervals)
+  {
+    return false;
+  }
+  for (int j = 0; j < num_intervals; j++)
+  {
+    if (pwp.all_coeff_x[j].size() > deg + 1 || pwp.all_coeff_y[j].size() > deg + 1 ||
+        pwp.all_coeff_z[j].size() > deg + 1)
+    {
+      return false;
+    }
+  }
+  return true;
+}
+
+bool readCoeff(mt::byteReader& r, Eigen::VectorXd& coeff, int deg)
+{
+  float tmp[MAX_DEGREE + 1];
+  if (!r.readArray(tmp, deg + 1))
+  {
+    return false;
+  }
+  coeff.resize(deg + 1);
+  for (int i = 0; i <= deg; i++)
+  {
+    coeff(i) = tmp[i];
+  }
+  return true;
+}
+}  // namespace
+
+void TrajBatchEncoder::start(int deg_mean, int deg_var)
+{
+  deg_mean_ = deg_mean;
+  deg_var_ = deg_var;
+  num_trajs_ = 0;
+
+  buffer_.clear();
+  mt::writeBytes<uint8_t>(buffer_, VERSION);
+  mt::writeBytes<uint8_t>(buffer_, deg_mean_);
+  mt::writeBytes<uint8_t>(buffer_, deg_var_);
+  mt::writeBytes<uint16_t>(buffer_, num_trajs_);
+}
+
+bool TrajBatchEncoder::add(const mt::PieceWisePol& pwp_mean, const mt::PieceWisePol& pwp_var,
+                           const mt::compactTrajInfo& info)
+{
+  if (num_trajs_ == std::numeric_limits<uint16_t>::max() || !canBeEncoded(pwp_mean, deg_mean_) ||
+      !canBeEncoded(pwp_var, deg_var_) || pwp_mean.times != pwp_var.times)
+  {
+    return false;
+  }
+
+  mt::writeBytes<uint8_t>(buffer_, info.is_agent ? FLAG_IS_AGENT : 0);
+  mt::writeBytes<int32_t>(buffer_, info.id);
+  for (int i = 0; i < 3; i++)
+  {
+    mt::writeBytes<float>(buffer_, info.bbox(i));
+  }
+  for (int i = 0; i < 3; i++)
+  {
+    mt::writeBytes<float>(buffer_, info.pos(i));
+  }
+
+  double t0 = pwp_mean.times.front();
+  mt::writeBytes<double>(buffer_, t0);
+  mt::writeBytes<uint16_t>(buffer_, pwp_mean.getNumOfIntervals());
+  for (int j = 0; j < pwp_mean.getNumOfIntervals(); j++)
+  {
+    mt::writeBytes<float>(buffer_, pwp_mean.times[j + 1] - t0);
+    writeCoeff(buffer_, pwp_mean.all_coeff_x[j], deg_mean_);
+    writeCoeff(buffer_, pwp_mean.all_coeff_y[j], deg_mean_);
+    writeCoeff(buffer_, pwp_mean.all_coeff_z[j], deg_mean_);
+    writeCoeff(buffer_, pwp_var.all_coeff_x[j], deg_var_);
+    writeCoeff(buffer_, pwp_var.all_coeff_y[j], deg_var_);
+    writeCoeff(buffer_, pwp_var.all_coeff_z[j], deg_var_);
+  }
+
+  num_trajs_++;
+  std::memcpy(&buffer_[POS_NUM_TRAJS], &num_trajs_, sizeof(num_trajs_));
+  return true;
+}
+
+int TrajBatchEncoder::getNumTrajs() const
+{
+  return num_trajs_;
+}
+
+const std::vector<uint8_t>& TrajBatchEncoder::getBuffer() const
+{
+  return buffer_;
+}
+
+bool TrajBatchDecoder::decode(const uint8_t* data, size_t size, std::vector<mt::compactTrajInfo>& infos,
+                              std::vector<mt::dynTraj>& trajs)
+{
+  infos.clear();
+  trajs.clear();
+
+  mt::byteReader r(data, size);
+  uint8_t version, deg_mean, deg_var;
+  uint16_t num_trajs;
+  if (!r.read(version) || version != VERSION || !r.read(deg_mean) || !r.read(deg_var) || !r.read(num_trajs) ||
+      deg_mean > MAX_DEGREE || deg_var > MAX_DEGREE)
+  {
+    return false;
+  }
+
+  infos.resize(num_trajs);
+  trajs.resize(num_trajs);
+  for (int i = 0; i < num_trajs; i++)
+  {
+    mt::compactTrajInfo& info = infos[i];
+    mt::dynTraj& traj = trajs[i];
+
+    uint8_t flags;
+    int32_t id;
+    float bbox[3], pos[3];
+    bool ok = r.read(flags) && r.read(id);
+    for (int k = 0; k < 3; k++)
+    {
+      ok = ok && r.read(bbox[k]);
+    }
+    for (int k = 0; k < 3; k++)
+    {
+      ok = ok && r.read(pos[k]);
+    }
+
+    double t0;
+    uint16_t num_intervals;
+    if (!ok || !r.read(t0) || !r.read(num_intervals) || num_intervals == 0)
+    {
+      return false;
+    }
+
+    info.id = id;
+    info.is_agent = (flags & FLAG_IS_AGENT);
+    info.bbox << bbox[0], bbox[1], bbox[2];
+    info.pos << pos[0], pos[1], pos[2];
+
+    traj.use_pwp_field = true;
+    traj.pwp_mean.clear();
+    traj.pwp_var.clear();
+    traj.pwp_mean.times.push_back(t0);
+    for (int j = 0; j < num_intervals; j++)
+    {
+      float t_end;
+      Eigen::VectorXd cx, cy, cz, vx, vy, vz;
+      if (!r.read(t_end) || !readCoeff(r, cx, deg_mean) || !readCoeff(r, cy, deg_mean) ||
+          !readCoeff(r, cz, deg_mean) || !readCoeff(r, vx, deg_var) || !readCoeff(r, vy, deg_var) ||
+          !readCoeff(r, vz, deg_var))
+      {
+        return false;
+      }
+      traj.pwp_mean.times.push_back(t0 + t_end);
+      traj.pwp_mean.all_coeff_x.push_back(cx);
+      traj.pwp_mean.all_coeff_y.push_back(cy);
+      traj.pwp_mean.all_coeff_z.push_back(cz);
+      traj.pwp_var.all_coeff_x.push_back(vx);
+      traj.pwp_var.all_coeff_y.push_back(vy);
+      traj.pwp_var.all_coeff_z.push_back(vz);
+    }
+    traj.pwp_var.times = traj.pwp_mean.times;
+
+    traj.bbox = info.bbox;
+    traj.id = info.id;
+    traj.is_agent = info.is_agent;
+  }
+
+  return true;
+}
@@ -342,6 +342,32 @@ panther_msgs::PieceWisePolTraj pwp2PwpMsg(const mt::PieceWisePol& pwp)
   return pwp_msg;
 }
 
+panther_msgs::PieceWisePolTraj pwp2PwpMsg(const mt::PieceWisePolDeque& pwp)
+{
+  panther_msgs::PieceWisePolTraj pwp_msg;
+
+  pwp_msg.times.reserve(pwp.intervals.size() + 1);
+  pwp_msg.all_coeff_x.reserve(pwp.intervals.size());
+  pwp_msg.all_coeff_y.reserve(pwp.intervals.size());
+  pwp_msg.all_coeff_z.reserve(pwp.intervals.size());
+
+  pwp_msg.times.push_back(pwp.t_start);
+  for (auto& interval_i : pwp.intervals)
+  {
+    pwp_msg.times.push_back(interval_i.t_end);
+
+    panther_msgs::CoeffPoly coeff_poly3;
+    coeff_poly3.data.assign(interval_i.coeff_x.data(), interval_i.coeff_x.data() + interval_i.coeff_x.size());
+    pwp_msg.all_coeff_x.push_back(coeff_poly3);
+    coeff_poly3.data.assign(interval_i.coeff_y.data(), interval_i.coeff_y.data() + interval_i.coeff_y.size());
+    pwp_msg.all_coeff_y.push_back(coeff_poly3);
+    coeff_poly3.data.assign(interval_i.coeff_z.data(), interval_i.coeff_z.data() + interval_i.coeff_z.size());
+    pwp_msg.all_coeff_z.push_back(coeff_poly3);
+  }
+
+  return pwp_msg;
+}
+
 void verify(bool cond, std::string info_if_false)
 {
   if (cond == false)
@@ -537,6 +563,76 @@ mt::PieceWisePol composePieceWisePol(const double t, const double dc, mt::PieceW
   return p;
 }
 
+void composePieceWisePol(const double t, const double dc, mt::PieceWisePolDeque& p1, mt::PieceWisePol& p2)
+{
+  if (p1.empty())
+  {
+    p1.fromPieceWisePol(p2);
+    return;
+  }
+
+  // Same adjustments of the times as in the function above
+  if (t > p1.timeEnd() && t < p2.times.front())
+  {
+    p2.times.front() = t;
+  }
+
+  if (p1.timeEnd() < p2.times.front())
+  {
+    p2.times.front() = p1.timeEnd();
+  }
+
+  if (t < p1.t_start)
+  {
+    p1.t_start = t;
+  }
+
+  if (fabs(t - p2.times.front()) < 1e-5 || t > p2.times.back() || t < p1.t_start)
+  {
+    p1.fromPieceWisePol(p2);
+    return;
+  }
+
+  // Remove the part of p1 that is after p2.times.front()
+  double t2 = p2.times.front();
+  while (!p1.empty() && p1.timeStart(p1.intervals.size() - 1) >= t2)
+  {
+    p1.intervals.pop_back();
+  }
+  if (p1.empty())
+  {
+    p1.t_start = t2;
+  }
+  else if (p1.timeEnd() > t2)
+  {
+    mt::PieceWisePolDeque::interval& last = p1.intervals.back();
+    double t_start_last = p1.timeStart(p1.intervals.size() - 1);
+    double u_end = (t2 - t_start_last) / (last.t_end - t_start_last);
+    changeDomPoly(Eigen::VectorXd(last.coeff_x), 0.0, u_end, last.coeff_x, 0.0, 1.0);
+    changeDomPoly(Eigen::VectorXd(last.coeff_y), 0.0, u_end, last.coeff_y, 0.0, 1.0);
+    changeDomPoly(Eigen::VectorXd(last.coeff_z), 0.0, u_end, last.coeff_z, 0.0, 1.0);
+    last.t_end = t2;
+  }
+
+  p1.appendPieceWisePol(p2);
+
+  // Remove the part that is before t
+  while (p1.intervals.size() > 1 && p1.intervals.front().t_end <= t)
+  {
+    p1.t_start = p1.intervals.front().t_end;
+    p1.intervals.pop_front();
+  }
+  if (t > p1.t_start && t < p1.intervals.front().t_end)
+  {
+    mt::PieceWisePolDeque::interval& first = p1.intervals.front();
+    double u_start = (t - p1.t_start) / (first.t_end - p1.t_start);
+    changeDomPoly(Eigen::VectorXd(first.coeff_x), u_start, 1.0, first.coeff_x, 0.0, 1.0);
+    changeDomPoly(Eigen::VectorXd(first.coeff_y), u_start, 1.0, first.coeff_y, 0.0, 1.0);
+    changeDomPoly(Eigen::VectorXd(first.coeff_z), u_start, 1.0, first.coeff_z, 0.0, 1.0);
+    p1.t_start = t;
+  }
+}
+
 std::vector<std::string> pieceWisePol2String(const mt::PieceWisePol& pwp)
 {
   // Define strings
@@ -27,6 +27,9 @@
 #include <iostream>
 #include <fstream>
 #include <math.h>  // for sqrt
+#include <cmath>
+#include <algorithm>
+#include <limits>
 #include <ros/package.h>
 
 using namespace boost;
@@ -97,11 +100,141 @@ private:
 ////////////////////////////////////////
 ////////////////////////////////////////
 
-casadi::DM SolverIpopt::generateYawGuess(casadi::DM matrix_qp_guess, casadi::DM all_w_fe, double y0, double ydot0,
-                                         double ydotf, double t0, double tf)
+// Graph used by the Boost A* yaw search (only needed if par_.use_boost_yaw_search==true)
+void SolverIpopt::createBoostYawGraph()
 {
-  WeightMap weightmap = get(boost::edge_weight, mygraph_);
+  // mygraph_t mygraph_(0);  // start a graph with 0 vertices
+  mygraph_.clear();
+
+  // create all the vertexes and add them to the graph
+  std::vector<std::vector<vd>> all_vertexes_tmp(num_of_layers_ - 1, std::vector<vd>(num_of_yaw_per_layer_));  // TODO
+  all_vertexes_ = all_vertexes_tmp;
+  std::vector<vd> tmp(1);  // first layer only one element
+  all_vertexes_.insert(all_vertexes_.begin(), tmp);
+
+  // https://stackoverflow.com/questions/47904550/should-i-keep-track-of-vertex-descriptors-in-boost-graph-library
 
+  double y0_tmp = 0.0;  // this value will be updated at the start of each iteration
+
+  // add rest of the vertexes
+  for (size_t i = 0; i < num_of_layers_; i++)  // i is the index of each layer
+  {
+    size_t num_of_circles_layer_i = (i == 0) ? 1 : num_of_yaw_per_layer_;
+    for (size_t j = 0; j < num_of_circles_layer_i; j++)  // j is the index of each  circle in the layer i
+    {
+      vd vertex1 = boost::add_vertex(mygraph_);
+      all_vertexes_[i][j] = vertex1;
+      mygraph_[vertex1].yaw = (i == 0) ? y0_tmp : double(vector_yaw_samples_(j));
+      mygraph_[vertex1].layer = i;
+      mygraph_[vertex1].circle = j;
+      // mygraph_[vertex1].print();
+      // std::cout << "So far, the graph has " << num_vertices(mygraph_) << "vertices" << std::endl;
+    }
+  }
+
+  for (size_t i = 0; i < (num_of_layers_ - 1); i++)  // i is the number of layers
+  {
+    size_t num_of_circles_layer_i = (i == 0) ? 1 : num_of_yaw_per_layer_;
+
+    for (size_t j = 0; j < num_of_circles_layer_i; j++)  // j is the circle index of layer i
+    {
+      for (size_t j_next = 0; j_next < num_of_yaw_per_layer_; j_next++)
+      {
+        vd index_vertex1 = all_vertexes_[i][j];
+        vd index_vertex2 = all_vertexes_[i + 1][j_next];
+
+        // std::cout <<  mygraph_[index_vertex2].layer << ", " << mygraph_[index_vertex2].circle
+        //           << std::endl;
+        // std::cout <<  i + 1 << ", " << j_next << std::endl;
+
+        edge_descriptor e;
+        bool inserted;
+        boost::tie(e, inserted) = add_edge(index_vertex1, index_vertex2, mygraph_);
+      }
+    }
+  }
+}
+
+// Fills vis_matrix_ (row i is the layer i, column j is the yaw sample j). The layers are the Simpson samples, uniformly
+// distributed in [t0, tf] (including both), and all_w_fe has the positions of the feature at those times.
+// This is the same computation as the one in visibility.casadi (see main.m), but done in a single pass over the layers:
+// since w_R_b = R_abc*Rz(yaw), the position of the feature in the frame abc is computed once per layer, and only the
+// (branch-free) rotation in yaw + FOV test is done for each yaw sample, over contiguous arrays.
+void SolverIpopt::computeVisibilityMatrix(const casadi::DM &matrix_qp_guess, const casadi::DM &all_w_fe,
+                                          double total_time)
+{
+  if (par_.use_casadi_visibility == true)
+  {
+    computeVisibilityMatrixCasadi(matrix_qp_guess, all_w_fe, total_time);
+    return;
+  }
+
+  int num_of_layers = num_of_layers_;
+  int num_of_yaw = num_of_yaw_per_layer_;
+  int num_seg = par_.num_seg;
+
+  std::vector<double> qp = casadi::DM::densify(matrix_qp_guess).nonzeros();  // column-major, 3x(N_+1)
+  std::vector<double> w_fe = casadi::DM::densify(all_w_fe).nonzeros();       // column-major, 3x(num_of_layers)
+
+  double deltaT = total_time / num_seg;  // duration of each interval of the position spline
+  double cos_half_fov = cos((par_.fov_x_deg / 2.0) * M_PI / 180.0);
+
+  Eigen::Matrix3d c_R_b = par_.c_T_b.rotation();
+  Eigen::Vector3d c_t_b = par_.c_T_b.translation();
+  double r00 = c_R_b(0, 0), r01 = c_R_b(0, 1), r02 = c_R_b(0, 2);
+  double r10 = c_R_b(1, 0), r11 = c_R_b(1, 1), r12 = c_R_b(1, 2);
+  double r20 = c_R_b(2, 0), r21 = c_R_b(2, 1), r22 = c_R_b(2, 2);
+  double tx = c_t_b.x(), ty = c_t_b.y(), tz = c_t_b.z();
+
+  const double *cos_yaw = cos_yaw_samples_.data();
+  const double *sin_yaw = sin_yaw_samples_.data();
+
+  for (int i = 0; i < num_of_layers; i++)
+  {
+    // Interval and u \in [0,1] of this sample
+    double t_n = (num_of_layers == 1) ? 0.0 : (double(i) / (num_of_layers - 1));  // normalized time \in [0,1]
+    int j = std::min(int(t_n * num_seg), num_seg - 1);
+    double u = t_n * num_seg - j;
+
+    Eigen::Matrix<double, 3, 4> Q;  // control points of the interval j
+    for (int k = 0; k < 4; k++)
+    {
+      Q.col(k) << qp[3 * (j + k)], qp[3 * (j + k) + 1], qp[3 * (j + k) + 2];
+    }
+    Eigen::Matrix<double, 3, 4> QA = Q * basis_tables_->getAPosBSpline(j, num_seg);
+    Eigen::Vector3d w_t_b = QA * Eigen::Vector4d(u * u * u, u * u, u, 1.0);
+    Eigen::Vector3d accel = QA * Eigen::Vector4d(6 * u, 2.0, 0.0, 0.0) / (deltaT * deltaT);
+
+    // Rotation given by the acceleration (i.e., w_R_b for yaw=0), see qabcFromAccel
+    Eigen::Vector3d thrust = accel + Eigen::Vector3d(0.0, 0.0, 9.81);
+    Eigen::Quaterniond qabc(thrust.norm() + thrust.z(), -thrust.y(), thrust.x(), 0.0);
+    qabc.normalize();
+
+    Eigen::Vector3d w_fe_i(w_fe[3 * i], w_fe[3 * i + 1], w_fe[3 * i + 2]);
+    Eigen::Vector3d v = qabc.toRotationMatrix().transpose() * (w_fe_i - w_t_b);  // feature in the frame abc
+    double vx = v.x(), vy = v.y(), vz = v.z();
+
+    double *vis_row = &vis_matrix_[i * num_of_yaw];
+    for (int k = 0; k < num_of_yaw; k++)
+    {
+      // Feature in the body frame: b_P = Rz(yaw)'*v
+      double bx = cos_yaw[k] * vx + sin_yaw[k] * vy;
+      double by = -sin_yaw[k] * vx + cos_yaw[k] * vy;
+
+      // Feature in the camera frame: c_P = c_T_b*b_P
+      double cx = r00 * bx + r01 * by + r02 * vz + tx;
+      double cy = r10 * bx + r11 * by + r12 * vz + ty;
+      double cz = r20 * bx + r21 * by + r22 * vz + tz;
+
+      double is_in_FOV = -cos_half_fov + cz / sqrt(cx * cx + cy * cy + cz * cz);
+      vis_row[k] = 1.0 / (1.0 + exp(-gamma_visibility_ * is_in_FOV));
+    }
+  }
+}
+
+void SolverIpopt::computeVisibilityMatrixCasadi(const casadi::DM &matrix_qp_guess, const casadi::DM &all_w_fe,
+                                                double total_time)
+{
   std::map<std::string, casadi::DM> map_arg;
   map_arg["thetax_FOV_deg"] = par_.fov_x_deg;
   map_arg["thetay_FOV_deg"] = par_.fov_y_deg;
@@ -109,19 +242,110 @@ casadi::DM SolverIpopt::generateYawGuess(casadi::DM matrix_qp_guess, casadi::DM
   map_arg["all_w_fe"] = all_w_fe;
   map_arg["pCPs"] = matrix_qp_guess;
   map_arg["yaw_samples"] = vector_yaw_samples_;
-  map_arg["total_time"] = (tf - t0);
+  map_arg["total_time"] = total_time;
 
   std::map<std::string, casadi::DM> result = cf_visibility_(map_arg);
-  casadi::DM vis_matrix_casadi = result["result"];  // Its values are in [0.1]
-                                                    // It's a matrix of size (num_of_layers_)x(num_of_yaw_per_layer_)
-                                                    // we won't use its 1st col  (since y0 is given)
+  // Its values are in [0.1]. It's a matrix of size (num_of_layers_)x(num_of_yaw_per_layer_) (column-major)
+  // we won't use its 1st row  (since y0 is given)
+  std::vector<double> vis_col_major = casadi::DM::densify(result["result"]).nonzeros();
+
+  int num_of_layers = num_of_layers_;
+  int num_of_yaw_per_layer = num_of_yaw_per_layer_;
+  for (int i = 0; i < num_of_layers; i++)
+  {
+    for (int j = 0; j < num_of_yaw_per_layer; j++)
+    {
+      vis_matrix_[i * num_of_yaw_per_layer + j] = vis_col_major[j * num_of_layers + i];
+    }
+  }
+}
+
+// Viterbi-like search over the layers (the graph is a layered DAG, so each layer only depends on the previous one).
+// Gives the same optimum as the Boost A* with zero heuristic, in O(num_of_layers*num_of_yaw_per_layer^2) and without
+// allocating memory. The cost of an edge is the same as in searchYawBoostAStar()
+bool SolverIpopt::searchYawDP(double y0, double deltaT, std::vector<double> &yaw_path)
+{
+  int num_of_layers = num_of_layers_;
+  int num_of_yaw = num_of_yaw_per_layer_;
+
+  yaw_path.resize(num_of_layers);
+  yaw_path[0] = y0;
+  if (num_of_layers == 1)
+  {
+    return true;
+  }
+
+  // Cost of going from yaw sample j to yaw sample k (the visibility cost is added later, it depends on the layer)
+  for (int j = 0; j < num_of_yaw; j++)
+  {
+    for (int k = 0; k < num_of_yaw; k++)
+    {
+      double distance = dist_yaw_samples_[j * num_of_yaw + k];
+      dp_transition_[j * num_of_yaw + k] =
+          par_.c_smooth_yaw_search * distance * distance + ((distance / deltaT) > par_.ydot_max) * 1e6;
+    }
+  }
+
+  double *cost_prev = &dp_cost_[0];
+  double *cost_now = &dp_cost_[num_of_yaw];
+
+  // Layer 1 (the layer 0 has only one vertex, y0)
+  for (int k = 0; k < num_of_yaw; k++)
+  {
+    double distance = fabs(wrapFromMPitoPi(y0 - yaw_samples_[k]));
+    cost_prev[k] = par_.c_smooth_yaw_search * distance * distance +
+                   par_.c_visibility_yaw_search * (1.0 - vis_matrix_[num_of_yaw + k]) +
+                   ((distance / deltaT) > par_.ydot_max) * 1e6;
+    dp_predecessor_[num_of_yaw + k] = 0;
+  }
+
+  // Rest of the layers
+  for (int i = 2; i < num_of_layers; i++)
+  {
+    for (int k = 0; k < num_of_yaw; k++)
+    {
+      double best_cost = std::numeric_limits<double>::infinity();
+      int best_j = 0;
+      for (int j = 0; j < num_of_yaw; j++)
+      {
+        double cost = cost_prev[j] + dp_transition_[j * num_of_yaw + k];
+        if (cost < best_cost)
+        {
+          best_cost = cost;
+          best_j = j;
+        }
+      }
+      cost_now[k] = best_cost + par_.c_visibility_yaw_search * (1.0 - vis_matrix_[i * num_of_yaw + k]);
+      dp_predecessor_[i * num_of_yaw + k] = best_j;
+    }
+    std::swap(cost_prev, cost_now);
+  }
+
+  // Best vertex of the last layer
+  int best_k = std::min_element(cost_prev, cost_prev + num_of_yaw) - cost_prev;
+  if (std::isfinite(cost_prev[best_k]) == false)
+  {
+    return false;  // Can happen if there are nans
+  }
+
+  // Backtrack
+  for (int i = num_of_layers - 1; i >= 1; i--)
+  {
+    yaw_path[i] = yaw_samples_[best_k];
+    best_k = dp_predecessor_[i * num_of_yaw + best_k];
+  }
+
+  return true;
+}
+
+bool SolverIpopt::searchYawBoostAStar(double y0, double deltaT, std::vector<double> &yaw_path)
+{
+  WeightMap weightmap = get(boost::edge_weight, mygraph_);
 
   // std::cout << bold << yellow << "y0= " << y0 << reset << std::endl;
   // Set the value of the first node (initial yaw)
   mygraph_[all_vertexes_[0][0]].yaw = y0;
 
-  double deltaT = (tf - t0) / (double(num_of_layers_));
-
   //////////////////////// Iterate through all the edges of the graph and add the cost
   auto es = boost::edges(mygraph_);
   for (auto ed_ptr = es.first; ed_ptr != es.second; ++ed_ptr)  // ed_ptr is edge descriptor pointer
@@ -131,10 +355,8 @@ casadi::DM SolverIpopt::generateYawGuess(casadi::DM matrix_qp_guess, casadi::DM
 
     // std::cout << boost::source(*ed_ptr, mygraph_) << ' ' << boost::target(*ed_ptr, mygraph_) << std::endl;
 
-    double visibility = double(vis_matrix_casadi(
-        mygraph_[index_vertex2].layer, mygraph_[index_vertex2].circle));  // \in [0,1]
-                                                                          // Note that vis_matrix_casadi has in the rows
-                                                                          // the circles, in the columns the layers.
+    double visibility = vis_matrix_[mygraph_[index_vertex2].layer * num_of_yaw_per_layer_ +
+                                    mygraph_[index_vertex2].circle];  // \in [0,1]
 
     // TODO: the distance cost is fixed (don't change in each iteration --> add it only once at the beginning?)
     double distance = abs(wrapFromMPitoPi(mygraph_[index_vertex1].yaw - mygraph_[index_vertex2].yaw));
@@ -160,7 +382,6 @@ casadi::DM SolverIpopt::generateYawGuess(casadi::DM matrix_qp_guess, casadi::DM
   std::vector<vd> p(num_vertices(mygraph_));
   std::vector<cost_graph> d(num_vertices(mygraph_));
 
-  log_ptr_->tim_guess_yaw_search_graph.tic();
   try
   {
     // call astar named parameter interface
@@ -172,8 +393,6 @@ casadi::DM SolverIpopt::generateYawGuess(casadi::DM matrix_qp_guess, casadi::DM
 
   catch (found_goal<vd> fg)
   {
-    log_ptr_->tim_guess_yaw_search_graph.toc();
-
     // found a path to the goal
     std::list<vd> shortest_path_vd;
     for (vd v = fg.get_goal_found();; v = p[v])
@@ -184,154 +403,159 @@ casadi::DM SolverIpopt::generateYawGuess(casadi::DM matrix_qp_guess, casadi::DM
         break;
       }
     }
-    std::list<vd>::iterator spi = shortest_path_vd.begin();
-    // std::cout << mygraph_[all_vertexes_[0][0]].yaw;
-    // std::cout << "shortest_path_vd.size()= " << shortest_path_vd.size() << std::endl;
 
-    casadi::DM vector_shortest_path(1, shortest_path_vd.size());  // TODO: do this just once?
+    yaw_path.clear();
+    for (auto spi = shortest_path_vd.begin(); spi != shortest_path_vd.end(); ++spi)
+    {
+      // std::cout << "layer = " << mygraph_[*spi].layer << ", circle=" << mygraph_[*spi].circle << std::endl;
+      yaw_path.push_back(mygraph_[*spi].yaw);
+    }
+    // cout << endl << "\nTotal cost: " << d[fg.get_goal_found()] << endl;
 
-    vector_shortest_path(0) = mygraph_[*spi].yaw;
+    return true;
+  }
 
-    int i = 1;
+  return false;
+}
 
-    for (++spi; spi != shortest_path_vd.end(); ++spi)
-    {
-      // double yaw_tmp = mygraph_[*spi].yaw;
-      // std::cout << "layer = " << mygraph_[*spi].layer << ", circle=" << mygraph_[*spi].circle << std::endl;
+casadi::DM SolverIpopt::generateYawGuess(casadi::DM matrix_qp_guess, casadi::DM all_w_fe, double y0, double ydot0,
+                                         double ydotf, double t0, double tf)
+{
+  computeVisibilityMatrix(matrix_qp_guess, all_w_fe, (tf - t0));
 
-      vector_shortest_path(i) = mygraph_[*spi].yaw;
-      i = i + 1;
-    }
+  double deltaT = (tf - t0) / (double(num_of_layers_));
+
+  std::vector<double> yaw_path;
+
+  log_ptr_->tim_guess_yaw_search_graph.tic();
+  bool found = (par_.use_boost_yaw_search == true) ? searchYawBoostAStar(y0, deltaT, yaw_path) :
+                                                     searchYawDP(y0, deltaT, yaw_path);
+  log_ptr_->tim_guess_yaw_search_graph.toc();
+
+  if (found == false)
+  {
+    log_ptr_->success_guess_yaw = false;
+
+    std::cout << red << bold << "Yaw search didn't find a path!! " << std::endl;  // [Can happen if there are nans I think]
+
+    //////// Debugging
+    // abort();
+    ///////////////////
+
+    casadi::DM constant_yaw_matrix_casadi = y0 * casadi::DM::ones(1, Ny_ + 1);
+
+    return constant_yaw_matrix_casadi;
+  }
+
+  casadi::DM vector_shortest_path(yaw_path);  // column vector
+  vector_shortest_path = vector_shortest_path.T();
 
-    // std::cout << "vector_yaw_samples_=\n" << vector_yaw_samples_ << std::endl;
-    // std::cout << "vis_matrix_casadi=\n" << vis_matrix_casadi << std::endl;
+  // std::cout << "vector_yaw_samples_=\n" << vector_yaw_samples_ << std::endl;
 
-    //////////////////////////////////////////////////////////////////////////////
-    /////////////////////PRINT SHORTEST PATH AND VISIBILITY MATRIX////////////////
-    //////////////////////////////////////////////////////////////////////////////
-    if (par_.print_graph_yaw_info)
+  //////////////////////////////////////////////////////////////////////////////
+  /////////////////////PRINT SHORTEST PATH AND VISIBILITY MATRIX////////////////
+  //////////////////////////////////////////////////////////////////////////////
+  if (par_.print_graph_yaw_info)
+  {
+    for (int j = 0; j < num_of_yaw_per_layer_; j++)
     {
-      for (int j = 0; j < vector_yaw_samples_.numel(); j++)
-      {
-        std::cout << right << std::fixed << std::setw(8) << std::setfill(' ') << "[" << j << "]" << reset;
-      }
-      std::cout << std::endl;
-      for (int j = 0; j < vector_yaw_samples_.numel(); j++)
-      {
-        std::cout << right << std::fixed << std::setw(8) << std::setfill(' ') << blue << vector_yaw_samples_(j)
-                  << reset;
-      }
-      std::cout << std::endl;
+      std::cout << right << std::fixed << std::setw(8) << std::setfill(' ') << "[" << j << "]" << reset;
+    }
+    std::cout << std::endl;
+    for (int j = 0; j < num_of_yaw_per_layer_; j++)
+    {
+      std::cout << right << std::fixed << std::setw(8) << std::setfill(' ') << blue << yaw_samples_[j] << reset;
+    }
+    std::cout << std::endl;
 
-      for (int i = 0; i < vis_matrix_casadi.rows(); i++)
+    for (int i = 0; i < num_of_layers_; i++)
+    {
+      std::cout << "[" << i << "] ";
+      for (int j = 0; j < num_of_yaw_per_layer_; j++)
       {
-        std::cout << "[" << i << "] ";
-        for (int j = 0; j < vis_matrix_casadi.columns(); j++)
+        std::cout << right << std::fixed << std::setw(8) << std::setfill(' ');
+        if (abs(yaw_samples_[j] - yaw_path[i]) < 1e-5)
         {
-          {
-            std::cout << right << std::fixed << std::setw(8) << std::setfill(' ');
-            if (abs(double(vector_yaw_samples_(j)) - double(vector_shortest_path(i))) < 1e-5)
-            {
-              std::cout << "\033[0;31m";
-            }
-            else
-            {
-              // std::cout << left << std::fixed << std::setw(8) << std::setfill(' ') << vis_matrix_casadi(i, j) <<
-              // reset;
-            }
-
-            std::cout << vis_matrix_casadi(i, j) << reset;
-          }
+          std::cout << "\033[0;31m";
         }
-        std::cout << std::endl;
+
+        std::cout << vis_matrix_[i * num_of_yaw_per_layer_ + j] << reset;
       }
+      std::cout << std::endl;
     }
-    std::cout << "Shortest path: ";
-    for (int i = 0; i < vector_shortest_path.numel(); i++)
+  }
+  std::cout << "Shortest path: ";
+  for (int i = 0; i < yaw_path.size(); i++)
+  {
+    std::cout << yellow << yaw_path[i];
+    if (i != (yaw_path.size() - 1))
     {
-      std::cout << yellow << vector_shortest_path(i);
-      if (i != (vector_shortest_path.numel() - 1))
-      {
-        std::cout << " --> ";
-      }
-      std::cout << reset;
+      std::cout << " --> ";
     }
-    std::cout << std::endl;
-    // cout << endl << "\nTotal cost: " << d[fg.get_goal_found()] << endl;
+    std::cout << reset;
+  }
+  std::cout << std::endl;
 
-    ///////////////////////////////////////////////////////////////
-    // Now fit a spline to the yaws found
-    /////////////////////////////////////////////////////////////
+  ///////////////////////////////////////////////////////////////
+  // Now fit a spline to the yaws found
+  /////////////////////////////////////////////////////////////
 
-    // First correct the angles so that the max absolute difference between two adjacent elements is <=pi
-    // See "fit_to_angular_data.m"
-    casadi::DM vsp_corrected = vector_shortest_path;
+  // First correct the angles so that the max absolute difference between two adjacent elements is <=pi
+  // See "fit_to_angular_data.m"
+  casadi::DM vsp_corrected = vector_shortest_path;
 
-    vsp_corrected(0) = vector_shortest_path(0);
-    for (size_t i = 1; i < vsp_corrected.columns(); i++)  // starts at 1, not at 0
-    {
-      double previous_phi = double(vsp_corrected(i - 1));
-      double phi_i = double(vsp_corrected(i));
-      double difference = previous_phi - phi_i;
+  vsp_corrected(0) = vector_shortest_path(0);
+  for (size_t i = 1; i < vsp_corrected.columns(); i++)  // starts at 1, not at 0
+  {
+    double previous_phi = double(vsp_corrected(i - 1));
+    double phi_i = double(vsp_corrected(i));
+    double difference = previous_phi - phi_i;
 
-      double phi_i_f = phi_i + floor(difference / (2 * M_PI)) * 2 * M_PI;
-      double phi_i_c = phi_i + ceil(difference / (2 * M_PI)) * 2 * M_PI;
+    double phi_i_f = phi_i + floor(difference / (2 * M_PI)) * 2 * M_PI;
+    double phi_i_c = phi_i + ceil(difference / (2 * M_PI)) * 2 * M_PI;
 
-      if (fabs(previous_phi - phi_i_f) < fabs(previous_phi - phi_i_c))
-      {
-        vsp_corrected(i) = phi_i_f;
-      }
-      else
-      {
-        vsp_corrected(i) = phi_i_c;
-      }
+    if (fabs(previous_phi - phi_i_f) < fabs(previous_phi - phi_i_c))
+    {
+      vsp_corrected(i) = phi_i_f;
+    }
+    else
+    {
+      vsp_corrected(i) = phi_i_c;
     }
-
-    //////////////// DEBUGGING
-    // for (size_t i = 1; i < vsp_corrected.columns(); i++)
-    // {
-    //   double phi_mi = double(vsp_corrected(i - 1));
-    //   double phi_i = double(vsp_corrected(i));
-
-    //   if (fabs(phi_i - phi_mi) > M_PI)
-    //   {
-    //     std::cout << red << bold << "This diff must be <= pi" << reset << std::endl;
-    //     abort();
-    //   }
-
-    //   // assert(fabs(phi_i - phi_mi) <= M_PI && "This diff must be <= pi");
-    // }
-    ////////////////////////////////
-
-    // std::cout << "vsp_corrected.columns()" << vsp_corrected.columns() << std::endl;
-
-    std::map<std::string, casadi::DM> map_arg2;
-    map_arg2["all_yaw"] = vsp_corrected;
-    // map_arg2["y0"] = y0; %Note that all_yaw[0] is used as the initial condition
-    map_arg2["ydot0"] = ydot0;
-    map_arg2["ydotf"] = ydotf;
-    map_arg2["total_time"] = (tf - t0);
-    log_ptr_->tim_guess_yaw_fit_poly.tic();
-    std::map<std::string, casadi::DM> result2 = cf_fit_yaw_(map_arg2);
-    log_ptr_->tim_guess_yaw_fit_poly.toc();
-    casadi::DM yaw_qps_matrix_casadi = result2["result"];
-
-    //////////////////////////////////////
-    //////////////////////////////////////
-    log_ptr_->success_guess_yaw = true;
-
-    return yaw_qps_matrix_casadi;
   }
-  log_ptr_->tim_guess_yaw_search_graph.toc();
-  log_ptr_->success_guess_yaw = false;
-
-  std::cout << red << bold << "Boost A* Didn't find a path!! " << std::endl;  // [Can happen if there are nans I think]
-
-  //////// Debugging
-  // abort();
-  ///////////////////
-
-  casadi::DM constant_yaw_matrix_casadi = y0 * casadi::DM::ones(1, Ny_ + 1);
 
-  return constant_yaw_matrix_casadi;
-}
\ No newline at end of file
+  //////////////// DEBUGGING
+  // for (size_t i = 1; i < vsp_corrected.columns(); i++)
+  // {
+  //   double phi_mi = double(vsp_corrected(i - 1));
+  //   double phi_i = double(vsp_corrected(i));
+
+  //   if (fabs(phi_i - phi_mi) > M_PI)
+  //   {
+  //     std::cout << red << bold << "This diff must be <= pi" << reset << std::endl;
+  //     abort();
+  //   }
+
+  //   // assert(fabs(phi_i - phi_mi) <= M_PI && "This diff must be <= pi");
+  // }
+  ////////////////////////////////
+
+  // std::cout << "vsp_corrected.columns()" << vsp_corrected.columns() << std::endl;
+
+  std::map<std::string, casadi::DM> map_arg2;
+  map_arg2["all_yaw"] = vsp_corrected;
+  // map_arg2["y0"] = y0; %Note that all_yaw[0] is used as the initial condition
+  map_arg2["ydot0"] = ydot0;
+  map_arg2["ydotf"] = ydotf;
+  map_arg2["total_time"] = (tf - t0);
+  log_ptr_->tim_guess_yaw_fit_poly.tic();
+  std::map<std::string, casadi::DM> result2 = cf_fit_yaw_(map_arg2);
+  log_ptr_->tim_guess_yaw_fit_poly.toc();
+  casadi::DM yaw_qps_matrix_casadi = result2["result"];
+
+  //////////////////////////////////////
+  //////////////////////////////////////
+  log_ptr_->success_guess_yaw = true;
+
+  return yaw_qps_matrix_casadi;
+}